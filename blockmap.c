@@ -0,0 +1,199 @@
+/**
+ * @file blockmap.c
+ * @brief A hash map keyed by block address
+ *
+ * The map uses open addressing with linear probing and Fibonacci hashing.
+ * Removal shifts later entries of the probe run backwards instead of
+ * leaving tombstones, so lookups never slow down as blocks are evicted.
+ * The table doubles whenever it becomes half full.
+ */
+
+#include <stdlib.h>
+
+#include "blockmap.h"
+
+/** @brief Smallest number of slots in a map */
+#define BLOCKMAP_MIN_SLOTS 64
+
+/** @brief Multiplier for Fibonacci hashing (2^64 / golden ratio) */
+#define BLOCKMAP_HASH_MULT 0x9e3779b97f4a7c15UL
+
+/**
+ * @brief Home slot of a key
+ */
+static inline size_t blockmap_slot(const blockmap_t *map, unsigned long key) {
+    return (size_t)((key * BLOCKMAP_HASH_MULT) >> map->shift);
+}
+
+/**
+ * @brief Allocate an empty table with the given number of slots
+ *
+ * @return true on success, false if memory allocation failed
+ */
+static bool blockmap_alloc(blockmap_t *map, size_t slots) {
+    map->keys = (unsigned long *)malloc(sizeof(unsigned long) * slots);
+    map->values = (unsigned long *)malloc(sizeof(unsigned long) * slots);
+    if (map->keys == NULL || map->values == NULL) {
+        free(map->keys);
+        free(map->values);
+        return false;
+    }
+    for (size_t i = 0; i < slots; i++) {
+        map->keys[i] = BLOCKMAP_EMPTY;
+    }
+    map->mask = slots - 1;
+    map->shift = 64;
+    for (size_t n = slots; n > 1; n >>= 1) {
+        map->shift--;
+    }
+    return true;
+}
+
+/**
+ * @brief Initialize a map sized for about hint keys
+ *
+ * @param[out] map  The map to initialize
+ * @param[in]  hint Expected number of keys; the map grows as needed
+ *
+ * @return true on success, false if memory allocation failed
+ */
+bool blockmap_init(blockmap_t *map, size_t hint) {
+    size_t slots = BLOCKMAP_MIN_SLOTS;
+    while (slots < 2 * hint) {
+        slots <<= 1;
+    }
+    map->count = 0;
+    map->has_empty_key = false;
+    map->empty_value = 0;
+    return blockmap_alloc(map, slots);
+}
+
+/**
+ * @brief Free the memory used by a map
+ */
+void blockmap_destroy(blockmap_t *map) {
+    free(map->keys);
+    free(map->values);
+    map->keys = NULL;
+    map->values = NULL;
+}
+
+/**
+ * @brief Look up a key
+ *
+ * @param[in]  map   The map to search
+ * @param[in]  key   The key to look up
+ * @param[out] value The value stored for key, if present
+ *
+ * @return true if the key was found
+ */
+bool blockmap_get(const blockmap_t *map, unsigned long key,
+                  unsigned long *value) {
+    if (key == BLOCKMAP_EMPTY) {
+        *value = map->empty_value;
+        return map->has_empty_key;
+    }
+    for (size_t i = blockmap_slot(map, key);; i = (i + 1) & map->mask) {
+        if (map->keys[i] == key) {
+            *value = map->values[i];
+            return true;
+        }
+        if (map->keys[i] == BLOCKMAP_EMPTY) {
+            return false;
+        }
+    }
+}
+
+/**
+ * @brief Double the number of slots and rehash every key
+ *
+ * @return true on success, false if memory allocation failed
+ */
+static bool blockmap_grow(blockmap_t *map) {
+    blockmap_t old = *map;
+    if (!blockmap_alloc(map, 2 * (old.mask + 1))) {
+        *map = old;
+        return false;
+    }
+    for (size_t i = 0; i <= old.mask; i++) {
+        if (old.keys[i] != BLOCKMAP_EMPTY) {
+            size_t j = blockmap_slot(map, old.keys[i]);
+            while (map->keys[j] != BLOCKMAP_EMPTY) {
+                j = (j + 1) & map->mask;
+            }
+            map->keys[j] = old.keys[i];
+            map->values[j] = old.values[i];
+        }
+    }
+    blockmap_destroy(&old);
+    return true;
+}
+
+/**
+ * @brief Insert a key, or update its value if already present
+ *
+ * @return true on success, false if memory allocation failed
+ */
+bool blockmap_put(blockmap_t *map, unsigned long key, unsigned long value) {
+    if (key == BLOCKMAP_EMPTY) {
+        map->has_empty_key = true;
+        map->empty_value = value;
+        return true;
+    }
+    size_t i = blockmap_slot(map, key);
+    while (map->keys[i] != BLOCKMAP_EMPTY) {
+        if (map->keys[i] == key) {
+            map->values[i] = value;
+            return true;
+        }
+        i = (i + 1) & map->mask;
+    }
+    if (2 * (map->count + 1) > map->mask + 1) {
+        if (!blockmap_grow(map)) {
+            return false;
+        }
+        return blockmap_put(map, key, value);
+    }
+    map->keys[i] = key;
+    map->values[i] = value;
+    map->count++;
+    return true;
+}
+
+/**
+ * @brief Remove a key
+ *
+ * Entries later in the probe run are shifted back into the hole whenever
+ * their home slot does not lie strictly between the hole and themselves.
+ *
+ * @return true if the key was present
+ */
+bool blockmap_remove(blockmap_t *map, unsigned long key) {
+    if (key == BLOCKMAP_EMPTY) {
+        bool had = map->has_empty_key;
+        map->has_empty_key = false;
+        return had;
+    }
+    size_t i = blockmap_slot(map, key);
+    while (map->keys[i] != key) {
+        if (map->keys[i] == BLOCKMAP_EMPTY) {
+            return false;
+        }
+        i = (i + 1) & map->mask;
+    }
+
+    size_t hole = i;
+    for (size_t j = (i + 1) & map->mask; map->keys[j] != BLOCKMAP_EMPTY;
+         j = (j + 1) & map->mask) {
+        size_t home = blockmap_slot(map, map->keys[j]);
+        /* Distance from home to j, and from the hole to j */
+        if (((j - home) & map->mask) >= ((j - hole) & map->mask)) {
+            map->keys[hole] = map->keys[j];
+            map->values[hole] = map->values[j];
+            hole = j;
+        }
+    }
+    map->keys[hole] = BLOCKMAP_EMPTY;
+    map->count--;
+    return true;
+}
@@ -0,0 +1,44 @@
+/**
+ * @file blockmap.h
+ * @brief Prototypes for a hash map keyed by block address
+ */
+
+#ifndef CSIM_BLOCKMAP_H
+#define CSIM_BLOCKMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Open-addressing hash map from block addresses to integers
+ */
+typedef struct {
+    unsigned long *keys;   /* key of each slot, BLOCKMAP_EMPTY if unused */
+    unsigned long *values; /* value of each slot */
+    size_t mask;           /* number of slots - 1 */
+    size_t count;          /* number of keys stored */
+    int shift;             /* 64 - log2(number of slots), for hashing */
+    bool has_empty_key;    /* whether BLOCKMAP_EMPTY itself is stored */
+    unsigned long empty_value; /* value stored for BLOCKMAP_EMPTY */
+} blockmap_t;
+
+/** @brief Key marking an unused slot; stored out of line when used */
+#define BLOCKMAP_EMPTY (~0UL)
+
+/** @brief Initialize a map sized for about hint keys */
+bool blockmap_init(blockmap_t *map, size_t hint);
+
+/** @brief Free the memory used by a map */
+void blockmap_destroy(blockmap_t *map);
+
+/** @brief Look up a key; returns false if it is not present */
+bool blockmap_get(const blockmap_t *map, unsigned long key,
+                  unsigned long *value);
+
+/** @brief Insert or update a key; returns false if memory ran out */
+bool blockmap_put(blockmap_t *map, unsigned long key, unsigned long value);
+
+/** @brief Remove a key; returns false if it was not present */
+bool blockmap_remove(blockmap_t *map, unsigned long key);
+
+#endif /* CSIM_BLOCKMAP_H */
@@ -0,0 +1,452 @@
+/**
+ * @file coher.c
+ * @brief Multi-core cache coherence simulation
+ *
+ * Each core seen in the trace (see access_t's core) gets a private
+ * csim_cache_t, and the cores share a last-level cache (LLC) in front of
+ * memory. The private caches are kept coherent by snooping a bus, one
+ * access at a time, with the MESI or MOESI protocol. A directory, with an
+ * entry per block ever accessed, holds the state of the block in every
+ * private cache:
+ *
+ * - A load that misses gets the block Exclusive if no other core holds it,
+ *   and Shared otherwise. A core holding it Modified supplies it (an
+ *   intervention) and, under MESI, writes it back to the LLC and keeps it
+ *   Shared; under MOESI it keeps it Owned instead, and an Owned block is
+ *   supplied like a Modified one. Any other miss reads the LLC.
+ * - A store that misses gets the block Modified, invalidating every other
+ *   copy; a core holding it Modified or Owned supplies it. A store to a
+ *   Shared or Owned block upgrades it, invalidating the other copies, and
+ *   a store to an Exclusive block makes it Modified silently.
+ * - Evicting a Modified or Owned block writes it back to the LLC.
+ *
+ * The LLC is neither inclusive nor exclusive: it is filled by the reads
+ * it misses and the writebacks it takes, and its dirty victims are written
+ * to memory. A miss on a block whose copy another core's store invalidated
+ * is a sharing miss; the directory tracks the bytes written since that
+ * store to tell true sharing from false sharing, at the same granularity
+ * as the write-combining buffer of libcsim (bytes of blocks up to 64 bytes,
+ * 64ths of larger ones). Accesses past the end of their block are cut off.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blockmap.h"
+#include "coher.h"
+
+/** @brief Bits of a block's state in one private cache */
+#define STATE_BITS 4
+
+/** @brief Mask of the bits of one state */
+#define STATE_MASK ((1U << STATE_BITS) - 1)
+
+/**
+ * @brief State of a block in a private cache
+ */
+typedef enum {
+    STATE_I, /* Invalid, or not cached */
+    STATE_S, /* Shared: clean, other caches may hold it */
+    STATE_E, /* Exclusive: clean, no other cache holds it */
+    STATE_O, /* Owned: dirty, others may hold it Shared (MOESI only) */
+    STATE_M, /* Modified: dirty, no other cache holds it */
+} state_t;
+
+/**
+ * @brief Directory entry of a block
+ */
+typedef struct {
+    unsigned long block;         /* block address */
+    uint64_t states;             /* STATE_BITS per core, core 0 lowest */
+    uint64_t written;            /* chunks written since the last takeover */
+    unsigned stolen;             /* cores a store invalidated, not missed */
+    unsigned cores;              /* cores that accessed the block */
+    unsigned long false_sharing; /* false sharing misses on the block */
+    unsigned long true_sharing;  /* true sharing misses on the block */
+} entry_t;
+
+/**
+ * @brief Multi-core simulator
+ */
+struct coher {
+    coher_protocol_t protocol;             /* coherence protocol */
+    csim_config_t core_config;             /* config of private caches */
+    csim_cache_t *caches[COHER_MAX_CORES]; /* private cache of each core */
+    csim_cache_t *llc;                     /* shared last-level cache */
+    int cores;                             /* caches created */
+    int b;                                 /* Number of block bits */
+    blockmap_t where;                      /* block -> its entry */
+    entry_t *entries;                      /* directory */
+    size_t count;                          /* entries in use */
+    size_t capacity;                       /* entries allocated */
+    coher_stats_t stats;                   /* statistics so far */
+    access_t batch[TRACE_BATCH];           /* accesses being decoded */
+};
+
+/**
+ * @brief Look up a protocol by name
+ *
+ * @param[out] protocol The protocol, if it exists
+ *
+ * @return true if name is one of COHER_PROTOCOLS, false otherwise
+ */
+bool coher_parse(const char *name, coher_protocol_t *protocol) {
+    if (strcmp(name, "mesi") == 0) {
+        *protocol = COHER_MESI;
+    } else if (strcmp(name, "moesi") == 0) {
+        *protocol = COHER_MOESI;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Create a system without cores
+ *
+ * The private cache of a core is only created once the trace uses it, so
+ * the system has as many cores as the highest core number seen, plus one.
+ *
+ * @return The system, or NULL if config is invalid or out of memory
+ */
+coher_t *coher_create(const coher_config_t *config) {
+    if (config->core.b != config->llc.b) {
+        return NULL;
+    }
+    coher_t *coher = (coher_t *)calloc(1, sizeof(coher_t));
+    if (coher == NULL) {
+        return NULL;
+    }
+    coher->protocol = config->protocol;
+    coher->core_config = config->core;
+    coher->b = config->core.b;
+    coher->llc = csim_create(&config->llc);
+    if (coher->llc == NULL || !blockmap_init(&coher->where, 0)) {
+        coher_destroy(coher);
+        return NULL;
+    }
+
+    /* Check the private cache config up front */
+    csim_cache_t *cache = csim_create(&config->core);
+    if (cache == NULL) {
+        coher_destroy(coher);
+        return NULL;
+    }
+    csim_destroy(cache);
+    return coher;
+}
+
+/**
+ * @brief Free all memory used by a system
+ */
+void coher_destroy(coher_t *coher) {
+    for (int i = 0; i < coher->cores; i++) {
+        csim_destroy(coher->caches[i]);
+    }
+    if (coher->llc != NULL) {
+        csim_destroy(coher->llc);
+    }
+    blockmap_destroy(&coher->where);
+    free(coher->entries);
+    free(coher);
+}
+
+/**
+ * @brief State of a block in the private cache of a core
+ */
+static inline state_t state_get(const entry_t *entry, int core) {
+    return (state_t)((entry->states >> (core * STATE_BITS)) & STATE_MASK);
+}
+
+/**
+ * @brief Set the state of a block in the private cache of a core
+ */
+static inline void state_set(entry_t *entry, int core, state_t state) {
+    int shift = core * STATE_BITS;
+    entry->states = (entry->states & ~((uint64_t)STATE_MASK << shift)) |
+                    ((uint64_t)state << shift);
+}
+
+/**
+ * @brief Directory entry of a block, added if it has none
+ *
+ * @return The entry, or NULL if out of memory
+ */
+static entry_t *entry_get(coher_t *coher, unsigned long block) {
+    unsigned long index;
+    if (blockmap_get(&coher->where, block, &index)) {
+        return &coher->entries[index];
+    }
+    if (coher->count == coher->capacity) {
+        size_t capacity = (coher->capacity == 0) ? 1024 : 2 * coher->capacity;
+        entry_t *entries =
+            (entry_t *)realloc(coher->entries, capacity * sizeof(entry_t));
+        if (entries == NULL) {
+            return NULL;
+        }
+        coher->entries = entries;
+        coher->capacity = capacity;
+    }
+    if (!blockmap_put(&coher->where, block, coher->count)) {
+        return NULL;
+    }
+    entry_t *entry = &coher->entries[coher->count++];
+    *entry = (entry_t){.block = block};
+    return entry;
+}
+
+/**
+ * @brief Chunks of a block an access touches, cut off at its end
+ */
+static uint64_t access_chunks(const coher_t *coher, const access_t *op) {
+    unsigned long B = 1UL << coher->b;
+    unsigned long offset = op->addr & (B - 1);
+    unsigned long end = (op->size == 0) ? offset + 1 : offset + op->size;
+    if (end > B) {
+        end = B;
+    }
+    int shift = (coher->b > 6) ? coher->b - 6 : 0;
+    unsigned long first = offset >> shift;
+    unsigned long last = (end - 1) >> shift;
+    return ((last == 63) ? ~0UL : (1UL << (last + 1)) - 1) &
+           ~((1UL << first) - 1);
+}
+
+/**
+ * @brief Read a block from the LLC, or from memory if it misses there
+ */
+static void llc_read(coher_t *coher, unsigned long block) {
+    access_t load = {.addr = block << coher->b, .size = 1, .op = 'L'};
+    csim_eviction_t evicted;
+    csim_result_t result = csim_access_evict(coher->llc, &load, &evicted);
+    if (result != CSIM_HIT) {
+        coher->stats.memory_reads++;
+    }
+    if (result == CSIM_MISS_EVICTION && evicted.dirty) {
+        coher->stats.memory_writes++;
+    }
+}
+
+/**
+ * @brief Write a dirty block back from a private cache to the LLC
+ */
+static void llc_writeback(coher_t *coher, int core, unsigned long block) {
+    csim_eviction_t evicted;
+    coher->stats.core[core].writebacks++;
+    if (csim_fill(coher->llc, block << coher->b, true, &evicted) ==
+            CSIM_MISS_EVICTION &&
+        evicted.dirty) {
+        coher->stats.memory_writes++;
+    }
+}
+
+/**
+ * @brief Invalidate every copy of a block but that of a core
+ */
+static void invalidate_others(coher_t *coher, entry_t *entry, int core) {
+    for (int i = 0; i < coher->cores; i++) {
+        if (i == core || state_get(entry, i) == STATE_I) {
+            continue;
+        }
+        csim_invalidate(coher->caches[i], entry->block << coher->b, NULL);
+        state_set(entry, i, STATE_I);
+        entry->stolen |= 1U << i;
+        coher->stats.core[core].invalidations++;
+    }
+}
+
+/**
+ * @brief Account for a block evicted from the private cache of a core
+ */
+static void core_evicted(coher_t *coher, int core,
+                         const csim_eviction_t *evicted) {
+    unsigned long block = evicted->addr >> coher->b;
+    unsigned long index;
+    coher->stats.core[core].evictions++;
+    if (!blockmap_get(&coher->where, block, &index)) {
+        return;
+    }
+    entry_t *entry = &coher->entries[index];
+    state_t state = state_get(entry, core);
+    if (state == STATE_M || state == STATE_O) {
+        llc_writeback(coher, core, block);
+    }
+    state_set(entry, core, STATE_I);
+}
+
+/**
+ * @brief Count a miss on a block as a sharing miss, if it is one
+ */
+static void classify_miss(coher_t *coher, entry_t *entry, int core,
+                          uint64_t chunks) {
+    if ((entry->stolen & (1U << core)) == 0) {
+        return;
+    }
+    entry->stolen &= ~(1U << core);
+    if (chunks & entry->written) {
+        entry->true_sharing++;
+        coher->stats.true_sharing++;
+    } else {
+        entry->false_sharing++;
+        coher->stats.false_sharing++;
+    }
+}
+
+/**
+ * @brief Simulate one access of a core whose cache exists
+ *
+ * @return false if out of memory, true otherwise
+ */
+static bool coher_access(coher_t *coher, const access_t *op) {
+    int core = op->core;
+    coher_core_stats_t *stats = &coher->stats.core[core];
+    unsigned long block = op->addr >> coher->b;
+    bool store = (op->op == 'S' || op->op == 'M');
+    entry_t *entry = entry_get(coher, block);
+    if (entry == NULL) {
+        return false;
+    }
+    entry->cores |= 1U << core;
+    uint64_t chunks = access_chunks(coher, op);
+    state_t state = state_get(entry, core);
+    /* The store of a modify hits the block its load brought in */
+    stats->hits += (op->op == 'M');
+
+    if (state != STATE_I) {
+        stats->hits++;
+        csim_access(coher->caches[core], op);
+        if (store && state != STATE_M) {
+            if (state != STATE_E) {
+                stats->upgrades++;
+                invalidate_others(coher, entry, core);
+                entry->written = 0;
+            }
+            state_set(entry, core, STATE_M);
+        }
+        if (store) {
+            entry->written |= chunks;
+        }
+        return true;
+    }
+
+    stats->misses++;
+    classify_miss(coher, entry, core, chunks);
+    int supplier = -1;
+    bool shared = false;
+    for (int i = 0; i < coher->cores; i++) {
+        state_t other = state_get(entry, i);
+        if (i == core || other == STATE_I) {
+            continue;
+        }
+        shared = true;
+        if (other == STATE_M || other == STATE_O) {
+            supplier = i;
+        }
+    }
+    if (supplier >= 0) {
+        coher->stats.core[supplier].interventions++;
+    } else {
+        llc_read(coher, block);
+    }
+
+    if (store) {
+        invalidate_others(coher, entry, core);
+        entry->written = chunks;
+        state = STATE_M;
+    } else {
+        for (int i = 0; shared && i < coher->cores; i++) {
+            state_t other = state_get(entry, i);
+            if (i == core || other == STATE_I || other == STATE_O) {
+                continue;
+            }
+            if (other == STATE_M && coher->protocol == COHER_MOESI) {
+                state_set(entry, i, STATE_O);
+                continue;
+            }
+            if (other == STATE_M) {
+                llc_writeback(coher, i, block);
+            }
+            state_set(entry, i, STATE_S);
+        }
+        state = shared ? STATE_S : STATE_E;
+    }
+
+    /* entry stays put: the victim already has an entry */
+    csim_eviction_t evicted;
+    if (csim_access_evict(coher->caches[core], op, &evicted) ==
+        CSIM_MISS_EVICTION) {
+        core_evicted(coher, core, &evicted);
+    }
+    state_set(entry, core, state);
+    return true;
+}
+
+/**
+ * @brief Simulate a whole trace
+ *
+ * @return 0 on success, -1 if the trace is malformed (see trace_line()),
+ *         -2 if a record's core is COHER_MAX_CORES or above, or -3 if out
+ *         of memory
+ */
+long coher_run(coher_t *coher, trace_t *trace) {
+    access_t *ops = coher->batch;
+    long n;
+    while ((n = trace_read(trace, ops, TRACE_BATCH)) > 0) {
+        for (long i = 0; i < n; i++) {
+            int core = ops[i].core;
+            if (core >= COHER_MAX_CORES) {
+                return -2;
+            }
+            while (coher->cores <= core) {
+                coher->caches[coher->cores] = csim_create(&coher->core_config);
+                if (coher->caches[coher->cores] == NULL) {
+                    return -3;
+                }
+                coher->cores++;
+            }
+            if (!coher_access(coher, &ops[i])) {
+                return -3;
+            }
+        }
+    }
+    return (n == 0) ? 0 : -1;
+}
+
+/**
+ * @brief Copy the statistics of all accesses simulated so far
+ *
+ * The blocks reported are those with the most false sharing misses, in
+ * decreasing order.
+ */
+void coher_get_stats(const coher_t *coher, coher_stats_t *stats) {
+    *stats = coher->stats;
+    stats->cores = coher->cores;
+    csim_get_stats(coher->llc, &stats->llc);
+
+    stats->blocks = 0;
+    for (size_t i = 0; i < coher->count; i++) {
+        const entry_t *entry = &coher->entries[i];
+        if (entry->false_sharing == 0) {
+            continue;
+        }
+        int at = stats->blocks;
+        while (at > 0 &&
+               stats->block[at - 1].false_sharing < entry->false_sharing) {
+            at--;
+        }
+        if (at == COHER_REPORT_BLOCKS) {
+            continue;
+        }
+        int last = (stats->blocks < COHER_REPORT_BLOCKS) ? stats->blocks++
+                                                         : stats->blocks - 1;
+        memmove(&stats->block[at + 1], &stats->block[at],
+                (size_t)(last - at) * sizeof(coher_block_t));
+        stats->block[at] = (coher_block_t){
+            .addr = entry->block << coher->b,
+            .false_sharing = entry->false_sharing,
+            .true_sharing = entry->true_sharing,
+            .cores = entry->cores,
+        };
+    }
+}
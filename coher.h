@@ -0,0 +1,100 @@
+/**
+ * @file coher.h
+ * @brief Prototypes for multi-core cache coherence simulation
+ */
+
+#ifndef CSIM_COHER_H
+#define CSIM_COHER_H
+
+#include <stdbool.h>
+
+#include "libcsim.h"
+#include "trace.h"
+
+/** @brief Largest number of cores, whose numbers go from 0 */
+#define COHER_MAX_CORES 16
+
+/** @brief Number of falsely shared blocks reported, most misses first */
+#define COHER_REPORT_BLOCKS 10
+
+/** @brief Names of the protocols, for coher_parse() */
+#define COHER_PROTOCOLS "mesi, moesi"
+
+/**
+ * @brief Coherence protocol of the private caches
+ */
+typedef enum {
+    COHER_MESI,  /* a dirty block read by another core is written back */
+    COHER_MOESI, /* a dirty block read by another core stays Owned */
+} coher_protocol_t;
+
+/**
+ * @brief Parameters of a multi-core system
+ */
+typedef struct {
+    coher_protocol_t protocol; /* coherence protocol */
+    csim_config_t core;        /* private cache of each core */
+    csim_config_t llc;         /* shared last-level cache, with the same b */
+} coher_config_t;
+
+/**
+ * @brief Statistics of one core and its private cache
+ */
+typedef struct {
+    unsigned long hits;          /* accesses found in a valid state */
+    unsigned long misses;        /* accesses to invalid or missing blocks */
+    unsigned long evictions;     /* blocks evicted, clean or dirty */
+    unsigned long writebacks;    /* dirty blocks written to the LLC */
+    unsigned long upgrades;      /* stores to Shared or Owned blocks */
+    unsigned long invalidations; /* copies of other cores invalidated */
+    unsigned long interventions; /* dirty blocks supplied to other cores */
+} coher_core_stats_t;
+
+/**
+ * @brief Sharing misses on one block
+ */
+typedef struct {
+    unsigned long addr;          /* address of the block */
+    unsigned long false_sharing; /* misses on bytes no other core wrote */
+    unsigned long true_sharing;  /* misses on bytes another core wrote */
+    unsigned cores;              /* bitmask of the cores that accessed it */
+} coher_block_t;
+
+/**
+ * @brief Statistics of a multi-core system
+ *
+ * A sharing miss is a miss on a block whose copy was invalidated by a
+ * store of another core. It is true sharing if the bytes accessed overlap
+ * those written since that store, and false sharing otherwise.
+ */
+typedef struct {
+    int cores;                                /* cores seen in the trace */
+    coher_core_stats_t core[COHER_MAX_CORES]; /* each core */
+    csim_stats_t llc;                         /* the shared cache */
+    unsigned long memory_reads;               /* blocks read from memory */
+    unsigned long memory_writes;              /* blocks written to memory */
+    unsigned long true_sharing;               /* true sharing misses */
+    unsigned long false_sharing;              /* false sharing misses */
+    int blocks;                               /* blocks reported in block */
+    coher_block_t block[COHER_REPORT_BLOCKS]; /* most falsely shared */
+} coher_stats_t;
+
+/** @brief Opaque multi-core simulator */
+typedef struct coher coher_t;
+
+/** @brief Look up a protocol by name; false if there is none */
+bool coher_parse(const char *name, coher_protocol_t *protocol);
+
+/** @brief Create a system without cores; NULL if invalid or out of memory */
+coher_t *coher_create(const coher_config_t *config);
+
+/** @brief Free all memory used by a system */
+void coher_destroy(coher_t *coher);
+
+/** @brief Simulate a whole trace; 0, or below 0 on an error */
+long coher_run(coher_t *coher, trace_t *trace);
+
+/** @brief Copy the statistics of all accesses simulated so far */
+void coher_get_stats(const coher_t *coher, coher_stats_t *stats);
+
+#endif /* CSIM_COHER_H */
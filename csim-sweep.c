@@ -0,0 +1,668 @@
+/**
+ * @file csim-sweep.c
+ * @brief Simulate many cache configurations against one trace in parallel
+ *
+ * The trace is decoded once into memory and shared by a pool of threads.
+ * Configurations are replayed in groups of SWEEP_GROUP: a thread walks the
+ * trace one chunk of SWEEP_CHUNK accesses at a time and runs every cache of
+ * its group over the chunk before moving on, so each chunk is decoded data
+ * that is still in the host's caches for all but the first configuration.
+ *
+ * Groups are dealt round-robin to per-thread queues, largest caches first.
+ * A thread takes work from the front of its own queue, and once that is
+ * empty steals from the back of the others, so threads that drew cheap
+ * configurations help out with the expensive ones. Results are printed in
+ * the order the configurations were given, as CSV or JSON; JSON also has the
+ * leader set statistics of set-dueling policies and the ghost list hits of
+ * ARC and LFU.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cachelab.h"
+#include "libcsim.h"
+#include "trace.h"
+
+/** @brief Number of configurations replayed together by one thread */
+#define SWEEP_GROUP 8
+
+/** @brief Accesses replayed per configuration before moving on: 128 KiB */
+#define SWEEP_CHUNK 8192
+
+/** @brief Largest number of threads */
+#define SWEEP_MAX_THREADS 256
+
+/** @brief Largest number of policies in a -p list */
+#define SWEEP_MAX_POLICIES 16
+
+/** @brief Size of a policy name, including the terminating null */
+#define SWEEP_POLICY_LEN 16
+
+/**
+ * @brief One configuration and its results
+ *
+ * config.policy points to policy once the array of jobs stops growing.
+ */
+typedef struct {
+    csim_config_t config;          /* the simulated cache */
+    char policy[SWEEP_POLICY_LEN]; /* name of its replacement policy */
+    csim_stats_t stats;            /* statistics at the end of the trace */
+    csim_duel_stats_t duel;        /* leader set statistics, if dueled */
+    bool dueled;                   /* whether the policy uses set dueling */
+    csim_ghost_stats_t ghosts;     /* ghost list hits, if any */
+    bool ghosted;                  /* whether the policy has ghost lists */
+    bool failed;                   /* whether allocating the cache failed */
+} sweep_job_t;
+
+/**
+ * @brief Queue of groups owned by one thread, open to stealing
+ */
+typedef struct {
+    pthread_mutex_t lock; /* protects head and tail */
+    size_t *groups;       /* group numbers */
+    size_t head;          /* next group the owner takes */
+    size_t tail;          /* one past the next group a thief takes */
+} sweep_queue_t;
+
+/**
+ * @brief State shared by all threads of a sweep
+ */
+typedef struct {
+    sweep_job_t *jobs;     /* configurations, in the order given */
+    size_t *order;         /* job numbers, largest cache first */
+    size_t njobs;          /* number of configurations */
+    const access_t *ops;   /* the decoded trace */
+    size_t nops;           /* number of accesses in the trace */
+    sweep_queue_t *queues; /* queue of each thread */
+    int threads;           /* number of threads */
+} sweep_t;
+
+/**
+ * @brief A thread of the pool
+ */
+typedef struct {
+    sweep_t *sweep;   /* the sweep it works on */
+    int id;           /* number of its own queue */
+    pthread_t thread; /* the thread */
+} sweep_worker_t;
+
+/**
+ * @brief Helper function to print usage info
+ */
+static void print_usage(void) {
+    printf("Usage: ./csim-sweep [-h] [-j <N>] [-f <format>] [-p <list>] "
+           "-s <list> -E <list> -b <list> -t <tracefile>\n"
+           "       ./csim-sweep [-h] [-j <N>] [-f <format>] -c <file> "
+           "-t <tracefile>\n"
+           "-h: Optional help flag that prints usage info\n"
+           "-j <N>: Number of threads (default: one per CPU)\n"
+           "-f <format>: Output format, csv or json (default: csv)\n"
+           "-s, -E, -b <list>: Values such as 0-4,8 to sweep; every "
+           "combination is simulated\n"
+           "-p <list>: Replacement policies such as lru,drrip to sweep, from "
+           CSIM_POLICIES " (default lru)\n"
+           "-c <file>: File of configurations, one \"s E b [policy]\" per "
+           "line\n"
+           "-t <tracefile>: Name of the memory trace (text or binary) to "
+           "replay\n");
+}
+
+/**
+ * @brief Parse a list of values such as "1,2,4-8"
+ *
+ * @param[out] values Set to the values, to be freed by the caller
+ * @param[out] count  Number of values
+ *
+ * @return true on success, false if the list is malformed or a value is
+ *         outside [lo, hi]
+ */
+static bool parse_list(const char *arg, int lo, int hi, int **values,
+                       size_t *count) {
+    size_t capacity = 16;
+    size_t n = 0;
+    int *list = (int *)malloc(capacity * sizeof(int));
+    const char *p = arg;
+    while (list != NULL) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p) {
+            break;
+        }
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p) {
+                break;
+            }
+        }
+        if (first < lo || last > hi || first > last) {
+            break;
+        }
+        for (long v = first; v <= last && list != NULL; v++) {
+            if (n == capacity) {
+                capacity *= 2;
+                int *grown = (int *)realloc(list, capacity * sizeof(int));
+                if (grown == NULL) {
+                    free(list);
+                }
+                list = grown;
+            }
+            if (list != NULL) {
+                list[n++] = (int)v;
+            }
+        }
+        if (*end == '\0' && list != NULL) {
+            *values = list;
+            *count = n;
+            return true;
+        }
+        if (*end != ',') {
+            break;
+        }
+        p = end + 1;
+    }
+    free(list);
+    return false;
+}
+
+/**
+ * @brief Split a list of policy names such as "lru,drrip" in place
+ *
+ * @param[out] names Set to the names, pointing into arg
+ * @param[out] count Number of names
+ *
+ * @return true on success, false if a name is unknown or there are more
+ *         than SWEEP_MAX_POLICIES
+ */
+static bool parse_policies(char *arg, const char *names[SWEEP_MAX_POLICIES],
+                           size_t *count) {
+    size_t n = 0;
+    for (char *name = arg; name != NULL; n++) {
+        char *comma = strchr(name, ',');
+        if (comma != NULL) {
+            *comma = '\0';
+        }
+        if (n == SWEEP_MAX_POLICIES || strlen(name) >= SWEEP_POLICY_LEN ||
+            !csim_policy_exists(name)) {
+            return false;
+        }
+        names[n] = name;
+        name = (comma != NULL) ? comma + 1 : NULL;
+    }
+    *count = n;
+    return true;
+}
+
+/**
+ * @brief Append a configuration to a growing array of jobs
+ *
+ * @param[in] policy Name of an existing policy, shorter than
+ *                   SWEEP_POLICY_LEN
+ *
+ * @return true on success, false if memory allocation failed
+ */
+static bool add_job(sweep_job_t **jobs, size_t *njobs, size_t *capacity,
+                    int s, int E, int b, const char *policy) {
+    if (*njobs == *capacity) {
+        size_t grown_capacity = (*capacity == 0) ? 64 : 2 * *capacity;
+        sweep_job_t *grown = (sweep_job_t *)realloc(
+            *jobs, grown_capacity * sizeof(sweep_job_t));
+        if (grown == NULL) {
+            return false;
+        }
+        *jobs = grown;
+        *capacity = grown_capacity;
+    }
+    sweep_job_t *job = &(*jobs)[(*njobs)++];
+    memset(job, 0, sizeof(sweep_job_t));
+    job->config.s = s;
+    job->config.E = E;
+    job->config.b = b;
+    strcpy(job->policy, policy);
+    return true;
+}
+
+/**
+ * @brief Whether a configuration can be simulated
+ */
+static bool valid_config(int s, int E, int b) {
+    return s >= 0 && b >= 0 && s + b < 64 && E > 0 && E <= CSIM_MAX_ASSOC;
+}
+
+/**
+ * @brief Read configurations from a file of "s E b [policy]" lines
+ *
+ * Blank lines and lines starting with '#' are skipped, and the policy
+ * defaults to LRU.
+ *
+ * @return true on success, false if the file could not be read, a line is
+ *         malformed or memory allocation failed
+ */
+static bool read_configs(const char *filename, sweep_job_t **jobs,
+                         size_t *njobs, size_t *capacity) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Open file error\n");
+        return false;
+    }
+    char line[256];
+    unsigned long lineno = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file) != NULL) {
+        lineno++;
+        const char *p = line;
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (*p == '\0' || *p == '#') {
+            continue;
+        }
+        int s;
+        int E;
+        int b;
+        char policy[SWEEP_POLICY_LEN] = "lru";
+        char extra;
+        int fields = sscanf(p, "%d %d %d %15s %c", &s, &E, &b, policy, &extra);
+        if (fields < 3 || fields > 4 || !valid_config(s, E, b) ||
+            !csim_policy_exists(policy)) {
+            fprintf(stderr, "Invalid configuration at line %lu\n", lineno);
+            ok = false;
+        } else if (!add_job(jobs, njobs, capacity, s, E, b, policy)) {
+            fprintf(stderr, "Malloc for configurations failed\n");
+            ok = false;
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+/**
+ * @brief Approximate memory footprint of a configuration, to order jobs
+ */
+static double job_cost(const sweep_job_t *job) {
+    return (double)(1UL << job->config.s) * (double)job->config.E;
+}
+
+/** @brief Jobs being sorted by sort_jobs(), for compare_jobs() */
+static const sweep_job_t *sort_base;
+
+/**
+ * @brief qsort() comparison of job numbers, largest cache first
+ */
+static int compare_jobs(const void *a, const void *b) {
+    size_t i = *(const size_t *)a;
+    size_t j = *(const size_t *)b;
+    double ci = job_cost(&sort_base[i]);
+    double cj = job_cost(&sort_base[j]);
+    if (ci != cj) {
+        return (ci > cj) ? -1 : 1;
+    }
+    return (i > j) - (i < j);
+}
+
+/**
+ * @brief Take a group to replay: from the front of the thread's own queue,
+ *        or else from the back of another's
+ *
+ * @return true if a group was taken, false once every queue is empty
+ */
+static bool sweep_take(sweep_t *sweep, int id, size_t *group) {
+    for (int k = 0; k < sweep->threads; k++) {
+        sweep_queue_t *queue = &sweep->queues[(id + k) % sweep->threads];
+        bool found = false;
+        pthread_mutex_lock(&queue->lock);
+        if (queue->head < queue->tail) {
+            *group = (k == 0) ? queue->groups[queue->head++]
+                              : queue->groups[--queue->tail];
+            found = true;
+        }
+        pthread_mutex_unlock(&queue->lock);
+        if (found) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Replay the whole trace through every configuration of a group
+ */
+static void sweep_replay(sweep_t *sweep, size_t group) {
+    size_t first = group * SWEEP_GROUP;
+    size_t count = sweep->njobs - first;
+    count = (count < SWEEP_GROUP) ? count : SWEEP_GROUP;
+
+    csim_cache_t *caches[SWEEP_GROUP];
+    for (size_t i = 0; i < count; i++) {
+        sweep_job_t *job = &sweep->jobs[sweep->order[first + i]];
+        caches[i] = csim_create(&job->config);
+        job->failed = (caches[i] == NULL);
+    }
+
+    for (size_t start = 0; start < sweep->nops; start += SWEEP_CHUNK) {
+        size_t m = sweep->nops - start;
+        m = (m < SWEEP_CHUNK) ? m : SWEEP_CHUNK;
+        for (size_t i = 0; i < count; i++) {
+            if (caches[i] != NULL) {
+                csim_access_batch(caches[i], &sweep->ops[start], m);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (caches[i] != NULL) {
+            sweep_job_t *job = &sweep->jobs[sweep->order[first + i]];
+            csim_get_stats(caches[i], &job->stats);
+            job->dueled = csim_get_duel_stats(caches[i], &job->duel);
+            job->ghosted = csim_get_ghost_stats(caches[i], &job->ghosts);
+            csim_destroy(caches[i]);
+        }
+    }
+}
+
+/**
+ * @brief Body of a pool thread: replay groups until none are left
+ */
+static void *sweep_worker(void *arg) {
+    sweep_worker_t *worker = (sweep_worker_t *)arg;
+    size_t group;
+    while (sweep_take(worker->sweep, worker->id, &group)) {
+        sweep_replay(worker->sweep, group);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Run every job of a sweep on a pool of threads
+ *
+ * The calling thread works as the first thread of the pool.
+ *
+ * @return true on success, false if memory allocation failed
+ */
+static bool sweep_run(sweep_t *sweep) {
+    size_t ngroups = (sweep->njobs + SWEEP_GROUP - 1) / SWEEP_GROUP;
+    if ((size_t)sweep->threads > ngroups) {
+        sweep->threads = (int)ngroups;
+    }
+    int threads = sweep->threads;
+    sweep->queues =
+        (sweep_queue_t *)calloc((size_t)threads, sizeof(sweep_queue_t));
+    sweep_worker_t *workers =
+        (sweep_worker_t *)calloc((size_t)threads, sizeof(sweep_worker_t));
+    size_t *groups = (size_t *)malloc(ngroups * sizeof(size_t));
+    if (sweep->queues == NULL || workers == NULL || groups == NULL) {
+        free(sweep->queues);
+        free(workers);
+        free(groups);
+        return false;
+    }
+
+    /* Deal groups round-robin, so each queue starts with large caches */
+    size_t at = 0;
+    for (int t = 0; t < threads; t++) {
+        sweep_queue_t *queue = &sweep->queues[t];
+        pthread_mutex_init(&queue->lock, NULL);
+        queue->groups = &groups[at];
+        for (size_t g = (size_t)t; g < ngroups; g += (size_t)threads) {
+            groups[at++] = g;
+        }
+        queue->tail = (size_t)(&groups[at] - queue->groups);
+    }
+
+    int started = 1;
+    for (int t = 0; t < threads; t++) {
+        workers[t].sweep = sweep;
+        workers[t].id = t;
+    }
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&workers[t].thread, NULL, sweep_worker,
+                           &workers[t]) != 0) {
+            /* The threads already running steal the rest of the work */
+            break;
+        }
+        started++;
+    }
+    sweep_worker(&workers[0]);
+    for (int t = 1; t < started; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+
+    for (int t = 0; t < threads; t++) {
+        pthread_mutex_destroy(&sweep->queues[t].lock);
+    }
+    free(sweep->queues);
+    free(workers);
+    free(groups);
+    return true;
+}
+
+/**
+ * @brief Print the results of every job
+ *
+ * @return true on success, false if a cache could not be allocated
+ */
+static bool print_results(const sweep_job_t *jobs, size_t njobs, bool json) {
+    bool ok = true;
+    if (json) {
+        printf("[\n");
+    } else {
+        printf("s,E,b,policy,hits,misses,evictions,dirty_bytes,"
+               "dirty_evictions\n");
+    }
+    bool first = true;
+    for (size_t i = 0; i < njobs; i++) {
+        const sweep_job_t *job = &jobs[i];
+        const csim_config_t *c = &job->config;
+        const csim_stats_t *st = &job->stats;
+        if (job->failed) {
+            fprintf(stderr, "Malloc for cache failed: s=%d E=%d b=%d p=%s\n",
+                    c->s, c->E, c->b, job->policy);
+            ok = false;
+            continue;
+        }
+        if (json) {
+            printf("%s  {\"s\": %d, \"E\": %d, \"b\": %d, \"policy\": "
+                   "\"%s\", \"hits\": %lu, \"misses\": %lu, "
+                   "\"evictions\": %lu, \"dirty_bytes\": %lu, "
+                   "\"dirty_evictions\": %lu",
+                   first ? "" : ",\n", c->s, c->E, c->b, job->policy,
+                   st->hits, st->misses, st->evictions, st->dirty_bytes,
+                   st->dirty_evictions);
+            if (job->dueled) {
+                const csim_duel_stats_t *d = &job->duel;
+                printf(", \"leaders\": [");
+                for (int team = 0; team < 2; team++) {
+                    printf("%s{\"policy\": \"%s\", \"sets\": %lu, "
+                           "\"hits\": %lu, \"misses\": %lu}",
+                           team ? ", " : "", d->policy[team], d->sets[team],
+                           d->hits[team], d->misses[team]);
+                }
+                printf("], \"psel\": %u, \"psel_max\": %u", d->psel,
+                       d->psel_max);
+            }
+            if (job->ghosted) {
+                const csim_ghost_stats_t *g = &job->ghosts;
+                printf(", \"ghost_hits\": [%lu", g->hits[0]);
+                if (g->lists == 2) {
+                    printf(", %lu], \"t1_target\": %lu", g->hits[1],
+                           g->target);
+                } else {
+                    printf("]");
+                }
+            }
+            printf("}");
+        } else {
+            printf("%d,%d,%d,%s,%lu,%lu,%lu,%lu,%lu\n", c->s, c->E, c->b,
+                   job->policy, st->hits, st->misses, st->evictions,
+                   st->dirty_bytes, st->dirty_evictions);
+        }
+        first = false;
+    }
+    if (json) {
+        printf("%s]\n", first ? "" : "\n");
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    const char *lists[3] = {NULL, NULL, NULL};
+    const char *policies[SWEEP_MAX_POLICIES] = {"lru"};
+    size_t npolicies = 1;
+    bool policies_ok = true;
+    const char *config_file = NULL;
+    const char *format = "csv";
+    const char *tracefile = NULL;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = (cpus > 0) ? (int)cpus : 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "hj:f:p:s:E:b:c:t:")) != -1) {
+        switch (opt) {
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'f':
+            format = optarg;
+            break;
+        case 'p':
+            policies_ok = parse_policies(optarg, policies, &npolicies);
+            break;
+        case 's':
+            lists[0] = optarg;
+            break;
+        case 'E':
+            lists[1] = optarg;
+            break;
+        case 'b':
+            lists[2] = optarg;
+            break;
+        case 'c':
+            config_file = optarg;
+            break;
+        case 't':
+            tracefile = optarg;
+            break;
+        case 'h':
+        default:
+            print_usage();
+            return (opt == 'h') ? 0 : -1;
+        }
+    }
+    bool any_list = lists[0] != NULL || lists[1] != NULL || lists[2] != NULL;
+    bool all_lists = lists[0] != NULL && lists[1] != NULL && lists[2] != NULL;
+    bool json = (strcmp(format, "json") == 0);
+    if (tracefile == NULL || threads < 1 || threads > SWEEP_MAX_THREADS ||
+        !policies_ok ||
+        (!json && strcmp(format, "csv") != 0) ||
+        (any_list && !all_lists) || (!all_lists && config_file == NULL)) {
+        print_usage();
+        return -1;
+    }
+
+    sweep_job_t *jobs = NULL;
+    size_t njobs = 0;
+    size_t capacity = 0;
+    if (all_lists) {
+        static const int BOUNDS[3][2] = {{0, 63}, {1, CSIM_MAX_ASSOC}, {0, 63}};
+        int *values[3] = {NULL, NULL, NULL};
+        size_t counts[3] = {0, 0, 0};
+        bool ok = true;
+        for (int k = 0; k < 3 && ok; k++) {
+            ok = parse_list(lists[k], BOUNDS[k][0], BOUNDS[k][1], &values[k],
+                            &counts[k]);
+        }
+        for (size_t i = 0; ok && i < counts[0]; i++) {
+            for (size_t e = 0; ok && e < counts[1]; e++) {
+                for (size_t k = 0; ok && k < counts[2]; k++) {
+                    int s = values[0][i];
+                    int E = values[1][e];
+                    int b = values[2][k];
+                    bool valid = valid_config(s, E, b);
+                    for (size_t p = 0; ok && valid && p < npolicies; p++) {
+                        ok = add_job(&jobs, &njobs, &capacity, s, E, b,
+                                     policies[p]);
+                    }
+                }
+            }
+        }
+        for (int k = 0; k < 3; k++) {
+            free(values[k]);
+        }
+        if (!ok) {
+            fprintf(stderr, "Invalid input!\n");
+            free(jobs);
+            return -1;
+        }
+    }
+    if (config_file != NULL &&
+        !read_configs(config_file, &jobs, &njobs, &capacity)) {
+        free(jobs);
+        return -1;
+    }
+    if (njobs == 0) {
+        fprintf(stderr, "No valid configurations\n");
+        free(jobs);
+        return -1;
+    }
+
+    trace_t *trace = trace_open(tracefile);
+    if (trace == NULL) {
+        fprintf(stderr, "Open file error\n");
+        free(jobs);
+        return -1;
+    }
+    access_t *ops;
+    long nops = trace_read_all(trace, &ops);
+    if (nops == -2) {
+        fprintf(stderr, "Malloc for trace failed\n");
+    } else if (nops < 0) {
+        fprintf(stderr, "Tracefile error at line %lu\n", trace_line(trace));
+    }
+    trace_close(trace);
+    size_t *order = (size_t *)malloc(njobs * sizeof(size_t));
+    if (ops == NULL || order == NULL) {
+        if (ops != NULL) {
+            fprintf(stderr, "Malloc for configurations failed\n");
+        }
+        free(ops);
+        free(order);
+        free(jobs);
+        return -1;
+    }
+
+    for (size_t i = 0; i < njobs; i++) {
+        jobs[i].config.policy = jobs[i].policy;
+        order[i] = i;
+    }
+    sort_base = jobs;
+    qsort(order, njobs, sizeof(size_t), compare_jobs);
+
+    sweep_t sweep = {
+        .jobs = jobs,
+        .order = order,
+        .njobs = njobs,
+        .ops = ops,
+        .nops = (size_t)nops,
+        .threads = threads,
+    };
+    bool ok = sweep_run(&sweep);
+    if (!ok) {
+        fprintf(stderr, "Malloc for threads failed\n");
+    } else {
+        ok = print_results(jobs, njobs, json);
+    }
+    free(ops);
+    free(order);
+    free(jobs);
+    return ok ? 0 : -1;
+}
@@ -8,243 +8,1166 @@
  * @author Yujia Wang <yujiawan@andrew.cmu.edu>
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <getopt.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "cachelab.h"
+#include "coher.h"
+#include "hier.h"
+#include "libcsim.h"
+#include "mrc.h"
+#include "opt.h"
+#include "prefetch.h"
+#include "psim.h"
+#include "skew.h"
+#include "stackdist.h"
+#include "tagmatch.h"
+#include "tlb.h"
+#include "trace.h"
+#include "victim.h"
+
+/** @brief Minimum wall time spent timing each parser in --bench-parse */
+#define BENCH_MIN_SECONDS 1.0
+
+/** @brief Log number of sets of the caches timed by --bench-lookup */
+#define BENCH_LOG_SETS 6
+
+/** @brief Number of accesses replayed per cache by --bench-lookup */
+#define BENCH_ACCESSES (1 << 20)
+
+/** @brief Number of passes timed per method by --bench-batch */
+#define BENCH_BATCH_PASSES 5
+
+/** @brief Default fraction of blocks sampled by --mrc */
+#define MRC_DEFAULT_RATE 0.01
 
 /**
- * @brief Line structure of a set
+ * @brief Helper function to print usage info
  */
-typedef struct {
-    int valid;     /* valid bit set 1 if line has data loaded */
-    int dirty_bit; /* dirty bit set 1 if payload has been modified, but has not
-                      written back to memory */
-    unsigned long tag; /* tag of line */
-    unsigned long
-        LRU_counter; /* LRU counter, evict the block with max LRU counter */
-} line_t;
+void print_usage(void) {
+    printf("Usage: ./csim-ref [-hv] [-j <N>] [-p <policy>] -s <s> -E <E> "
+           "-b <b> -t <tracefile>\n"
+           "-h: Optional help flag that prints usage info\n"
+           "-v: Optional verbose flag that displays trace info\n"
+           "-s <s>: Number of set index bits (S = 2^s is the number of sets)\n"
+           "-S <S>: Number of sets, instead of -s; need not be a power of "
+           "two\n"
+           "-E <E>: Associativity (number of lines per set)\n"
+           "-b <b>: Number of block bits (B = 2^b is the block size)\n"
+           "-t <tracefile>: Name of the memory trace (text or binary) to "
+           "replay\n"
+           "-p <policy>: Replacement policy: " CSIM_POLICIES
+           ", or opt for Belady's optimal (not with -v) (default lru)\n"
+           "-j <N>: Simulate with N threads, each owning a share of the sets "
+           "(not with -v, drrip, --write-buffer, --prefetch, --split-blocks, "
+           "--icache, --tlb, -S, --index or --victim, which warn and use one "
+           "thread)\n"
+           "--write-through: Write stores to memory too, leaving lines clean\n"
+           "--no-write-allocate: Write stores that miss to memory only\n"
+           "--write-buffer <N>: Combine writes to memory in an N-entry "
+           "write-combining buffer\n"
+           "--split-blocks: Access every block an access spans, not only the "
+           "block of its first byte\n"
+           "--prefetch <kind>: Prefetch blocks into the cache: " PREFETCH_KINDS
+           "\n"
+           "--prefetch-degree <N>: Blocks per prefetch trigger, or per stream "
+           "buffer (default 1, or 4 for stream)\n"
+           "--prefetch-latency <N>: Accesses before a prefetch arrives "
+           "(default 0)\n"
+           "--victim <N>: Put an N-entry fully associative victim cache behind "
+           "the cache\n"
+           "--miss-cache <N>: Put an N-entry fully associative miss cache "
+           "behind the cache\n"
+           "--bench-parse: Time trace parsing against fscanf and exit\n"
+           "--bench-lookup: Time set lookup kernels per associativity and "
+           "exit\n"
+           "--bench-batch: Time single and batched simulation of the trace "
+           "and exit\n"
+           "--sweep-assoc: Simulate LRU with every associativity from 1 to E "
+           "in one pass\n"
+           "--mrc: Print the miss ratio curve of fully associative LRU "
+           "caches\n"
+           "--mrc-rate <R>: Sample a fraction R of the blocks for --mrc "
+           "(default 0.01)\n"
+           "--mrc-max <N>: Sample at most N blocks for --mrc, lowering the "
+           "rate as needed\n"
+           "--mrc-check: Also compute the exact curve and report the error\n"
+           "--opt-window <N>: Accesses per window of a binary trace with -p "
+           "opt\n"
+           "--hier <file>: Simulate the cache hierarchy in file, one \"<name> "
+           "<s> <E> <b> [policy=<p>] [inclusion=nine|inclusive|exclusive] "
+           "[cycles=<n>]\" line per level from L1 down, and an optional "
+           "\"memory cycles=<n>\" line, instead of -s, -E, -b and -p\n"
+           "--coherence <protocol>: Give each core of the trace a private "
+           "cache, kept coherent with " COHER_PROTOCOLS "\n"
+           "--llc <s>,<E>: Sets and ways of the LLC the cores share "
+           "(default s + 2 and E)\n"
+           "--icache <s>,<E>: Send instruction fetches (I records) to a "
+           "separate cache with these sets and ways, instead of the unified "
+           "cache\n"
+           "--tlb <s>,<E>[/<s>,<E>...]: Translate addresses through TLB levels "
+           "with these sets and ways, from L1 down, and index the cache with "
+           "physical addresses (which -v prints)\n"
+           "--page-size <size>: Page size for --tlb: " TLB_PAGE_SIZES
+           " (default 4k)\n"
+           "--index <function>: Map blocks to sets by " CSIM_INDEX_FUNCTIONS
+           " (default modulo; prime uses the largest prime number of sets up "
+           "to S, skew hashes each way differently and only replaces with "
+           "lru)\n");
+}
 
 /**
- * @brief Set structure of a cache
+ * @brief Move the instruction fetches of a batch to a batch of their own
+ *
+ * Each access is copied to both batches, and only the count of the one it
+ * belongs to advances, so that splitting takes no branch per access.
+ *
+ * @param[in,out] ops     Accesses, left holding only the data accesses
+ * @param[in,out] n       Number of accesses in ops
+ * @param[out]    fetches The instruction fetches, in order
+ *
+ * @return Number of instruction fetches
  */
-typedef struct {
-    line_t *lines; /* pointer to lines of a set */
-} set_t;
+static long split_fetches(access_t *ops, long *n, access_t *fetches) {
+    long data = 0;
+    long fetched = 0;
+    for (long i = 0; i < *n; i++) {
+        access_t op = ops[i];
+        long fetch = (op.op == 'I');
+        fetches[fetched] = op;
+        ops[data] = op;
+        fetched += fetch;
+        data += 1 - fetch;
+    }
+    *n = data;
+    return fetched;
+}
 
 /**
- * @brief Cache structure with parameters
+ * @brief Print an access and its outcome, as in verbose mode
  */
-typedef struct {
-    int s;       /* Number of set index bits */
-    int E;       /* Associativity (number of lines per set) */
-    int b;       /* Number of block bits */
-    set_t *sets; /* pointer to sets of a cache */
-} cache_t;
-
-unsigned long hit = 0;             /* number of hits */
-unsigned long miss = 0;            /* number of misses */
-unsigned long eviction = 0;        /* number of evictions */
-unsigned long dirty_bytes = 0;     /* number of dirty bytes in cache at end */
-unsigned long dirty_evictions = 0; /* number of dirty bytes evicted */
+static void print_access(const access_t *op, csim_result_t result) {
+    static const char *const RESULT_NAMES[] = {
+        [CSIM_HIT] = "hit",
+        [CSIM_MISS] = "miss",
+        [CSIM_MISS_EVICTION] = "miss eviction",
+    };
+    printf("%c %lx,%u %s%s\n", op->op, op->addr, op->size,
+           RESULT_NAMES[result], (op->op == 'M') ? " hit" : "");
+}
 
 /**
- * @brief Initialize a new cache
+ * @brief Simulate a batch of decoded accesses
  *
- * @param[in] s Number of set index bits
- * @param[in] E Associativity (number of lines per set)
- * @param[in] b Number of block bits
+ * In verbose mode each access is simulated on its own so that its outcome
+ * can be printed; otherwise the whole batch goes to the library at once.
+ * With a prefetcher or a victim cache, each data access goes through it
+ * instead. With an instruction cache, instruction fetches go to it rather
+ * than to cache.
  *
- * @return The new cache, or NULL if memory allocation failed
+ * @param[in,out] ops      The accesses, reordered if icache is not NULL
+ * @param[in]     icache   The instruction cache, or NULL if unified
+ * @param[in]     prefetch The prefetcher attached to cache, or NULL
+ * @param[in]     victim   The victim cache behind cache, or NULL
  */
-cache_t *cache_init(int s, int E, int b) {
-    cache_t *cache = (cache_t *)malloc(sizeof(cache_t));
-    if (cache == NULL) {
-        printf("Malloc for cache failed\n");
-        return NULL;
+void cache_sim_batch(csim_cache_t *cache, csim_cache_t *icache,
+                     prefetch_t *prefetch, victim_t *victim, access_t *ops,
+                     long n, bool verbose) {
+    static access_t fetches[TRACE_BATCH];
+    if (!verbose && icache != NULL) {
+        long fetched = split_fetches(ops, &n, fetches);
+        csim_access_batch(icache, fetches, (size_t)fetched);
+    }
+    if (!verbose && prefetch == NULL && victim == NULL) {
+        csim_access_batch(cache, ops, (size_t)n);
+        return;
+    }
+    for (long i = 0; i < n; i++) {
+        csim_result_t result;
+        if (icache != NULL && ops[i].op == 'I') {
+            result = csim_access(icache, &ops[i]);
+        } else if (prefetch != NULL) {
+            result = prefetch_access(prefetch, &ops[i]);
+        } else if (victim != NULL) {
+            result = victim_access(victim, &ops[i]);
+        } else {
+            result = csim_access(cache, &ops[i]);
+        }
+        if (verbose) {
+            print_access(&ops[i], result);
+        }
     }
-    cache->s = s;
-    cache->E = E;
-    cache->b = b;
+}
 
-    int S = 1 << s;
-    cache->sets = (set_t *)malloc(sizeof(set_t) * (unsigned long)S);
-    if (cache->sets == NULL) {
-        printf("Malloc for set failed\n");
-        free(cache);
-        return NULL;
+/**
+ * @brief Current time in seconds from a monotonic clock
+ */
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Parse a trace once with fscanf, as csim originally did
+ *
+ * @return Number of records parsed, or -1 if the file could not be opened
+ */
+static long bench_fscanf_pass(const char *tracefile, unsigned long *checksum) {
+    FILE *pFile = fopen(tracefile, "r");
+    if (pFile == NULL) {
+        return -1;
     }
+    char access_type;
+    unsigned long address;
+    int size;
+    long count = 0;
+    while (fscanf(pFile, "%c %lx,%d\n", &access_type, &address, &size) > 0) {
+        *checksum += address + (unsigned long)size;
+        count++;
+    }
+    fclose(pFile);
+    return count;
+}
 
-    for (int i = 0; i < S; i++) {
-        cache->sets[i].lines =
-            (line_t *)malloc(sizeof(line_t) * (unsigned long)E);
-        if (cache->sets[i].lines == NULL) {
-            printf("Malloc for line failed\n");
-            free(cache->sets);
-            free(cache);
-            return NULL;
+/**
+ * @brief Parse a trace once with the batched trace reader
+ *
+ * @return Number of records parsed, or -1 on error
+ */
+static long bench_reader_pass(const char *tracefile, unsigned long *checksum) {
+    trace_t *trace = trace_open(tracefile);
+    if (trace == NULL) {
+        return -1;
+    }
+    static access_t ops[TRACE_BATCH];
+    long count = 0;
+    long n;
+    while ((n = trace_read(trace, ops, TRACE_BATCH)) > 0) {
+        for (long i = 0; i < n; i++) {
+            *checksum += ops[i].addr + ops[i].size;
         }
+        count += n;
+    }
+    trace_close(trace);
+    return (n < 0) ? -1 : count;
+}
 
-        for (int j = 0; j < E; j++) {
-            cache->sets[i].lines[j].valid = 0;
-            cache->sets[i].lines[j].dirty_bit = 0;
-            cache->sets[i].lines[j].tag = 0;
-            cache->sets[i].lines[j].LRU_counter = 0;
-        }
+/**
+ * @brief Time one pass of a parser
+ *
+ * @return Records parsed per second, or a negative value on error
+ */
+static double bench_pass(long (*pass)(const char *, unsigned long *),
+                         const char *tracefile, long *records,
+                         unsigned long *checksum) {
+    double start = now_seconds();
+    long count = pass(tracefile, checksum);
+    if (count < 0) {
+        return -1.0;
     }
-    return cache;
+    *records = count;
+    return (double)count / (now_seconds() - start);
 }
 
 /**
- * @brief Free all memory used by a cache
+ * @brief Compare trace parsing throughput of fscanf and the trace reader
+ *
+ * Passes of the two parsers are interleaved until BENCH_MIN_SECONDS have
+ * elapsed, and the fastest pass of each is reported, so that noise from
+ * other load on the machine affects both sides equally. fscanf cannot read
+ * binary traces, so for those only the trace reader is timed.
  *
- * @param[in] cache the cache to free
+ * @return 0 on success, -1 on error
  */
-void cache_free(cache_t *cache) {
-    int S = 1 << cache->s;
-    for (int i = 0; i < S; i++) {
-        free(cache->sets[i].lines);
+int bench_parse(const char *tracefile) {
+    long fscanf_records = 0;
+    long reader_records = 0;
+    unsigned long fscanf_sum = 0;
+    unsigned long reader_sum = 0;
+    double fscanf_rate = 0.0;
+    double reader_rate = 0.0;
+
+    trace_t *trace = trace_open(tracefile);
+    if (trace == NULL) {
+        printf("Open file error\n");
+        return -1;
+    }
+    bool binary = (trace_format(trace) == TRACE_BINARY);
+    trace_close(trace);
+
+    double start = now_seconds();
+    do {
+        double rate;
+        if (!binary) {
+            rate = bench_pass(bench_fscanf_pass, tracefile, &fscanf_records,
+                              &fscanf_sum);
+            if (rate < 0) {
+                printf("Open file error\n");
+                return -1;
+            }
+            fscanf_rate = (rate > fscanf_rate) ? rate : fscanf_rate;
+        }
+
+        rate = bench_pass(bench_reader_pass, tracefile, &reader_records,
+                          &reader_sum);
+        if (rate < 0) {
+            printf("Tracefile error\n");
+            return -1;
+        }
+        reader_rate = (rate > reader_rate) ? rate : reader_rate;
+    } while (now_seconds() - start < BENCH_MIN_SECONDS);
+
+    if (binary) {
+        printf("records: %ld\n", reader_records);
+        printf("reader: %.2f M records/s\n", reader_rate / 1e6);
+        return 0;
     }
-    free(cache->sets);
-    free(cache);
+    if (fscanf_records != reader_records || fscanf_sum != reader_sum) {
+        printf("Parsers disagree: fscanf read %ld records, reader read %ld\n",
+               fscanf_records, reader_records);
+        return -1;
+    }
+
+    printf("records: %ld\n", reader_records);
+    printf("fscanf: %.2f M records/s\n", fscanf_rate / 1e6);
+    printf("reader: %.2f M records/s\n", reader_rate / 1e6);
+    printf("speedup: %.1fx\n", reader_rate / fscanf_rate);
+    return 0;
 }
 
 /**
- * @brief Helper function to print usage info
+ * @brief Next value of a xorshift pseudo-random sequence
  */
-void print_usage() {
-    printf("Usage: ./csim-ref [-hv] -s <s> -E <E> -b <b> -t <tracefile>\n"
-           "-h: Optional help flag that prints usage info\n"
-           "-v: Optional verbose flag that displays trace info\n"
-           "-s <s>: Number of set index bits (S = 2^s is the number of sets)\n"
-           "-E <E>: Associativity (number of lines per set)\n"
-           "-b <b>: Number of block bits (B = 2^b is the block size)\n"
-           "-t <tracefile>: Name of the memory trace to replay");
+static unsigned long bench_random(unsigned long *state) {
+    unsigned long x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
 }
 
 /**
- * @brief Add LRU counter of unused lines
+ * @brief Time one cache configuration on a trace
+ *
+ * @return Best rate of several runs, in accesses per second, or a
+ *         negative value if the cache could not be allocated
  */
-void add_LRU_counter(set_t *set_access, int begin_index, int end_index) {
-    for (int i = begin_index; i < end_index; i++) {
-        set_access->lines[i].LRU_counter++;
+static double bench_kernel(const csim_config_t *config, const access_t *ops,
+                           long n) {
+    double best = 0.0;
+    for (int rep = 0; rep < 5; rep++) {
+        csim_cache_t *cache = csim_create(config);
+        if (cache == NULL) {
+            return -1.0;
+        }
+        double start = now_seconds();
+        csim_access_batch(cache, ops, (size_t)n);
+        double rate = (double)n / (now_seconds() - start);
+        best = (rate > best) ? rate : best;
+        csim_destroy(cache);
     }
+    return best;
 }
 
 /**
- * @brief A cache simulator to simulate the behavior of a cache memory with data
- * load and store
+ * @brief Compare set lookup kernels across associativities
+ *
+ * For each associativity, a synthetic trace of random accesses to a working
+ * set 25% larger than the cache is replayed through the generic simulation
+ * kernel once per available lookup kernel, and then through the kernel
+ * specialized for that associativity, if there is one. The best of several
+ * runs is reported in millions of accesses per second. Associativities from
+ * MAP_MIN_ASSOC up use the block map instead of a lookup kernel, so every
+ * column shows the same path there.
+ *
+ * @return 0 on success, -1 on error
  */
-void cache_sim(char access_type, set_t *set_access, unsigned long tag, int E,
-               int b, bool verbose) {
-    unsigned long B = (unsigned long)(1 << b);
-    int hit_flag = 0;
-    int hit_index = 0;
-    for (int i = 0; i < E; i++) {
-        line_t *line_access = &(set_access->lines[i]);
-        if (line_access->tag == tag && line_access->valid == 1) {
-            if (verbose) {
-                printf("hit\n");
+int bench_lookup(void) {
+    static const int assocs[] = {1, 2, 4, 8, 12, 16, 24, 32, 64};
+    static access_t ops[BENCH_ACCESSES];
+    const tag_matcher_t *matchers;
+    int count = tagmatch_available(&matchers);
+    int b = 6;
+
+    printf("%5s", "E");
+    for (int m = 0; m < count; m++) {
+        printf("%10s", matchers[m].name);
+    }
+    printf("%10s   (M accesses/s)\n", "special");
+
+    for (size_t a = 0; a < sizeof(assocs) / sizeof(assocs[0]); a++) {
+        int E = assocs[a];
+        unsigned long blocks = (5UL << BENCH_LOG_SETS) * (unsigned long)E / 4;
+        unsigned long state = 0x2545f4914f6cdd1dUL;
+        for (long i = 0; i < BENCH_ACCESSES; i++) {
+            unsigned long r = bench_random(&state);
+            ops[i].addr = ((r >> 8) % blocks) << b;
+            ops[i].size = 8;
+            ops[i].op = (r & 7) ? 'L' : 'S';
+        }
+
+        printf("%5d", E);
+        csim_config_t config = {.s = BENCH_LOG_SETS, .E = E, .b = b};
+        for (int m = 0; m < count; m++) {
+            config.lookup = matchers[m].name;
+            config.generic = true;
+            double rate = bench_kernel(&config, ops, BENCH_ACCESSES);
+            if (rate < 0) {
+                return -1;
             }
-            hit++;
-            line_access->LRU_counter = 0;
-            hit_flag = 1;
-            hit_index = i;
-            break;
+            printf("%10.1f", rate / 1e6);
+        }
+
+        config.lookup = NULL;
+        config.generic = false;
+        csim_cache_t *probe = csim_create(&config);
+        if (probe == NULL) {
+            return -1;
+        }
+        bool special = strcmp(csim_kernel_name(probe), "generic") != 0;
+        csim_destroy(probe);
+        if (special) {
+            double rate = bench_kernel(&config, ops, BENCH_ACCESSES);
+            if (rate < 0) {
+                return -1;
+            }
+            printf("%10.1f", rate / 1e6);
         } else {
-            line_access->LRU_counter++;
+            printf("%10s", "-");
         }
+        printf("\n");
     }
-    if (hit_flag == 1) {
-        add_LRU_counter(set_access, hit_index + 1, E);
-        if (access_type == 'S' && set_access->lines[hit_index].dirty_bit == 0) {
-            set_access->lines[hit_index].dirty_bit = 1;
-            dirty_bytes += B;
+    return 0;
+}
+
+/**
+ * @brief Read a whole trace into memory
+ *
+ * @param[out] count Number of accesses read
+ *
+ * @return The accesses, to be freed by the caller, or NULL on error
+ */
+static access_t *load_trace(const char *tracefile, long *count) {
+    trace_t *trace = trace_open(tracefile);
+    if (trace == NULL) {
+        printf("Open file error\n");
+        return NULL;
+    }
+    access_t *ops;
+    long n = trace_read_all(trace, &ops);
+    if (n == -2) {
+        printf("Malloc for trace failed\n");
+    } else if (n < 0) {
+        printf("Tracefile error at line %lu\n", trace_line(trace));
+    }
+    trace_close(trace);
+    *count = n;
+    return ops;
+}
+
+/**
+ * @brief Time one pass of a trace through a new cache
+ *
+ * @param[in]  batch Whether to use csim_access_batch() or csim_access()
+ * @param[out] stats Statistics at the end of the pass
+ *
+ * @return Accesses simulated per second, or a negative value if the cache
+ *         could not be allocated
+ */
+static double bench_batch_pass(const csim_config_t *config, bool batch,
+                               const access_t *ops, long n,
+                               csim_stats_t *stats) {
+    csim_cache_t *cache = csim_create(config);
+    if (cache == NULL) {
+        return -1.0;
+    }
+    csim_access_batch(cache, ops, (size_t)n);
+    double start = now_seconds();
+    if (batch) {
+        csim_access_batch(cache, ops, (size_t)n);
+    } else {
+        for (long i = 0; i < n; i++) {
+            csim_access(cache, &ops[i]);
         }
-        return;
     }
+    double rate = (double)n / (now_seconds() - start);
+    csim_get_stats(cache, stats);
+    csim_destroy(cache);
+    return rate;
+}
 
-    if (verbose) {
-        printf("miss");
+/**
+ * @brief Compare one-at-a-time and batched simulation of a trace
+ *
+ * The trace is read into memory first, so that only simulation is timed.
+ * Passes of the two methods are interleaved and the fastest of each is
+ * reported. Batches prefetch set state ahead of use, which pays off once
+ * the cache no longer fits in the host's caches (large s).
+ *
+ * @return 0 on success, -1 on error
+ */
+int bench_batch(const csim_config_t *config, const char *tracefile) {
+    long n;
+    access_t *ops = load_trace(tracefile, &n);
+    if (ops == NULL) {
+        return -1;
     }
-    miss++;
-    int flag = 0;
-    int index = 0;
-    for (int i = 0; i < E; i++) {
-        line_t *line_access = &(set_access->lines[i]);
-        if (line_access->valid == 0) {
-            if (verbose) {
-                printf("\n");
+    double single_rate = 0.0;
+    double batch_rate = 0.0;
+    csim_stats_t single_stats;
+    csim_stats_t batch_stats;
+    for (int pass = 0; pass < BENCH_BATCH_PASSES; pass++) {
+        double rate = bench_batch_pass(config, false, ops, n, &single_stats);
+        single_rate = (rate > single_rate) ? rate : single_rate;
+        rate = bench_batch_pass(config, true, ops, n, &batch_stats);
+        batch_rate = (rate > batch_rate) ? rate : batch_rate;
+        if (rate < 0) {
+            printf("Malloc for cache failed\n");
+            free(ops);
+            return -1;
+        }
+    }
+    free(ops);
+
+    if (memcmp(&single_stats, &batch_stats, sizeof(csim_stats_t)) != 0) {
+        printf("Single and batched simulation disagree\n");
+        return -1;
+    }
+    printf("accesses: %ld\n", n);
+    printf("single: %.2f M accesses/s\n", single_rate / 1e6);
+    printf("batch: %.2f M accesses/s\n", batch_rate / 1e6);
+    printf("speedup: %.2fx\n", batch_rate / single_rate);
+    return 0;
+}
+
+/**
+ * @brief Simulate every LRU associativity from 1 to max_E in one pass
+ *
+ * An access hits in an E-way LRU set exactly when its stack distance is
+ * below E, so a histogram of the distances below max_E gives the hits of
+ * every associativity. Since lines are never invalidated, a set with n
+ * distinct blocks fills min(n, E) empty lines, and every other miss is an
+ * eviction. The results match running csim once per associativity, apart
+ * from the dirty byte counts, which are not reported.
+ *
+ * @return 0 on success, -1 on error
+ */
+int sweep_assoc(int s, int max_E, int b, const char *tracefile) {
+    trace_t *trace = trace_open(tracefile);
+    if (trace == NULL) {
+        printf("Open file error\n");
+        return -1;
+    }
+    stackdist_t *sd = stackdist_create(s);
+    unsigned long *hist =
+        (unsigned long *)calloc((size_t)max_E + 1, sizeof(unsigned long));
+    if (sd == NULL || hist == NULL) {
+        printf("Malloc for stack distances failed\n");
+        if (sd != NULL) {
+            stackdist_destroy(sd);
+        }
+        free(hist);
+        trace_close(trace);
+        return -1;
+    }
+
+    static access_t ops[TRACE_BATCH];
+    unsigned long total = 0;
+    long n;
+    int result = 0;
+    while (result == 0 && (n = trace_read(trace, ops, TRACE_BATCH)) > 0) {
+        unsigned long modifies = 0;
+        for (long i = 0; i < n; i++) {
+            modifies += (ops[i].op == 'M');
+            unsigned long distance;
+            if (!stackdist_access(sd, ops[i].addr >> b, &distance)) {
+                printf("Malloc for stack distances failed\n");
+                result = -1;
+                break;
             }
-            line_access->valid = 1;
-            line_access->tag = tag;
-            line_access->LRU_counter = 0;
-            flag = 1;
-            index = i;
-            break;
-        } else {
-            line_access->LRU_counter++;
+            hist[(distance < (unsigned long)max_E) ? distance
+                                                   : (unsigned long)max_E]++;
         }
+        /* The store of a modify hits at distance 0 */
+        hist[0] += modifies;
+        total += (unsigned long)n + modifies;
+    }
+    if (result == 0 && n < 0) {
+        printf("Tracefile error at line %lu\n", trace_line(trace));
+        result = -1;
     }
-    if (flag == 1) {
-        add_LRU_counter(set_access, index + 1, E);
-        if (access_type == 'S') {
-            set_access->lines[index].dirty_bit = 1;
-            dirty_bytes += B;
+    trace_close(trace);
+
+    if (result == 0) {
+        /* Reuse hist[0..max_E] afterwards to count sets by distinct blocks */
+        unsigned long *hits =
+            (unsigned long *)malloc((size_t)max_E * sizeof(unsigned long));
+        if (hits == NULL) {
+            printf("Malloc for stack distances failed\n");
+            result = -1;
+        } else {
+            unsigned long sum = 0;
+            for (int E = 0; E < max_E; E++) {
+                sum += hist[E];
+                hits[E] = sum;
+            }
+            memset(hist, 0, ((size_t)max_E + 1) * sizeof(unsigned long));
+            for (unsigned long set = 0; set < (1UL << s); set++) {
+                unsigned long blocks = stackdist_blocks(sd, set);
+                hist[(blocks < (unsigned long)max_E) ? blocks
+                                                     : (unsigned long)max_E]++;
+            }
+
+            printf("%5s %12s %12s %12s\n", "E", "hits", "misses",
+                   "evictions");
+            unsigned long fills = 0;
+            unsigned long full = (1UL << s) - hist[0];
+            for (int E = 1; E <= max_E; E++) {
+                /* Sets with at least E blocks fill their E-th line */
+                fills += full;
+                full -= hist[E];
+                unsigned long misses = total - hits[E - 1];
+                printf("%5d %12lu %12lu %12lu\n", E, hits[E - 1], misses,
+                       misses - fills);
+            }
+            free(hits);
         }
-        return;
     }
+    stackdist_destroy(sd);
+    free(hist);
+    return result;
+}
 
-    if (verbose) {
-        printf(" eviction\n");
+/**
+ * @brief Print the miss ratio curve of a trace
+ *
+ * Caches are fully associative LRU caches of 2^i blocks of 2^b bytes. The
+ * curve is estimated from a spatially sampled subset of the blocks (see
+ * mrc.c). If check is set, the exact curve is computed in the same pass,
+ * and the error of each point and the mean absolute error are reported.
+ *
+ * @return 0 on success, -1 on error
+ */
+int mrc_report(int b, double rate, unsigned long max_blocks, bool check,
+               const char *tracefile) {
+    trace_t *trace = trace_open(tracefile);
+    if (trace == NULL) {
+        printf("Open file error\n");
+        return -1;
     }
-    eviction++;
-    int evict_index = 0;
-    unsigned long max_counter = set_access->lines[0].LRU_counter;
-    for (int i = 1; i < E; i++) {
-        line_t *line_access = &(set_access->lines[i]);
-        if (line_access->LRU_counter > max_counter) {
-            evict_index = i;
+    mrc_t *sampled = mrc_create(rate, max_blocks);
+    mrc_t *exact = check ? mrc_create(1.0, 0) : NULL;
+    if (sampled == NULL || (check && exact == NULL)) {
+        printf("Malloc for miss ratio curve failed\n");
+        if (sampled != NULL) {
+            mrc_destroy(sampled);
         }
+        trace_close(trace);
+        return -1;
     }
-    set_access->lines[evict_index].tag = tag;
-    set_access->lines[evict_index].LRU_counter = 0;
-    add_LRU_counter(set_access, 0, evict_index);
-    add_LRU_counter(set_access, evict_index + 1, E);
 
-    if (set_access->lines[evict_index].dirty_bit == 0 && access_type == 'S') {
-        set_access->lines[evict_index].dirty_bit = 1;
-        dirty_bytes += B;
-        return;
+    static access_t ops[TRACE_BATCH];
+    long n;
+    int result = 0;
+    while (result == 0 && (n = trace_read(trace, ops, TRACE_BATCH)) > 0) {
+        for (long i = 0; i < n; i++) {
+            unsigned long block = ops[i].addr >> b;
+            if (!mrc_access(sampled, block) ||
+                (check && !mrc_access(exact, block))) {
+                printf("Malloc for miss ratio curve failed\n");
+                result = -1;
+                break;
+            }
+        }
+    }
+    if (result == 0 && n < 0) {
+        printf("Tracefile error at line %lu\n", trace_line(trace));
+        result = -1;
     }
+    trace_close(trace);
+
+    if (result == 0) {
+        double approx[MRC_POINTS];
+        double truth[MRC_POINTS];
+        int points = mrc_curve(sampled, approx);
+        if (check) {
+            int exact_points = mrc_curve(exact, truth);
+            for (int i = points; i < exact_points; i++) {
+                approx[i] = approx[points - 1];
+            }
+            for (int i = exact_points; i < points; i++) {
+                truth[i] = truth[exact_points - 1];
+            }
+            points = (exact_points > points) ? exact_points : points;
+        }
+        /* Only print cache sizes whose size in bytes is representable */
+        if (points > 64 - b) {
+            points = 64 - b;
+        }
 
-    if (set_access->lines[evict_index].dirty_bit == 1) {
-        if (access_type == 'L') {
-            set_access->lines[evict_index].dirty_bit = 0;
-            dirty_bytes -= B;
-            dirty_evictions += B;
+        printf("%12s %14s %10s", "blocks", "bytes", "miss ratio");
+        if (check) {
+            printf(" %10s %10s", "exact", "error");
         }
-        if (access_type == 'S') {
-            set_access->lines[evict_index].dirty_bit = 1;
-            dirty_evictions += B;
+        printf("\n");
+        /* Sampling cannot resolve distances below 1 / rate */
+        double min_size = 1.0 / mrc_rate(sampled);
+        double total_error = 0.0;
+        double large_error = 0.0;
+        int large_points = 0;
+        for (int i = 0; i < points; i++) {
+            printf("%12lu %14lu %10.6f", 1UL << i, 1UL << (i + b), approx[i]);
+            if (check) {
+                double error = approx[i] - truth[i];
+                double abs_error = (error < 0) ? -error : error;
+                total_error += abs_error;
+                if ((double)(1UL << i) >= min_size) {
+                    large_error += abs_error;
+                    large_points++;
+                }
+                printf(" %10.6f %+10.6f", truth[i], error);
+            }
+            printf("\n");
+        }
+        printf("sampling rate: %.6f, sampled blocks: %lu\n",
+               mrc_rate(sampled), mrc_sampled(sampled));
+        if (check) {
+            printf("mean absolute error: %.6f\n",
+                   total_error / (double)points);
+            if (large_points > 0) {
+                printf("mean absolute error from %.0f blocks: %.6f\n",
+                       min_size, large_error / (double)large_points);
+            }
+        }
+    }
+    mrc_destroy(sampled);
+    if (exact != NULL) {
+        mrc_destroy(exact);
+    }
+    return result;
+}
+
+/**
+ * @brief Print the hits in the ghost lists of the ARC or LFU policy
+ *
+ * @param[in] sets Number of sets, to average ARC's targets
+ */
+void print_ghosts(const csim_ghost_stats_t *ghosts, unsigned long sets) {
+    if (ghosts->lists == 1) {
+        printf("ghost_hits:%lu\n", ghosts->hits[0]);
+    } else {
+        printf("ghost_hits: b1:%lu b2:%lu mean_t1_target:%.2f\n",
+               ghosts->hits[0], ghosts->hits[1],
+               (double)ghosts->target / (double)sets);
+    }
+}
+
+/**
+ * @brief Print the writes that reached memory, and those combined
+ */
+void print_writes(const csim_write_stats_t *writes) {
+    printf("memory_writes:%lu memory_write_bytes:%lu combined:%lu "
+           "buffered_bytes:%lu\n",
+           writes->writes, writes->bytes, writes->combined, writes->buffered);
+}
+
+/**
+ * @brief Print the prefetches issued, and how they turned out
+ */
+void print_prefetch(const prefetch_stats_t *prefetch) {
+    printf("prefetches: issued:%lu useful:%lu late:%lu polluting:%lu "
+           "accuracy:%.6f\n",
+           prefetch->issued, prefetch->useful, prefetch->late,
+           prefetch->polluting,
+           prefetch->issued > 0
+               ? (double)prefetch->useful / (double)prefetch->issued
+               : 0.0);
+}
+
+/**
+ * @brief Print the hits of the victim or miss cache, and its evictions
+ *
+ * The dirty bytes the cache moved into a victim cache are printed apart,
+ * as the cache's summary counts them as evicted though they stay cached;
+ * only the victim cache's dirty evictions are written to memory.
+ */
+void print_victim(const victim_config_t *config, const victim_stats_t *victim) {
+    printf("%s hits:%lu misses:%lu dirty_bytes_moved:%lu evictions:%lu "
+           "dirty_bytes_evicted:%lu\n",
+           (config->kind == VICTIM_MISS) ? "miss_cache" : "victim",
+           victim->hits, victim->misses, victim->dirty_moves,
+           victim->evictions, victim->dirty_evictions);
+}
+
+/**
+ * @brief Print the hits and misses of each TLB level, and the page walks
+ */
+void print_tlb(const tlb_stats_t *tlb) {
+    for (int i = 0; i < tlb->levels; i++) {
+        printf("tlb%d hits:%lu misses:%lu\n", i + 1, tlb->hits[i],
+               tlb->misses[i]);
+    }
+    printf("page_walks:%lu walk_reads:%lu\n", tlb->walks, tlb->walk_reads);
+}
+
+/**
+ * @brief Translate the virtual addresses of a batch to physical ones
+ */
+static void translate_batch(tlb_t *tlb, access_t *ops, long n) {
+    for (long i = 0; i < n; i++) {
+        ops[i].addr = tlb_translate(tlb, ops[i].addr);
+    }
+}
+
+/**
+ * @brief Simulate a trace with several threads, as with -j
+ *
+ * @return 0 on success, -1 on error
+ */
+int parallel_sim(const csim_config_t *config, int threads,
+                 const char *tracefile) {
+    trace_t *trace = trace_open(tracefile);
+    if (trace == NULL) {
+        printf("Open file error\n");
+        return -1;
+    }
+    psim_t *psim = psim_create(config, threads);
+    if (psim == NULL) {
+        printf("Malloc for cache failed\n");
+        trace_close(trace);
+        return -1;
+    }
+    if (!psim_run(psim, trace)) {
+        printf("Tracefile error at line %lu\n", trace_line(trace));
+        trace_close(trace);
+        psim_destroy(psim);
+        return -1;
+    }
+    trace_close(trace);
+
+    csim_stats_t stats;
+    csim_ghost_stats_t ghosts;
+    psim_get_stats(psim, &stats);
+    if (psim_get_ghost_stats(psim, &ghosts)) {
+        print_ghosts(&ghosts, 1UL << config->s);
+    }
+    if (config->write_through || config->no_write_allocate) {
+        csim_write_stats_t writes;
+        psim_get_write_stats(psim, &writes);
+        print_writes(&writes);
+    }
+    psim_destroy(psim);
+    printSummary(&stats);
+    return 0;
+}
+
+/**
+ * @brief Simulate a trace with Belady's OPT replacement, as with -p opt
+ *
+ * @return 0 on success, -1 on error
+ */
+int opt_sim(const csim_config_t *config, size_t window,
+            const char *tracefile) {
+    trace_t *trace = trace_open(tracefile);
+    if (trace == NULL) {
+        printf("Open file error\n");
+        return -1;
+    }
+    opt_t *opt = opt_create(config, window);
+    if (opt == NULL) {
+        printf("Malloc for cache failed\n");
+        trace_close(trace);
+        return -1;
+    }
+    long n = opt_run(opt, trace);
+    if (n == -1) {
+        printf("Tracefile error at line %lu\n", trace_line(trace));
+    } else if (n == -2) {
+        printf("Malloc for next uses failed\n");
+    } else if (n == -3) {
+        printf("Temporary file for next uses failed\n");
+    }
+    trace_close(trace);
+
+    csim_stats_t stats;
+    opt_get_stats(opt, &stats);
+    opt_destroy(opt);
+    if (n < 0) {
+        return -1;
+    }
+    printSummary(&stats);
+    return 0;
+}
+
+/**
+ * @brief Simulate a trace with a skewed-associative cache, as with
+ *        --index skew
+ *
+ * @return 0 on success, -1 on error
+ */
+int skew_sim(const csim_config_t *config, bool verbose,
+             const char *tracefile) {
+    trace_t *trace = trace_open(tracefile);
+    if (trace == NULL) {
+        printf("Open file error\n");
+        return -1;
+    }
+    skew_t *skew = skew_create(config);
+    if (skew == NULL) {
+        printf("Malloc for cache failed\n");
+        trace_close(trace);
+        return -1;
+    }
+    static access_t ops[TRACE_BATCH];
+    long n;
+    while ((n = trace_read(trace, ops, TRACE_BATCH)) > 0) {
+        for (long i = 0; i < n; i++) {
+            csim_result_t result = skew_access(skew, &ops[i]);
+            if (verbose) {
+                print_access(&ops[i], result);
+            }
         }
     }
+    if (n < 0) {
+        printf("Tracefile error at line %lu\n", trace_line(trace));
+    }
+    trace_close(trace);
+
+    csim_stats_t stats;
+    skew_get_stats(skew, &stats);
+    skew_destroy(skew);
+    if (n < 0) {
+        return -1;
+    }
+    printSummary(&stats);
+    return 0;
+}
+
+/**
+ * @brief Simulate a cache hierarchy and print the statistics of each level
+ *
+ * The last line is the cycle estimate of the whole trace, and the average
+ * memory access time (AMAT) in cycles per access.
+ *
+ * @return 0 on success, -1 on error
+ */
+int hier_sim(const char *config_file, const char *tracefile) {
+    hier_config_t config;
+    long bad = hier_read_config(config_file, &config);
+    if (bad == -1) {
+        printf("Open file error\n");
+        return -1;
+    }
+    if (bad == -2) {
+        printf("No cache levels in hierarchy\n");
+        return -1;
+    }
+    if (bad != 0) {
+        printf("Invalid hierarchy at line %ld\n", bad);
+        return -1;
+    }
+    trace_t *trace = trace_open(tracefile);
+    if (trace == NULL) {
+        printf("Open file error\n");
+        return -1;
+    }
+    hier_t *hier = hier_create(&config);
+    if (hier == NULL) {
+        printf("Malloc for cache failed\n");
+        trace_close(trace);
+        return -1;
+    }
+    bool ok = hier_run(hier, trace);
+    if (!ok) {
+        printf("Tracefile error at line %lu\n", trace_line(trace));
+    }
+    trace_close(trace);
+
+    hier_stats_t stats;
+    hier_get_stats(hier, &stats);
+    hier_destroy(hier);
+    if (!ok) {
+        return -1;
+    }
+    for (int i = 0; i < stats.levels; i++) {
+        const hier_level_stats_t *level = &stats.level[i];
+        printf("%s hits:%lu misses:%lu evictions:%lu writebacks:%lu "
+               "back_invalidations:%lu\n",
+               config.level[i].name, level->hits, level->misses,
+               level->evictions, level->writebacks,
+               level->back_invalidations);
+    }
+    printf("memory reads:%lu writes:%lu\n", stats.memory_reads,
+           stats.memory_writes);
+    printf("cycles:%lu amat:%.2f\n", stats.cycles,
+           stats.accesses > 0 ? (double)stats.cycles / (double)stats.accesses
+                              : 0.0);
+    return 0;
+}
+
+/**
+ * @brief Simulate private caches kept coherent across cores, and an LLC
+ *
+ * Prints the statistics of each core, then of the LLC, memory and sharing
+ * misses, and last the blocks with the most false sharing misses.
+ *
+ * @return 0 on success, -1 on error
+ */
+int coher_sim(const coher_config_t *config, const char *tracefile) {
+    trace_t *trace = trace_open(tracefile);
+    if (trace == NULL) {
+        printf("Open file error\n");
+        return -1;
+    }
+    coher_t *coher = coher_create(config);
+    if (coher == NULL) {
+        printf("Malloc for cache failed\n");
+        trace_close(trace);
+        return -1;
+    }
+    long result = coher_run(coher, trace);
+    if (result == -1) {
+        printf("Tracefile error at line %lu\n", trace_line(trace));
+    } else if (result == -2) {
+        printf("Core out of range at line %lu (at most %d cores)\n",
+               trace_line(trace), COHER_MAX_CORES);
+    } else if (result == -3) {
+        printf("Malloc for cache failed\n");
+    }
+    trace_close(trace);
+
+    coher_stats_t stats;
+    coher_get_stats(coher, &stats);
+    coher_destroy(coher);
+    if (result != 0) {
+        return -1;
+    }
+    for (int i = 0; i < stats.cores; i++) {
+        const coher_core_stats_t *core = &stats.core[i];
+        printf("core%d hits:%lu misses:%lu evictions:%lu writebacks:%lu "
+               "upgrades:%lu invalidations:%lu interventions:%lu\n",
+               i, core->hits, core->misses, core->evictions, core->writebacks,
+               core->upgrades, core->invalidations, core->interventions);
+    }
+    printf("llc hits:%lu misses:%lu evictions:%lu\n", stats.llc.hits,
+           stats.llc.misses, stats.llc.evictions);
+    printf("memory reads:%lu writes:%lu\n", stats.memory_reads,
+           stats.memory_writes);
+    printf("sharing_misses true:%lu false:%lu\n", stats.true_sharing,
+           stats.false_sharing);
+    for (int i = 0; i < stats.blocks; i++) {
+        const coher_block_t *block = &stats.block[i];
+        printf("false_sharing %lx: false:%lu true:%lu cores:%x\n",
+               block->addr, block->false_sharing, block->true_sharing,
+               block->cores);
+    }
+    return 0;
+}
+
+/**
+ * @brief Print how the leader sets of a set-dueling policy performed
+ */
+void print_duel(const csim_cache_t *cache) {
+    csim_duel_stats_t duel;
+    if (!csim_get_duel_stats(cache, &duel)) {
+        return;
+    }
+    for (int team = 0; team < 2; team++) {
+        unsigned long accesses = duel.hits[team] + duel.misses[team];
+        printf("%s leaders: sets:%lu hits:%lu misses:%lu miss_ratio:%.6f\n",
+               duel.policy[team], duel.sets[team], duel.hits[team],
+               duel.misses[team],
+               accesses > 0 ? (double)duel.misses[team] / (double)accesses
+                            : 0.0);
+    }
+    printf("psel:%u/%u followers:%s\n", duel.psel, duel.psel_max,
+           duel.policy[duel.psel > duel.psel_max / 2 ? 1 : 0]);
 }
 
 int main(int argc, char *argv[]) {
-    int s, E, b = 0;
+    int s = -1;
+    int E = 0;
+    int b = 0;
+    int threads = 1;
+    const char *policy = NULL;
     bool verbose = false;
-    char *tracefile;
+    bool bench = false;
+    bool batch = false;
+    bool sweep = false;
+    bool mrc = false;
+    bool mrc_check = false;
+    double mrc_rate = MRC_DEFAULT_RATE;
+    unsigned long mrc_max = 0;
+    size_t opt_window = OPT_WINDOW;
+    const char *hier_file = NULL;
+    bool write_through = false;
+    bool no_write_allocate = false;
+    int write_buffer = 0;
+    bool split = false;
+    const char *prefetch_kind = NULL;
+    int prefetch_degree = 0;
+    long prefetch_latency = 0;
+    const char *protocol = NULL;
+    int llc_s = -1;
+    int llc_E = 0;
+    int icache_s = -1;
+    int icache_E = 0;
+    const char *tlb_levels = NULL;
+    const char *page_size = NULL;
+    unsigned long sets = 0;
+    const char *index_name = NULL;
+    victim_kind_t victim_kind = VICTIM_CACHE;
+    int victim_entries = 0;
+    char *tracefile = NULL;
+
+    static const struct option long_options[] = {
+        {"bench-parse", no_argument, NULL, 'P'},
+        {"bench-lookup", no_argument, NULL, 'L'},
+        {"bench-batch", no_argument, NULL, 'B'},
+        {"sweep-assoc", no_argument, NULL, 'A'},
+        {"mrc", no_argument, NULL, 'M'},
+        {"mrc-rate", required_argument, NULL, 'R'},
+        {"mrc-max", required_argument, NULL, 'N'},
+        {"mrc-check", no_argument, NULL, 'C'},
+        {"opt-window", required_argument, NULL, 'W'},
+        {"hier", required_argument, NULL, 'H'},
+        {"write-through", no_argument, NULL, 'T'},
+        {"no-write-allocate", no_argument, NULL, 'n'},
+        {"write-buffer", required_argument, NULL, 'w'},
+        {"split-blocks", no_argument, NULL, 'k'},
+        {"prefetch", required_argument, NULL, 'f'},
+        {"prefetch-degree", required_argument, NULL, 'd'},
+        {"prefetch-latency", required_argument, NULL, 'l'},
+        {"coherence", required_argument, NULL, 'c'},
+        {"llc", required_argument, NULL, 'U'},
+        {"icache", required_argument, NULL, 'I'},
+        {"tlb", required_argument, NULL, 'X'},
+        {"page-size", required_argument, NULL, 'z'},
+        {"index", required_argument, NULL, 'i'},
+        {"victim", required_argument, NULL, 'V'},
+        {"miss-cache", required_argument, NULL, 'm'},
+        {NULL, 0, NULL, 0},
+    };
 
     int opt;
-    while ((opt = getopt(argc, argv, "hvs:E:b:t:")) != -1) {
+    while ((opt = getopt_long(argc, argv, "hvs:S:E:b:t:j:p:", long_options,
+                              NULL)) != -1) {
         switch (opt) {
         case 's':
             s = atoi(optarg);
             break;
+        case 'S':
+            sets = strtoul(optarg, NULL, 10);
+            break;
         case 'E':
             E = atoi(optarg);
             break;
@@ -254,53 +1177,368 @@ int main(int argc, char *argv[]) {
         case 't':
             tracefile = optarg;
             break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'p':
+            policy = optarg;
+            break;
         case 'v':
             verbose = true;
             break;
+        case 'P':
+            bench = true;
+            break;
+        case 'L':
+            return bench_lookup() == 0 ? 0 : -1;
+        case 'B':
+            batch = true;
+            break;
+        case 'A':
+            sweep = true;
+            break;
+        case 'M':
+            mrc = true;
+            break;
+        case 'R':
+            mrc_rate = atof(optarg);
+            break;
+        case 'N':
+            mrc_max = strtoul(optarg, NULL, 10);
+            break;
+        case 'C':
+            mrc_check = true;
+            break;
+        case 'W':
+            opt_window = strtoul(optarg, NULL, 10);
+            break;
+        case 'H':
+            hier_file = optarg;
+            break;
+        case 'T':
+            write_through = true;
+            break;
+        case 'n':
+            no_write_allocate = true;
+            break;
+        case 'w':
+            write_buffer = atoi(optarg);
+            break;
+        case 'k':
+            split = true;
+            break;
+        case 'f':
+            prefetch_kind = optarg;
+            break;
+        case 'd':
+            prefetch_degree = atoi(optarg);
+            break;
+        case 'l':
+            prefetch_latency = atol(optarg);
+            break;
+        case 'c':
+            protocol = optarg;
+            break;
+        case 'U':
+            if (sscanf(optarg, "%d,%d", &llc_s, &llc_E) != 2) {
+                llc_s = -2;
+            }
+            break;
+        case 'I':
+            if (sscanf(optarg, "%d,%d", &icache_s, &icache_E) != 2) {
+                icache_s = -2;
+            }
+            break;
+        case 'X':
+            tlb_levels = optarg;
+            break;
+        case 'z':
+            page_size = optarg;
+            break;
+        case 'i':
+            index_name = optarg;
+            break;
+        case 'V':
+            victim_kind = VICTIM_CACHE;
+            victim_entries = atoi(optarg);
+            break;
+        case 'm':
+            victim_kind = VICTIM_MISS;
+            victim_entries = atoi(optarg);
+            break;
         case 'h':
         default:
             print_usage();
         }
     }
 
-    if (s < 0 || E <= 0 || b < 0 || tracefile == NULL) {
+    if (bench && tracefile != NULL) {
+        return bench_parse(tracefile) == 0 ? 0 : -1;
+    }
+    bool separate_icache = (icache_s != -1);
+    bool translating = (tlb_levels != NULL);
+    bool indexed = (sets != 0 || index_name != NULL);
+    bool victimizing = (victim_entries != 0);
+    if (hier_file != NULL) {
+        if (tracefile == NULL || policy != NULL || verbose || threads != 1 ||
+            prefetch_kind != NULL || protocol != NULL || split ||
+            separate_icache || translating || indexed || victimizing) {
+            printf("Invalid input!\n");
+            return -1;
+        }
+        return hier_sim(hier_file, tracefile) == 0 ? 0 : -1;
+    }
+    bool lru = (policy == NULL || strcmp(policy, "lru") == 0);
+    bool optimal = (policy != NULL && strcmp(policy, "opt") == 0);
+    if ((mrc || sweep) && !lru) {
+        printf("Stack distances only apply to LRU\n");
+        return -1;
+    }
+    if (mrc) {
+        if (b < 0 || b >= 64 || !(mrc_rate > 0.0 && mrc_rate <= 1.0) ||
+            tracefile == NULL || separate_icache || translating || indexed ||
+            victimizing) {
+            printf("Invalid input!\n");
+            return -1;
+        }
+        return mrc_report(b, mrc_rate, mrc_max, mrc_check, tracefile) == 0
+                   ? 0
+                   : -1;
+    }
+
+    bool writes = write_through || no_write_allocate || write_buffer != 0;
+    tlb_config_t tlb_config = {.page_bits = 12};
+    prefetch_config_t prefetch_config = {.b = b, .degree = prefetch_degree};
+    bool prefetching = (prefetch_kind != NULL);
+    victim_config_t victim_config = {
+        .kind = victim_kind, .b = b, .entries = victim_entries};
+    csim_index_t index = CSIM_INDEX_MODULO;
+    bool index_exists =
+        (index_name == NULL || csim_index_parse(index_name, &index));
+    bool skewed = (index == CSIM_INDEX_SKEW);
+    if ((s < 0) == (sets == 0) || E <= 0 || E > CSIM_MAX_ASSOC || b < 0 ||
+        (sets == 0 && s + b >= 64) || !index_exists ||
+        (indexed && (optimal || sweep)) ||
+        (skewed && (!lru || writes || split || separate_icache ||
+                    translating || prefetching || batch)) ||
+        threads < 1 || threads > PSIM_MAX_THREADS || tracefile == NULL ||
+        (!optimal && !csim_policy_exists(policy)) || opt_window == 0 ||
+        (optimal && (verbose || batch)) || write_buffer < 0 ||
+        write_buffer > CSIM_MAX_WRITE_BUFFER ||
+        ((writes || split) && (optimal || sweep)) ||
+        (separate_icache &&
+         (optimal || sweep || batch || icache_s < 0 || icache_s + b >= 64 ||
+          icache_E <= 0 || icache_E > CSIM_MAX_ASSOC)) ||
+        (page_size != NULL &&
+         (!translating || !tlb_parse_page(page_size, &tlb_config.page_bits))) ||
+        (translating && (optimal || sweep || batch ||
+                         !tlb_parse_levels(tlb_levels, &tlb_config))) ||
+        (prefetching &&
+         (optimal || sweep || split ||
+          !prefetch_parse(prefetch_kind, &prefetch_config.kind) ||
+          prefetch_degree < 0 || prefetch_degree > PREFETCH_MAX_DEGREE ||
+          prefetch_latency < 0 || prefetch_latency > PREFETCH_MAX_LATENCY)) ||
+        (victimizing &&
+         (optimal || sweep || batch || skewed || writes || split ||
+          prefetching || victim_entries < 0 ||
+          victim_entries > VICTIM_MAX_ENTRIES))) {
         printf("Invalid input!\n");
         return -1;
     }
 
-    cache_t *cache = cache_init(s, E, b);
-    FILE *pFile;
-    pFile = fopen(tracefile, "r");
-    if (pFile == NULL) {
+    csim_config_t config = {.s = s,
+                            .E = E,
+                            .b = b,
+                            .policy = policy,
+                            .write_through = write_through,
+                            .no_write_allocate = no_write_allocate,
+                            .write_buffer = write_buffer,
+                            .split = split,
+                            .sets = sets,
+                            .index = index};
+    if (csim_config_sets(&config) == 0) {
+        printf("Invalid input!\n");
+        return -1;
+    }
+    prefetch_config.latency = (unsigned long)prefetch_latency;
+    if (protocol != NULL) {
+        coher_config_t coher = {.core = config, .llc = config};
+        coher.llc.s = (llc_s == -1) ? s + 2 : llc_s;
+        coher.llc.E = (llc_E == 0) ? E : llc_E;
+        if (!coher_parse(protocol, &coher.protocol) || coher.llc.s < 0 ||
+            coher.llc.s + b >= 64 || coher.llc.E <= 0 ||
+            coher.llc.E > CSIM_MAX_ASSOC || verbose || batch || sweep ||
+            optimal || writes || split || prefetching || separate_icache ||
+            translating || indexed || victimizing || threads != 1) {
+            printf("Invalid input!\n");
+            return -1;
+        }
+        return coher_sim(&coher, tracefile) == 0 ? 0 : -1;
+    }
+    bool serial = verbose || batch || sweep || optimal ||
+                  !csim_policy_per_set(policy) || write_buffer != 0 || split ||
+                  prefetching || separate_icache || translating || indexed ||
+                  victimizing;
+    if (threads > 1 && serial) {
+        fprintf(stderr, "Warning: -j %d is not supported with these options, "
+                        "simulating with one thread\n",
+                threads);
+    }
+    if (batch) {
+        return bench_batch(&config, tracefile) == 0 ? 0 : -1;
+    }
+    if (sweep) {
+        return sweep_assoc(s, E, b, tracefile) == 0 ? 0 : -1;
+    }
+    if (optimal) {
+        return opt_sim(&config, opt_window, tracefile) == 0 ? 0 : -1;
+    }
+    if (skewed) {
+        return skew_sim(&config, verbose, tracefile) == 0 ? 0 : -1;
+    }
+    if (threads > 1 && !serial) {
+        return parallel_sim(&config, threads, tracefile) == 0 ? 0 : -1;
+    }
+
+    trace_t *trace = trace_open(tracefile);
+    if (trace == NULL) {
         printf("Open file error\n");
         return -1;
     }
-    char access_type;
-    unsigned long address;
-    int size;
-    while (fscanf(pFile, "%c %lx,%d\n", &access_type, &address, &size) > 0) {
-        unsigned long set_index = (address >> b) & ((1 << s) - 1);
-        unsigned long tag = address >> (s + b);
-        set_t *set_access = &(cache->sets[set_index]);
-        if (verbose) {
-            printf("%c %lx,%d ", access_type, address, size);
+    csim_cache_t *cache = csim_create(&config);
+    if (cache == NULL) {
+        printf("Malloc for cache failed\n");
+        trace_close(trace);
+        return -1;
+    }
+    csim_cache_t *icache = NULL;
+    if (separate_icache) {
+        csim_config_t icache_config = {.s = icache_s,
+                                       .E = icache_E,
+                                       .b = b,
+                                       .policy = policy,
+                                       .split = split};
+        icache = csim_create(&icache_config);
+        if (icache == NULL) {
+            printf("Malloc for cache failed\n");
+            trace_close(trace);
+            csim_destroy(cache);
+            return -1;
         }
-        if ((access_type == 'L') || (access_type == 'S')) {
-            cache_sim(access_type, set_access, tag, E, b, verbose);
-        } else {
-            printf("Tracefile error\n");
+    }
+    prefetch_t *prefetch = NULL;
+    if (prefetching) {
+        prefetch = prefetch_create(cache, &prefetch_config);
+        if (prefetch == NULL) {
+            printf("Malloc for prefetcher failed\n");
+            trace_close(trace);
+            if (icache != NULL) {
+                csim_destroy(icache);
+            }
+            csim_destroy(cache);
+            return -1;
+        }
+    }
+    victim_t *victim = NULL;
+    if (victimizing) {
+        victim = victim_create(cache, &victim_config);
+        if (victim == NULL) {
+            printf("Malloc for victim cache failed\n");
+            trace_close(trace);
+            if (icache != NULL) {
+                csim_destroy(icache);
+            }
+            csim_destroy(cache);
+            return -1;
+        }
+    }
+    tlb_t *tlb = NULL;
+    if (translating) {
+        tlb = tlb_create(&tlb_config);
+        if (tlb == NULL) {
+            printf("Invalid input!\n");
+            trace_close(trace);
+            if (victim != NULL) {
+                victim_destroy(victim);
+            }
+            if (prefetch != NULL) {
+                prefetch_destroy(prefetch);
+            }
+            if (icache != NULL) {
+                csim_destroy(icache);
+            }
+            csim_destroy(cache);
             return -1;
         }
     }
-    fclose(pFile);
-    cache_free(cache);
+
+    static access_t ops[TRACE_BATCH];
+    long n;
+    while ((n = trace_read(trace, ops, TRACE_BATCH)) > 0) {
+        if (tlb != NULL) {
+            translate_batch(tlb, ops, n);
+        }
+        cache_sim_batch(cache, icache, prefetch, victim, ops, n, verbose);
+    }
+    if (n < 0) {
+        printf("Tracefile error at line %lu\n", trace_line(trace));
+        trace_close(trace);
+        if (tlb != NULL) {
+            tlb_destroy(tlb);
+        }
+        if (victim != NULL) {
+            victim_destroy(victim);
+        }
+        if (prefetch != NULL) {
+            prefetch_destroy(prefetch);
+        }
+        if (icache != NULL) {
+            csim_destroy(icache);
+        }
+        csim_destroy(cache);
+        return -1;
+    }
+    trace_close(trace);
 
     csim_stats_t stats;
-    stats.hits = hit;
-    stats.misses = miss;
-    stats.evictions = eviction;
-    stats.dirty_bytes = dirty_bytes;
-    stats.dirty_evictions = dirty_evictions;
+    csim_get_stats(cache, &stats);
+    print_duel(cache);
+    csim_ghost_stats_t ghosts;
+    if (csim_get_ghost_stats(cache, &ghosts)) {
+        print_ghosts(&ghosts, csim_config_sets(&config));
+    }
+    if (writes) {
+        csim_write_stats_t write_stats;
+        csim_get_write_stats(cache, &write_stats);
+        print_writes(&write_stats);
+    }
+    if (prefetch != NULL) {
+        prefetch_stats_t prefetch_stats;
+        prefetch_get_stats(prefetch, &prefetch_stats);
+        print_prefetch(&prefetch_stats);
+        prefetch_destroy(prefetch);
+    }
+    if (victim != NULL) {
+        victim_stats_t victim_stats;
+        victim_get_stats(victim, &victim_stats);
+        print_victim(&victim_config, &victim_stats);
+        victim_destroy(victim);
+    }
+    if (icache != NULL) {
+        csim_stats_t icache_stats;
+        csim_get_stats(icache, &icache_stats);
+        printf("icache hits:%lu misses:%lu evictions:%lu\n",
+               icache_stats.hits, icache_stats.misses, icache_stats.evictions);
+        csim_destroy(icache);
+    }
+    if (tlb != NULL) {
+        tlb_stats_t tlb_stats;
+        tlb_get_stats(tlb, &tlb_stats);
+        print_tlb(&tlb_stats);
+        tlb_destroy(tlb);
+    }
+    csim_destroy(cache);
     printSummary(&stats);
     return 0;
 }
+
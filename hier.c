@@ -0,0 +1,414 @@
+/**
+ * @file hier.c
+ * @brief Multi-level cache hierarchy simulation
+ *
+ * A hierarchy is a stack of csim_cache_t levels, the first one closest to
+ * the CPU, simulated in one pass over the trace. An access that misses in
+ * a level becomes a request for the block to the level below, down to
+ * memory, and the block is filled on its way back up. Every level is
+ * write-back and write-allocate: a dirty block evicted from a level is
+ * written to the level below, which takes it even if it does not hold
+ * the block (as csim_fill() does), and clean blocks evicted are dropped.
+ *
+ * The inclusion property of a level says which blocks of the levels above
+ * it may hold:
+ *
+ * - nine (non-inclusive, non-exclusive): any. The level is filled by the
+ *   requests it misses and the writebacks it takes, and evicts blocks
+ *   without looking above.
+ * - inclusive: every block cached above. Evicting a block invalidates it
+ *   in every level above (a back-invalidation), and a dirty copy found
+ *   there is written back along with it.
+ * - exclusive: no block of the level right above, acting as its victim
+ *   cache. A request that hits moves the block up, dirty bit and all, and
+ *   one that misses is passed on without filling the level. Every block
+ *   evicted from the level above, clean or dirty, is filled instead.
+ *
+ * A level requests a block from the level below before sending its own
+ * victim down, so that an exclusive level swaps the two blocks. Meanwhile
+ * the victim waits in the level's writeback buffer, where inclusive
+ * levels below look for it too. All levels must have the same block size.
+ *
+ * The cycle estimate extends the HIT_CYCLES and MISS_CYCLES model of one
+ * cache to a hierarchy: an access costs the latency of the level it hits
+ * in, or of memory if it misses everywhere. Writebacks and back-
+ * invalidations are assumed to be off the critical path and cost nothing.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hier.h"
+
+/**
+ * @brief Hierarchy simulator
+ */
+struct hier {
+    int levels;                                  /* number of levels */
+    csim_cache_t *caches[HIER_MAX_LEVELS];       /* the levels, L1 first */
+    hier_inclusion_t inclusion[HIER_MAX_LEVELS]; /* of each level */
+    unsigned long cycles[HIER_MAX_LEVELS];       /* hit latency of each */
+    unsigned long memory_cycles;                 /* latency of memory */
+    int b;                                       /* number of block bits */
+    csim_eviction_t pending[HIER_MAX_LEVELS];    /* victim of each level */
+    bool waiting[HIER_MAX_LEVELS];               /* whether it is not sent */
+    hier_stats_t stats;                          /* statistics so far */
+    access_t batch[TRACE_BATCH];                 /* accesses being decoded */
+};
+
+/**
+ * @brief Parse a positive integer option value
+ *
+ * @return true on success, false if value is not a number above zero
+ */
+static bool parse_count(const char *value, unsigned long *count) {
+    char *end;
+    if (!isdigit((unsigned char)*value)) {
+        return false;
+    }
+    *count = strtoul(value, &end, 10);
+    return *end == '\0' && *count > 0;
+}
+
+/**
+ * @brief Parse one "key=value" option of a level or of memory
+ *
+ * @param[out] level   The level the option applies to, or NULL for memory
+ * @param[out] cycles  Latency, set by a cycles option
+ *
+ * @return true on success, false if the option is unknown or invalid
+ */
+static bool parse_option(char *option, hier_level_config_t *level,
+                         unsigned long *cycles) {
+    char *value = strchr(option, '=');
+    if (value == NULL) {
+        return false;
+    }
+    *value++ = '\0';
+    if (strcmp(option, "cycles") == 0) {
+        return parse_count(value, cycles);
+    }
+    if (level == NULL) {
+        return false;
+    }
+    if (strcmp(option, "policy") == 0) {
+        if (strlen(value) >= HIER_POLICY_LEN || !csim_policy_exists(value)) {
+            return false;
+        }
+        strcpy(level->policy, value);
+        return true;
+    }
+    if (strcmp(option, "inclusion") == 0) {
+        if (strcmp(value, "nine") == 0) {
+            level->inclusion = HIER_NINE;
+        } else if (strcmp(value, "inclusive") == 0) {
+            level->inclusion = HIER_INCLUSIVE;
+        } else if (strcmp(value, "exclusive") == 0) {
+            level->inclusion = HIER_EXCLUSIVE;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Parse one line of a hierarchy file, which is not blank
+ *
+ * @return true on success, false if the line is invalid
+ */
+static bool parse_line(char *line, hier_config_t *config) {
+    char *save;
+    char *name = strtok_r(line, " \t\r\n", &save);
+    char *option;
+    if (strcmp(name, "memory") == 0) {
+        while ((option = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+            if (!parse_option(option, NULL, &config->memory_cycles)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    if (config->levels == HIER_MAX_LEVELS || strlen(name) >= HIER_NAME_LEN) {
+        return false;
+    }
+    hier_level_config_t *level = &config->level[config->levels];
+    memset(level, 0, sizeof(*level));
+    strcpy(level->name, name);
+    strcpy(level->policy, "lru");
+    int *fields[] = {&level->s, &level->E, &level->b};
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        char *field = strtok_r(NULL, " \t\r\n", &save);
+        char *end;
+        if (field == NULL) {
+            return false;
+        }
+        long value = strtol(field, &end, 10);
+        if (*end != '\0' || value < 0 || value > CSIM_MAX_ASSOC) {
+            return false;
+        }
+        *fields[i] = (int)value;
+    }
+    while ((option = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+        if (!parse_option(option, level, &level->cycles)) {
+            return false;
+        }
+    }
+
+    bool first = (config->levels == 0);
+    if (first && level->cycles == 0) {
+        level->cycles = HIT_CYCLES;
+    }
+    if (level->E == 0 || level->s + level->b >= 64 || level->cycles == 0 ||
+        (first && level->inclusion != HIER_NINE) ||
+        (!first && level->b != config->level[0].b)) {
+        return false;
+    }
+    config->levels++;
+    return true;
+}
+
+/**
+ * @brief Read the description of a hierarchy from a file
+ *
+ * Each line describes one level, from the level closest to the CPU:
+ *
+ *     <name> <s> <E> <b> [policy=<p>] [inclusion=<i>] [cycles=<n>]
+ *
+ * where the inclusion is nine (the default), inclusive or exclusive, and
+ * cycles is the latency of a hit in the level, which defaults to
+ * HIT_CYCLES for the first level and must be given for the others. The
+ * first level cannot have an inclusion, and every level must have the
+ * block size of the first. A "memory cycles=<n>" line sets the latency of
+ * memory, MISS_CYCLES by default. Blank lines and lines starting with '#'
+ * are skipped.
+ *
+ * @param[out] config The hierarchy
+ *
+ * @return 0 on success, the number of the first invalid line, -1 if the
+ *         file could not be read, or -2 if it has no levels
+ */
+long hier_read_config(const char *filename, hier_config_t *config) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    memset(config, 0, sizeof(*config));
+    config->memory_cycles = MISS_CYCLES;
+    char line[256];
+    long lineno = 0;
+    long result = 0;
+    while (result == 0 && fgets(line, sizeof(line), file) != NULL) {
+        lineno++;
+        const char *p = line;
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (*p != '\0' && *p != '#' && !parse_line(line, config)) {
+            result = lineno;
+        }
+    }
+    fclose(file);
+    if (result == 0 && config->levels == 0) {
+        result = -2;
+    }
+    return result;
+}
+
+/**
+ * @brief Create an empty hierarchy
+ *
+ * @return The new hierarchy, or NULL if the parameters are invalid or
+ *         memory allocation failed
+ */
+hier_t *hier_create(const hier_config_t *config) {
+    if (config->levels <= 0 || config->levels > HIER_MAX_LEVELS) {
+        return NULL;
+    }
+    hier_t *hier = (hier_t *)calloc(1, sizeof(hier_t));
+    if (hier == NULL) {
+        return NULL;
+    }
+    hier->memory_cycles = config->memory_cycles;
+    hier->b = config->level[0].b;
+    hier->stats.levels = config->levels;
+    for (int i = 0; i < config->levels; i++) {
+        const hier_level_config_t *level = &config->level[i];
+        csim_config_t cache = {.s = level->s,
+                               .E = level->E,
+                               .b = level->b,
+                               .policy = level->policy};
+        if (level->b != hier->b) {
+            hier_destroy(hier);
+            return NULL;
+        }
+        hier->caches[i] = csim_create(&cache);
+        if (hier->caches[i] == NULL) {
+            hier_destroy(hier);
+            return NULL;
+        }
+        hier->levels++;
+        hier->inclusion[i] = (i > 0) ? level->inclusion : HIER_NINE;
+        hier->cycles[i] = level->cycles;
+    }
+    return hier;
+}
+
+/**
+ * @brief Free all memory used by a hierarchy
+ *
+ * @param[in] hier the hierarchy to free
+ */
+void hier_destroy(hier_t *hier) {
+    for (int i = 0; i < hier->levels; i++) {
+        csim_destroy(hier->caches[i]);
+    }
+    free(hier);
+}
+
+/**
+ * @brief Send a block evicted from a level to the level below
+ *
+ * An inclusive level first removes the block from every level above, and
+ * from their writeback buffers, taking their dirty bits with it. A dirty
+ * block is then written back below, and an exclusive level below takes
+ * even a clean one. Filling the block there may evict another in turn.
+ */
+static void hier_evict(hier_t *hier, int level, unsigned long addr,
+                       bool dirty) {
+    hier_level_stats_t *stats = &hier->stats.level[level];
+    if (hier->inclusion[level] == HIER_INCLUSIVE) {
+        unsigned long block = addr >> hier->b;
+        for (int above = 0; above < level; above++) {
+            bool copy_dirty;
+            if (csim_invalidate(hier->caches[above], addr, &copy_dirty)) {
+                stats->back_invalidations++;
+                dirty = dirty || copy_dirty;
+            } else if (hier->waiting[above] &&
+                       hier->pending[above].addr >> hier->b == block) {
+                hier->waiting[above] = false;
+                dirty = dirty || hier->pending[above].dirty;
+            }
+        }
+    }
+    if (dirty) {
+        stats->writebacks++;
+    }
+
+    int below = level + 1;
+    if (below == hier->levels) {
+        if (dirty) {
+            hier->stats.memory_writes++;
+        }
+        return;
+    }
+    if (dirty || hier->inclusion[below] == HIER_EXCLUSIVE) {
+        csim_eviction_t evicted;
+        if (csim_fill(hier->caches[below], addr, dirty, &evicted) ==
+            CSIM_MISS_EVICTION) {
+            hier_evict(hier, below, evicted.addr, evicted.dirty);
+        }
+    }
+}
+
+/**
+ * @brief Request a block from a level, or from memory below the last
+ *
+ * The first level is accessed with the access itself, and the others with
+ * a load of the block missing above. A block that misses is requested
+ * from the level below before the victim it replaced is sent down.
+ *
+ * @return Whether the block comes with a dirty bit, from an exclusive
+ *         level, that the level above must take over
+ */
+static bool hier_request(hier_t *hier, int level, const access_t *op) {
+    if (level == hier->levels) {
+        hier->stats.memory_reads++;
+        return false;
+    }
+    hier_level_stats_t *stats = &hier->stats.level[level];
+    csim_cache_t *cache = hier->caches[level];
+    access_t load = {.addr = op->addr, .size = op->size, .op = 'L'};
+
+    if (hier->inclusion[level] == HIER_EXCLUSIVE) {
+        bool dirty;
+        if (csim_invalidate(cache, op->addr, &dirty)) {
+            stats->hits++;
+            return dirty;
+        }
+        stats->misses++;
+        return hier_request(hier, level + 1, &load);
+    }
+
+    csim_eviction_t *victim = &hier->pending[level];
+    csim_result_t result = csim_access_evict(cache, op, victim);
+    if (result == CSIM_HIT) {
+        stats->hits++;
+        return false;
+    }
+    stats->misses++;
+    hier->waiting[level] = (result == CSIM_MISS_EVICTION);
+    if (hier_request(hier, level + 1, &load)) {
+        csim_fill(cache, op->addr, true, NULL);
+    }
+    if (hier->waiting[level]) {
+        hier->waiting[level] = false;
+        hier_evict(hier, level, victim->addr, victim->dirty);
+    }
+    return false;
+}
+
+/**
+ * @brief Simulate one access
+ *
+ * A modify ('M') counts as two accesses, a load and then a store that
+ * hits in the first level.
+ *
+ * @param[in] op The access; 'S' is a store, 'M' a modify, and anything
+ *               else a load
+ */
+void hier_access(hier_t *hier, const access_t *op) {
+    hier->stats.accesses += 1UL + (op->op == 'M');
+    hier->stats.level[0].hits += (op->op == 'M');
+    hier_request(hier, 0, op);
+}
+
+/**
+ * @brief Simulate a whole trace
+ *
+ * @return true on success, false if the trace is malformed
+ */
+bool hier_run(hier_t *hier, trace_t *trace) {
+    access_t *ops = hier->batch;
+    long n;
+    while ((n = trace_read(trace, ops, TRACE_BATCH)) > 0) {
+        for (long i = 0; i < n; i++) {
+            hier_access(hier, &ops[i]);
+        }
+    }
+    return n == 0;
+}
+
+/**
+ * @brief Copy the statistics of all accesses simulated so far
+ *
+ * @param[out] stats Requests found and passed on by each level, with its
+ *                   evictions and writebacks, the blocks read from and
+ *                   written to memory, and the total latency
+ */
+void hier_get_stats(const hier_t *hier, hier_stats_t *stats) {
+    *stats = hier->stats;
+    stats->cycles = stats->memory_reads * hier->memory_cycles;
+    for (int i = 0; i < hier->levels; i++) {
+        csim_stats_t cache;
+        csim_get_stats(hier->caches[i], &cache);
+        stats->level[i].evictions = cache.evictions;
+        stats->cycles += stats->level[i].hits * hier->cycles[i];
+    }
+}
@@ -0,0 +1,101 @@
+/**
+ * @file hier.h
+ * @brief Prototypes for multi-level cache hierarchy simulation
+ */
+
+#ifndef CSIM_HIER_H
+#define CSIM_HIER_H
+
+#include <stdbool.h>
+
+#include "libcsim.h"
+#include "trace.h"
+
+/** @brief Largest number of cache levels in a hierarchy */
+#define HIER_MAX_LEVELS 8
+
+/** @brief Size of a level name, including its terminating null */
+#define HIER_NAME_LEN 16
+
+/** @brief Size of a policy name, including its terminating null */
+#define HIER_POLICY_LEN 16
+
+/**
+ * @brief Which blocks of the levels above a level may hold
+ */
+typedef enum {
+    HIER_NINE,      /* any: neither inclusive nor exclusive */
+    HIER_INCLUSIVE, /* every block cached above, evicting them with it */
+    HIER_EXCLUSIVE, /* no block of the level above, but all its victims */
+} hier_inclusion_t;
+
+/**
+ * @brief Parameters of one level of a hierarchy
+ */
+typedef struct {
+    char name[HIER_NAME_LEN];     /* name in reports, such as "L2" */
+    int s;                        /* Number of set index bits */
+    int E;                        /* Associativity */
+    int b;                        /* Number of block bits */
+    char policy[HIER_POLICY_LEN]; /* replacement policy */
+    hier_inclusion_t inclusion;   /* relation to the levels above */
+    unsigned long cycles;         /* latency of a hit in this level */
+} hier_level_config_t;
+
+/**
+ * @brief Parameters of a hierarchy, from the level closest to the CPU
+ */
+typedef struct {
+    int levels;                                 /* number of levels */
+    hier_level_config_t level[HIER_MAX_LEVELS]; /* the levels, L1 first */
+    unsigned long memory_cycles;                /* latency of memory */
+} hier_config_t;
+
+/**
+ * @brief Statistics of one level of a hierarchy
+ *
+ * Hits and misses count the requests of the level above (or the accesses
+ * of the trace, for the first level) that the level found or passed on.
+ */
+typedef struct {
+    unsigned long hits;               /* requests found in the level */
+    unsigned long misses;             /* requests passed to the next level */
+    unsigned long evictions;          /* blocks evicted, clean or dirty */
+    unsigned long writebacks;         /* dirty blocks written further down */
+    unsigned long back_invalidations; /* copies removed above for inclusion */
+} hier_level_stats_t;
+
+/**
+ * @brief Statistics of a hierarchy
+ */
+typedef struct {
+    int levels;                                /* number of levels */
+    hier_level_stats_t level[HIER_MAX_LEVELS]; /* the levels, L1 first */
+    unsigned long accesses;                    /* accesses simulated */
+    unsigned long memory_reads;                /* blocks read from memory */
+    unsigned long memory_writes;               /* blocks written to memory */
+    unsigned long cycles;                      /* latency of all accesses */
+} hier_stats_t;
+
+/** @brief Opaque hierarchy simulator */
+typedef struct hier hier_t;
+
+/** @brief Read a hierarchy file; 0 on success, else a bad line or below 0 */
+long hier_read_config(const char *filename, hier_config_t *config);
+
+/** @brief Create an empty hierarchy; NULL if invalid or out of memory */
+hier_t *hier_create(const hier_config_t *config);
+
+/** @brief Free all memory used by a hierarchy */
+void hier_destroy(hier_t *hier);
+
+/** @brief Simulate one access */
+void hier_access(hier_t *hier, const access_t *op);
+
+/** @brief Simulate a whole trace; returns false on a trace error */
+bool hier_run(hier_t *hier, trace_t *trace);
+
+/** @brief Copy the statistics of all accesses simulated so far */
+void hier_get_stats(const hier_t *hier, hier_stats_t *stats);
+
+#endif /* CSIM_HIER_H */
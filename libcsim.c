@@ -0,0 +1,2300 @@
+/**
+ * @file libcsim.c
+ * @brief A reentrant cache simulator library
+ *
+ * This library simulates the behavior of a cache memory with arbitrary size
+ * and associativity. All simulation state, including the statistics, lives
+ * in the csim_cache_t, so independent caches never share memory.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_AVX2_KERNELS 1
+#endif
+
+#include "blockmap.h"
+#include "libcsim.h"
+#include "tagmatch.h"
+
+/* Full products of two 64-bit numbers, for modulo by a reciprocal */
+__extension__ typedef unsigned __int128 u128_t;
+
+/** @brief Smallest associativity at which sets are searched by hash map */
+#define MAP_MIN_ASSOC 32
+
+#if MAP_MIN_ASSOC > TAGMATCH_MAX_WAYS
+#error "Sets searched by tag match kernels must fit in one bitmap word"
+#endif
+
+/** @brief Alignment of each array in the cache arena (a host cache line) */
+#define ARENA_ALIGN 64
+
+/** @brief Accesses whose sets csim_access_batch() computes at a time */
+#define BATCH_CHUNK 256
+
+/** @brief How many accesses ahead csim_access_batch() prefetches a set */
+#define PREFETCH_DISTANCE 16
+
+/** @brief Smallest cache arena, in bytes, whose sets are prefetched */
+#define PREFETCH_MIN_BYTES (32UL << 20)
+
+/** @brief Size of a transparent huge page on the host */
+#define HUGE_PAGE_BYTES (2UL << 20)
+
+/** @brief Way index within a set; holds any way below CSIM_MAX_ASSOC */
+typedef uint16_t way_t;
+
+/**
+ * @brief Per-set replacement state
+ *
+ * Under LRU, the valid lines of a set form a doubly linked recency list,
+ * so that promoting a line on a hit and finding the LRU victim are O(1).
+ * Under FIFO, lru is the oldest line instead, and mru is unused; under
+ * BRRIP and DRRIP, mru counts insertions modulo BRRIP_EPSILON. Lines
+ * are filled in way order, so the valid lines are ways 0 to count - 1,
+ * until csim_invalidate() first leaves a hole in the cache; from then on
+ * fills take the lowest invalid way of their set. Either way the list is
+ * empty exactly when count is zero, and an all-zero set_meta_t is an empty
+ * set.
+ */
+typedef struct {
+    way_t mru;   /* most recently used way */
+    way_t lru;   /* least recently used (or, for FIFO, oldest) way */
+    way_t count; /* number of valid lines */
+} set_meta_t;
+
+/**
+ * @brief Doubly linked list of ways, ghost slots or buckets of a set
+ *
+ * The links live in prev and next arrays indexed like the list's entries.
+ * head and tail are only meaningful while size is nonzero, so an all-zero
+ * list is empty.
+ */
+typedef struct {
+    way_t head; /* oldest entry, the first to be removed */
+    way_t tail; /* newest entry */
+    way_t size; /* number of entries */
+} way_list_t;
+
+/** @brief Lists of an ARC set, and the only two lists of an LFU set */
+enum { ARC_T1, ARC_T2, ARC_B1, ARC_B2 };
+enum { LFU_BUCKETS, LFU_GHOSTS };
+
+/**
+ * @brief Per-set lists of the ARC and LFU policies
+ *
+ * ARC keeps the lines of a set in T1 (blocks seen once recently) or T2
+ * (blocks seen at least twice), and remembers the blocks it evicted from
+ * them in the ghost lists B1 and B2. LFU keeps its lines in buckets of
+ * equal frequency, lowest first, and remembers the blocks it evicted in a
+ * single ghost list. Ghost slots and buckets are taken from a spare list
+ * of released ones, or else are the first never used.
+ */
+typedef struct {
+    way_list_t lists[4];      /* ARC_* or LFU_* lists */
+    way_list_t spare_ghosts;  /* released ghost slots */
+    way_list_t spare_buckets; /* released LFU buckets */
+    way_t used_ghosts;        /* ghost slots ever used */
+    way_t used_buckets;       /* LFU buckets ever used */
+    way_t target;             /* ARC's target size of T1 */
+    unsigned long ticks;      /* LFU accesses since counts were last aged */
+} list_set_t;
+
+/**
+ * @brief Replacement policies
+ *
+ * Policies other than LRU and FIFO keep their per-set state in a bitmap of
+ * PW words per set, which is a single word for up to 64 ways:
+ *
+ * - random: the state of a xorshift generator, so that the victims chosen
+ *   in a set depend only on the accesses to that set
+ * - plru: the E - 1 direction bits of a binary tree over the ways (over
+ *   the next power of two ways, if E is not one)
+ * - bitplru: one MRU bit per way, all but one cleared when all are set
+ * - nru: one referenced bit per way, all cleared when no victim is left
+ * - srrip, brrip, drrip: a 2-bit re-reference prediction value (RRPV) per
+ *   way, so one word holds 32 ways
+ *
+ * ARC and LFU keep linked lists of lines, of blocks recently evicted and
+ * (for LFU) of frequency buckets instead; see list_set_t.
+ *
+ * DRRIP is the only policy with state shared by all sets: set dueling
+ * between SRRIP and BRRIP leader sets, through a policy selector (PSEL).
+ */
+typedef enum {
+    POLICY_LRU,
+    POLICY_FIFO,
+    POLICY_RANDOM,
+    POLICY_PLRU,
+    POLICY_BITPLRU,
+    POLICY_NRU,
+    POLICY_SRRIP,
+    POLICY_BRRIP,
+    POLICY_DRRIP,
+    POLICY_ARC,
+    POLICY_LFU,
+} policy_t;
+
+/** @brief Name of each policy, as passed in csim_config_t */
+static const char *const POLICY_NAMES[] = {
+    [POLICY_LRU] = "lru",         [POLICY_FIFO] = "fifo",
+    [POLICY_RANDOM] = "random",   [POLICY_PLRU] = "plru",
+    [POLICY_BITPLRU] = "bitplru", [POLICY_NRU] = "nru",
+    [POLICY_SRRIP] = "srrip",     [POLICY_BRRIP] = "brrip",
+    [POLICY_DRRIP] = "drrip",     [POLICY_ARC] = "arc",
+    [POLICY_LFU] = "lfu",
+};
+
+/** @brief Number of replacement policies */
+#define POLICY_COUNT (sizeof(POLICY_NAMES) / sizeof(POLICY_NAMES[0]))
+
+/** @brief State of the random policy's generator in a set never evicted */
+#define RANDOM_SEED 0x9e3779b97f4a7c15UL
+
+/** @brief RRPV of a line predicted to be re-referenced in the distant future */
+#define RRPV_MAX 3
+
+/** @brief One in this many BRRIP insertions predicts a long re-reference */
+#define BRRIP_EPSILON 32
+
+/** @brief Largest number of leader sets per DRRIP team */
+#define DUEL_LEADERS 32
+
+/** @brief Largest value of the saturating DRRIP policy selector */
+#define PSEL_MAX 1023
+
+/** @brief LFU halves the counts of a set every this many accesses per way */
+#define LFU_AGE_PERIOD 16
+
+/**
+ * @brief A simulation kernel: simulate one access to a block in a set
+ */
+typedef csim_result_t (*sim_kernel_fn)(csim_cache_t *cache,
+                                       unsigned long set_index,
+                                       unsigned long block, bool store);
+
+/**
+ * @brief Cache structure with parameters
+ *
+ * Line state is kept as a structure of arrays carved out of one zeroed
+ * allocation, indexed by set * E + way. The tag array holds the full block
+ * address (address >> b) of each line rather than just its tag: it compares
+ * the same within a set, and lets evictions recover the victim's address.
+ * Valid and dirty bits are bitmaps with W words per set. Arrays a policy
+ * does not use, such as the list links outside LRU, ARC and LFU, are empty.
+ *
+ * Sets are searched with a vector kernel that compares every way at once
+ * and masks the result with the valid bitmap. Highly associative caches
+ * instead index their valid lines by block address, so that a lookup does
+ * not have to compare against every way of a set.
+ */
+struct csim_cache {
+    int s;                     /* Number of set index bits */
+    int E;                     /* Associativity (number of lines per set) */
+    int b;                     /* Number of block bits */
+    size_t W;                  /* bitmap words per set */
+    unsigned long *blocks;     /* block address of each line */
+    way_t *prev;               /* previous way in its list (LRU, ARC, LFU) */
+    way_t *next;               /* next way in its list (LRU, ARC, LFU) */
+    set_meta_t *meta;          /* replacement state of each set */
+    list_set_t *lists;         /* ARC and LFU lists of each set */
+    way_t *owner;              /* ARC list or LFU bucket of each line */
+    unsigned long *ghost;      /* block of each ghost slot, E per set */
+    way_t *ghost_prev;         /* previous slot in its ghost list */
+    way_t *ghost_next;         /* next slot in its ghost list */
+    unsigned long *freq;       /* access count of each LFU bucket, E per set */
+    way_t *bucket_prev;        /* next lower frequency bucket */
+    way_t *bucket_next;        /* next higher frequency bucket */
+    way_list_t *bucket;        /* lines of each LFU bucket, oldest first */
+    blockmap_t ghost_map;      /* block -> list << 16 | slot of every ghost */
+    int arc_source;            /* ARC_B1 or ARC_B2 on a ghost hit, else T1 */
+    bool arc_discard;          /* whether ARC's next victim leaves no ghost */
+    bool holes;                /* whether a line was ever invalidated */
+    unsigned long victim;      /* block evicted by the last eviction */
+    bool victim_dirty;         /* whether that block was dirty */
+    csim_ghost_stats_t ghosts; /* hits in the ghost lists */
+    policy_t policy;           /* replacement policy */
+    size_t PW;                 /* policy state words per set */
+    uint64_t *pbits;           /* policy state, PW words per set */
+    unsigned long duel_mask;   /* leader set spacing - 1, 0 if not dueling */
+    csim_duel_stats_t duel;    /* leader set statistics and PSEL */
+    uint64_t *valid;           /* valid bitmap, W words per set */
+    uint64_t *dirty;           /* dirty bitmap, W words per set */
+    void *arena;               /* the allocation backing all of the above */
+    tag_match_fn match;        /* kernel searching a set's blocks */
+    bool use_map;              /* whether lines are found through map */
+    blockmap_t map;            /* block address -> way of every valid line */
+    sim_kernel_fn kernel;      /* kernel simulating one access */
+    bool prefetch;             /* whether batches prefetch upcoming sets */
+    const char *kernel_name;   /* name of kernel, for csim_kernel_name() */
+    csim_stats_t stats;        /* statistics of the accesses so far */
+    bool write_through;        /* whether stores write memory too */
+    bool no_write_allocate;    /* whether store misses bypass the cache */
+    bool writes_slow;          /* whether accesses go through sim_write() */
+    bool split;                /* whether accesses span several blocks */
+    bool slow;                 /* whether accesses go through sim_slow() */
+    unsigned long *wcb_blocks; /* block of each write-combining entry */
+    uint64_t *wcb_chunks;      /* chunks written in each entry */
+    size_t wcb_entries;        /* entries of the buffer, 0 if none */
+    size_t wcb_count;          /* entries in use */
+    size_t wcb_oldest;         /* entry to flush first */
+    csim_write_stats_t writes; /* writes to memory, if writes_slow */
+    unsigned long sets;        /* number of sets */
+    csim_index_t index;        /* function mapping blocks to sets */
+    bool hashed;               /* whether sets are not the low s bits */
+    unsigned long recip;       /* floor((2^64 - 1) / sets), for modulo */
+};
+
+static void sim_select_kernel(csim_cache_t *cache, bool generic);
+
+/**
+ * @brief Reserve an aligned array in the cache arena
+ *
+ * @param[in,out] offset Running size of the arena, advanced past the array
+ * @param[in]     bytes  Size of the array
+ *
+ * @return Offset of the array from the (aligned) start of the arena
+ */
+static size_t arena_reserve(size_t *offset, size_t bytes) {
+    size_t start = (*offset + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    *offset = start + bytes;
+    return start;
+}
+
+/**
+ * @brief Ask for the pages of an arena to be backed by huge pages
+ *
+ * The sets of a large cache are touched in random order, so with small
+ * pages nearly every access also misses the host's TLB. This is only a
+ * hint, and it does nothing on hosts without transparent huge pages.
+ *
+ * @param[in] base Aligned start of the arena
+ * @param[in] size Size of the arena in bytes
+ */
+static void arena_advise_huge(uintptr_t base, size_t size) {
+#ifdef MADV_HUGEPAGE
+    uintptr_t start = (base + HUGE_PAGE_BYTES - 1) &
+                      ~(uintptr_t)(HUGE_PAGE_BYTES - 1);
+    uintptr_t end = (base + size) & ~(uintptr_t)(HUGE_PAGE_BYTES - 1);
+    if (end > start) {
+        madvise((void *)start, end - start, MADV_HUGEPAGE);
+    }
+#else
+    (void)base;
+    (void)size;
+#endif
+}
+
+/**
+ * @brief Find a replacement policy by name
+ *
+ * @param[in] name Name of the policy, or NULL for LRU
+ *
+ * @return The index of the policy, or -1 if there is none by that name
+ */
+static int policy_find(const char *name) {
+    if (name == NULL) {
+        return POLICY_LRU;
+    }
+    for (size_t i = 0; i < POLICY_COUNT; i++) {
+        if (strcmp(POLICY_NAMES[i], name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Number of policy state words per set
+ */
+static size_t policy_words(policy_t policy, int E) {
+    size_t leaves = 1;
+    switch (policy) {
+    case POLICY_RANDOM:
+        return 1;
+    case POLICY_PLRU:
+        while (leaves < (size_t)E) {
+            leaves *= 2;
+        }
+        return (leaves + 62) / 64;
+    case POLICY_BITPLRU:
+    case POLICY_NRU:
+        return ((size_t)E + 63) / 64;
+    case POLICY_SRRIP:
+    case POLICY_BRRIP:
+    case POLICY_DRRIP:
+        return ((size_t)E + 31) / 32;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Set up set dueling between SRRIP and BRRIP leader sets
+ *
+ * Up to DUEL_LEADERS sets per team lead, evenly spread: with leaders
+ * every k sets, set i leads for SRRIP if i mod k is 0 and for BRRIP if it
+ * is k / 2. Each team gets at most S / 4 sets, so k is at least 4 and at
+ * least half the sets follow PSEL. If S / leaders is not a power of two,
+ * k is rounded down to a power of two, and a few more sets lead. A cache
+ * with fewer than 4 sets has no leaders, and its followers stay with
+ * SRRIP.
+ */
+static void duel_init(csim_cache_t *cache) {
+    unsigned long S = cache->sets;
+    unsigned long leaders = (S / 4 < DUEL_LEADERS) ? S / 4 : DUEL_LEADERS;
+    cache->duel.policy[0] = POLICY_NAMES[POLICY_SRRIP];
+    cache->duel.policy[1] = POLICY_NAMES[POLICY_BRRIP];
+    cache->duel.psel = PSEL_MAX / 2;
+    cache->duel.psel_max = PSEL_MAX;
+    if (leaders > 0) {
+        unsigned long k = 1;
+        while (k * 2 <= S / leaders) {
+            k *= 2;
+        }
+        cache->duel_mask = k - 1;
+        cache->duel.sets[0] = (S + k - 1) / k;
+        cache->duel.sets[1] = (S + k / 2 - 1) / k;
+    }
+}
+
+/**
+ * @brief Whether a replacement policy exists
+ *
+ * @param[in] name Name of the policy, or NULL for LRU
+ */
+bool csim_policy_exists(const char *name) {
+    return policy_find(name) >= 0;
+}
+
+/**
+ * @brief Whether the sets of a policy are simulated independently
+ *
+ * Only then can the sets of a cache be split between several caches, as
+ * psim does, without changing the results.
+ *
+ * @param[in] name Name of an existing policy, or NULL for LRU
+ */
+bool csim_policy_per_set(const char *name) {
+    return policy_find(name) != POLICY_DRRIP;
+}
+
+/**
+ * @brief Look up a set index function by name
+ *
+ * @return true if name is one of CSIM_INDEX_FUNCTIONS, false otherwise
+ */
+bool csim_index_parse(const char *name, csim_index_t *index) {
+    static const char *const NAMES[] = {
+        [CSIM_INDEX_MODULO] = "modulo",
+        [CSIM_INDEX_XOR] = "xor",
+        [CSIM_INDEX_PRIME] = "prime",
+        [CSIM_INDEX_SKEW] = "skew",
+    };
+    for (size_t i = 0; i < sizeof(NAMES) / sizeof(NAMES[0]); i++) {
+        if (strcmp(name, NAMES[i]) == 0) {
+            *index = (csim_index_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Number of bits needed to number n sets
+ */
+static int index_bits(unsigned long n) {
+    int bits = 0;
+    while (bits < 63 && (1UL << bits) < n) {
+        bits++;
+    }
+    return bits;
+}
+
+/**
+ * @brief Whether a number is prime, by trial division
+ */
+static bool is_prime(unsigned long n) {
+    if (n < 2) {
+        return false;
+    }
+    for (unsigned long d = 2; d * d <= n; d++) {
+        if (n % d == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Number of sets a configuration gives
+ *
+ * This is sets, or 2^s if sets is 0, lowered to the largest prime not
+ * above it for CSIM_INDEX_PRIME; a single set stays one. Any count other
+ * than 2^s with modulo indexing is limited to CSIM_MAX_SETS.
+ *
+ * @return The number of sets, or 0 if s, sets or b is out of range
+ */
+unsigned long csim_config_sets(const csim_config_t *config) {
+    unsigned long S = config->sets;
+    if (S == 0) {
+        if (config->s < 0 || config->s >= 64) {
+            return 0;
+        }
+        S = 1UL << config->s;
+    }
+    if (config->b < 0 || index_bits(S) + config->b >= 64 ||
+        ((config->sets != 0 || config->index != CSIM_INDEX_MODULO) &&
+         S > CSIM_MAX_SETS)) {
+        return 0;
+    }
+    if (config->index == CSIM_INDEX_PRIME) {
+        while (S > 2 && !is_prime(S)) {
+            S--;
+        }
+    }
+    return S;
+}
+
+/**
+ * @brief Whether a policy keeps statistics beyond hits and misses
+ *
+ * These policies must be updated even in a direct-mapped cache, where
+ * there is no replacement choice to make.
+ */
+static inline bool policy_keeps_stats(policy_t policy) {
+    return policy == POLICY_DRRIP || policy == POLICY_ARC ||
+           policy == POLICY_LFU;
+}
+
+/**
+ * @brief Find a set lookup kernel by name
+ *
+ * @param[in] name Name of the kernel, or NULL for the fastest one
+ *
+ * @return The kernel, or NULL if the host does not support it
+ */
+static tag_match_fn lookup_kernel(const char *name) {
+    if (name == NULL) {
+        return tagmatch_best()->match;
+    }
+    const tag_matcher_t *matchers;
+    int count = tagmatch_available(&matchers);
+    for (int i = 0; i < count; i++) {
+        if (strcmp(matchers[i].name, name) == 0) {
+            return matchers[i].match;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Create a new, empty cache
+ *
+ * All line and set state lives in a single calloc'd arena. Zero is the
+ * empty state of every array, so the arena needs no further setup and
+ * large caches are only backed by memory once their sets are touched.
+ *
+ * @param[in] config Parameters of the cache
+ *
+ * @return The new cache, or NULL if the parameters are invalid or memory
+ *         allocation failed
+ */
+csim_cache_t *csim_create(const csim_config_t *config) {
+    unsigned long sets = csim_config_sets(config);
+    int s = index_bits(sets);
+    int E = config->E;
+    int b = config->b;
+    if (sets == 0 || config->index == CSIM_INDEX_SKEW || E <= 0 ||
+        E > CSIM_MAX_ASSOC || config->write_buffer < 0 ||
+        config->write_buffer > CSIM_MAX_WRITE_BUFFER) {
+        return NULL;
+    }
+    tag_match_fn match = lookup_kernel(config->lookup);
+    int policy = policy_find(config->policy);
+    if (match == NULL || policy < 0) {
+        return NULL;
+    }
+
+    csim_cache_t *cache = (csim_cache_t *)calloc(1, sizeof(csim_cache_t));
+    if (cache == NULL) {
+        return NULL;
+    }
+    cache->s = s;
+    cache->E = E;
+    cache->b = b;
+    cache->W = ((size_t)E + 63) / 64;
+    cache->policy = (policy_t)policy;
+    cache->PW = policy_words(cache->policy, E);
+
+    size_t S = (size_t)sets;
+    size_t lines = S * (size_t)E;
+    bool listed = (cache->policy == POLICY_ARC || cache->policy == POLICY_LFU);
+    size_t links = (cache->policy == POLICY_LRU || listed) ? lines : 0;
+    size_t ghosts = listed ? lines : 0;
+    size_t buckets = (cache->policy == POLICY_LFU) ? lines : 0;
+    size_t size = 0;
+    size_t blocks_at = arena_reserve(
+        &size, (lines + TAGMATCH_OVERREAD) * sizeof(unsigned long));
+    size_t prev_at = arena_reserve(&size, links * sizeof(way_t));
+    size_t next_at = arena_reserve(&size, links * sizeof(way_t));
+    size_t meta_at = arena_reserve(&size, S * sizeof(set_meta_t));
+    size_t lists_at =
+        arena_reserve(&size, (listed ? S : 0) * sizeof(list_set_t));
+    size_t owner_at = arena_reserve(&size, ghosts * sizeof(way_t));
+    size_t ghost_at = arena_reserve(&size, ghosts * sizeof(unsigned long));
+    size_t ghost_prev_at = arena_reserve(&size, ghosts * sizeof(way_t));
+    size_t ghost_next_at = arena_reserve(&size, ghosts * sizeof(way_t));
+    size_t freq_at = arena_reserve(&size, buckets * sizeof(unsigned long));
+    size_t bucket_prev_at = arena_reserve(&size, buckets * sizeof(way_t));
+    size_t bucket_next_at = arena_reserve(&size, buckets * sizeof(way_t));
+    size_t bucket_at = arena_reserve(&size, buckets * sizeof(way_list_t));
+    size_t valid_at = arena_reserve(&size, S * cache->W * sizeof(uint64_t));
+    size_t dirty_at = arena_reserve(&size, S * cache->W * sizeof(uint64_t));
+    size_t pbits_at = arena_reserve(&size, S * cache->PW * sizeof(uint64_t));
+    cache->wcb_entries = (size_t)config->write_buffer;
+    size_t wcb_blocks_at =
+        arena_reserve(&size, cache->wcb_entries * sizeof(unsigned long));
+    size_t wcb_chunks_at =
+        arena_reserve(&size, cache->wcb_entries * sizeof(uint64_t));
+
+    cache->arena = calloc(1, size + ARENA_ALIGN);
+    if (cache->arena == NULL) {
+        free(cache);
+        return NULL;
+    }
+    uintptr_t base = ((uintptr_t)cache->arena + ARENA_ALIGN - 1) &
+                     ~(uintptr_t)(ARENA_ALIGN - 1);
+    cache->blocks = (unsigned long *)(base + blocks_at);
+    cache->prev = (way_t *)(base + prev_at);
+    cache->next = (way_t *)(base + next_at);
+    cache->meta = (set_meta_t *)(base + meta_at);
+    cache->lists = (list_set_t *)(base + lists_at);
+    cache->owner = (way_t *)(base + owner_at);
+    cache->ghost = (unsigned long *)(base + ghost_at);
+    cache->ghost_prev = (way_t *)(base + ghost_prev_at);
+    cache->ghost_next = (way_t *)(base + ghost_next_at);
+    cache->freq = (unsigned long *)(base + freq_at);
+    cache->bucket_prev = (way_t *)(base + bucket_prev_at);
+    cache->bucket_next = (way_t *)(base + bucket_next_at);
+    cache->bucket = (way_list_t *)(base + bucket_at);
+    cache->valid = (uint64_t *)(base + valid_at);
+    cache->dirty = (uint64_t *)(base + dirty_at);
+    cache->pbits = (uint64_t *)(base + pbits_at);
+    cache->wcb_blocks = (unsigned long *)(base + wcb_blocks_at);
+    cache->wcb_chunks = (uint64_t *)(base + wcb_chunks_at);
+    cache->write_through = config->write_through;
+    cache->no_write_allocate = config->no_write_allocate;
+    cache->writes_slow = config->write_through || config->no_write_allocate ||
+                         cache->wcb_entries > 0;
+    cache->split = config->split;
+    cache->slow = cache->writes_slow || cache->split;
+    cache->sets = sets;
+    cache->index = config->index;
+    cache->hashed = sets > 1 && (config->index != CSIM_INDEX_MODULO ||
+                                 (sets & (sets - 1)) != 0);
+    cache->recip = ~0UL / sets;
+    if (cache->policy == POLICY_DRRIP) {
+        duel_init(cache);
+    }
+
+    cache->prefetch = (size >= PREFETCH_MIN_BYTES);
+    if (cache->prefetch) {
+        arena_advise_huge(base, size);
+    }
+    cache->match = match;
+    sim_select_kernel(cache, config->generic);
+    cache->use_map = (E >= MAP_MIN_ASSOC);
+    if (cache->use_map && !blockmap_init(&cache->map, 0)) {
+        free(cache->arena);
+        free(cache);
+        return NULL;
+    }
+    if (listed && !blockmap_init(&cache->ghost_map, 0)) {
+        if (cache->use_map) {
+            blockmap_destroy(&cache->map);
+        }
+        free(cache->arena);
+        free(cache);
+        return NULL;
+    }
+    if (listed) {
+        cache->ghosts.lists = (cache->policy == POLICY_ARC) ? 2 : 1;
+    }
+    return cache;
+}
+
+/**
+ * @brief Free all memory used by a cache
+ *
+ * @param[in] cache the cache to free
+ */
+void csim_destroy(csim_cache_t *cache) {
+    if (cache->use_map) {
+        blockmap_destroy(&cache->map);
+    }
+    if (cache->policy == POLICY_ARC || cache->policy == POLICY_LFU) {
+        blockmap_destroy(&cache->ghost_map);
+    }
+    free(cache->arena);
+    free(cache);
+}
+
+/**
+ * @brief Test a bit in a per-set bitmap
+ */
+static inline bool bit_test(const uint64_t *bitmap, size_t word, int way) {
+    return (bitmap[word + (size_t)way / 64] >> (way % 64)) & 1;
+}
+
+/**
+ * @brief Set a bit in a per-set bitmap
+ */
+static inline void bit_set(uint64_t *bitmap, size_t word, int way) {
+    bitmap[word + (size_t)way / 64] |= 1UL << (way % 64);
+}
+
+/**
+ * @brief Clear a bit in a per-set bitmap
+ */
+static inline void bit_clear(uint64_t *bitmap, size_t word, int way) {
+    bitmap[word + (size_t)way / 64] &= ~(1UL << (way % 64));
+}
+
+/**
+ * @brief Unlink a way from the recency list of its set
+ *
+ * @param[in] line Index of the set's way 0 in the line arrays
+ */
+static inline void lru_unlink(csim_cache_t *cache, set_meta_t *meta,
+                              size_t line, way_t way) {
+    way_t prev = cache->prev[line + way];
+    way_t next = cache->next[line + way];
+    if (way == meta->mru) {
+        meta->mru = next;
+    } else {
+        cache->next[line + prev] = next;
+    }
+    if (way == meta->lru) {
+        meta->lru = prev;
+    } else {
+        cache->prev[line + next] = prev;
+    }
+}
+
+/**
+ * @brief Insert a way at the most recently used end of its set's list
+ *
+ * @param[in] empty Whether the list is currently empty
+ */
+static inline void lru_push(csim_cache_t *cache, set_meta_t *meta, size_t line,
+                            way_t way, bool empty) {
+    if (empty) {
+        meta->lru = way;
+    } else {
+        cache->next[line + way] = meta->mru;
+        cache->prev[line + meta->mru] = way;
+    }
+    meta->mru = way;
+}
+
+/**
+ * @brief Mark a way as the most recently used line of its set
+ */
+static inline void lru_touch(csim_cache_t *cache, set_meta_t *meta,
+                             size_t line, way_t way) {
+    if (meta->mru != way) {
+        lru_unlink(cache, meta, line, way);
+        lru_push(cache, meta, line, way, false);
+    }
+}
+
+/**
+ * @brief First policy state word of a set
+ *
+ * Every policy keeps at most one word per set up to 32 ways, so kernels
+ * with a constant E fold this to the set index.
+ */
+static inline uint64_t *policy_state(csim_cache_t *cache, int E,
+                                     unsigned long set_index) {
+    return &cache->pbits[(E <= 32) ? set_index : set_index * cache->PW];
+}
+
+/**
+ * @brief Number of leaves of the tree-PLRU tree of an E-way set
+ */
+static inline int plru_leaves(int E) {
+    return (E <= 1) ? 1 : 1 << (32 - __builtin_clz((unsigned)E - 1));
+}
+
+/**
+ * @brief Point every node on the path to a way of a tree-PLRU set away
+ *        from it
+ *
+ * With P leaves, node n (from 1, in heap order) has direction bit n - 1,
+ * and way w is leaf P + w. A set bit points the victim search to the right
+ * subtree. Up to 64 ways, the whole tree is updated in one register.
+ */
+static inline void plru_touch(uint64_t *bits, int E, int way) {
+    int node = plru_leaves(E) + way;
+    if (E <= 64) {
+        uint64_t tree = bits[0];
+        for (; node > 1; node /= 2) {
+            uint64_t bit = 1UL << (node / 2 - 1);
+            tree = (node & 1) ? (tree & ~bit) : (tree | bit);
+        }
+        bits[0] = tree;
+        return;
+    }
+    for (; node > 1; node /= 2) {
+        if (node & 1) {
+            bit_clear(bits, 0, node / 2 - 1);
+        } else {
+            bit_set(bits, 0, node / 2 - 1);
+        }
+    }
+}
+
+/**
+ * @brief Follow the direction bits of a tree-PLRU set to its victim
+ *
+ * Subtrees holding only ways past E are never entered.
+ */
+static inline way_t plru_victim(const uint64_t *bits, int E) {
+    int leaves = plru_leaves(E);
+    int node = 1;
+    int way = 0;
+    for (int half = leaves / 2; half >= 1; half /= 2) {
+        int right = bit_test(bits, 0, node - 1);
+        if (E != leaves && way + half >= E) {
+            right = 0;
+        }
+        way += right ? half : 0;
+        node = 2 * node + right;
+    }
+    return (way_t)way;
+}
+
+/**
+ * @brief Lowest way of a set whose bit is clear
+ *
+ * @return The way, or -1 if the bits of all E ways are set
+ */
+static inline int bits_first_clear(const uint64_t *bits, int E) {
+    for (int i = 0; i * 64 < E; i++) {
+        uint64_t clear = ~bits[i];
+        if (E - i * 64 < 64) {
+            clear &= (1UL << (E - i * 64)) - 1;
+        }
+        if (clear != 0) {
+            return i * 64 + __builtin_ctzll(clear);
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Set the MRU bit of a way; if that sets them all, clear the others
+ */
+static inline void bitplru_touch(uint64_t *bits, int E, int way) {
+    bit_set(bits, 0, way);
+    if (bits_first_clear(bits, E) < 0) {
+        memset(bits, 0, (((size_t)E + 63) / 64) * sizeof(uint64_t));
+        bit_set(bits, 0, way);
+    }
+}
+
+/**
+ * @brief Next victim of a random set, from its xorshift generator
+ */
+static inline way_t random_victim(uint64_t *bits, int E) {
+    uint64_t x = (bits[0] != 0) ? bits[0] : RANDOM_SEED;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    bits[0] = x;
+    return (way_t)(x % (uint64_t)E);
+}
+
+/**
+ * @brief Set the RRPV of a way
+ */
+static inline void rrpv_set(uint64_t *bits, int way, uint64_t rrpv) {
+    int shift = 2 * (way % 32);
+    uint64_t *word = &bits[way / 32];
+    *word = (*word & ~(3UL << shift)) | (rrpv << shift);
+}
+
+/**
+ * @brief Mask of the RRPV fields of the ways of a set in one of its words
+ */
+static inline uint64_t rrpv_mask(int E, int i) {
+    return (E - i * 32 >= 32) ? ~0UL : (1UL << (2 * (E - i * 32))) - 1;
+}
+
+/**
+ * @brief Find the first way of an RRIP set with RRPV_MAX, aging the set
+ *        until there is one
+ *
+ * Aging adds the same amount to every RRPV, just enough for the largest to
+ * reach RRPV_MAX, which is the same as incrementing them all one at a time.
+ */
+static inline way_t rrip_victim(uint64_t *bits, int E) {
+    const uint64_t lows = 0x5555555555555555UL;
+    uint64_t oldest = 0;
+    for (int i = 0; i * 32 < E; i++) {
+        uint64_t rrpvs = bits[i] & rrpv_mask(E, i);
+        uint64_t distant = rrpvs & (rrpvs >> 1) & lows;
+        if (distant != 0) {
+            return (way_t)(i * 32 + __builtin_ctzll(distant) / 2);
+        }
+        if ((rrpvs >> 1) & lows) {
+            oldest = 2;
+        } else if ((rrpvs & lows) && oldest == 0) {
+            oldest = 1;
+        }
+    }
+    for (int i = 0; i * 32 < E; i++) {
+        bits[i] += (RRPV_MAX - oldest) * (lows & rrpv_mask(E, i));
+    }
+    return rrip_victim(bits, E);
+}
+
+/**
+ * @brief RRPV of a block inserted by BRRIP in a set
+ *
+ * Most blocks are predicted to be re-referenced in the distant future, and
+ * one in BRRIP_EPSILON in the long one, as by SRRIP. A per-set counter
+ * picks them, so that results do not depend on other sets.
+ */
+static inline uint64_t brrip_insertion(set_meta_t *meta) {
+    meta->mru = (meta->mru + 1 == BRRIP_EPSILON) ? 0 : (way_t)(meta->mru + 1);
+    return (meta->mru == 0) ? RRPV_MAX - 1 : RRPV_MAX;
+}
+
+/**
+ * @brief Team of a DRRIP set: 0 for SRRIP leaders, 1 for BRRIP leaders, and
+ *        -1 for followers
+ */
+static inline int duel_team(const csim_cache_t *cache,
+                            unsigned long set_index) {
+    unsigned long offset = set_index & cache->duel_mask;
+    if (cache->duel_mask == 0) {
+        return -1;
+    }
+    if (offset == 0) {
+        return 0;
+    }
+    return (offset == (cache->duel_mask + 1) / 2) ? 1 : -1;
+}
+
+/**
+ * @brief RRPV of a block inserted by DRRIP in a set, after a miss
+ *
+ * Misses in leader sets move PSEL towards the other team's policy, and
+ * followers use BRRIP once PSEL is in its upper half.
+ */
+static inline uint64_t drrip_insertion(csim_cache_t *cache,
+                                       unsigned long set_index) {
+    csim_duel_stats_t *duel = &cache->duel;
+    int team = duel_team(cache, set_index);
+    if (team >= 0) {
+        duel->misses[team]++;
+        if (team == 0 && duel->psel < PSEL_MAX) {
+            duel->psel++;
+        } else if (team == 1 && duel->psel > 0) {
+            duel->psel--;
+        }
+    } else {
+        team = (duel->psel > PSEL_MAX / 2) ? 1 : 0;
+    }
+    return (team == 0) ? RRPV_MAX - 1
+                       : brrip_insertion(&cache->meta[set_index]);
+}
+
+/**
+ * @brief Append an entry to the tail of a list
+ */
+static inline void list_append(way_list_t *list, way_t *prev, way_t *next,
+                               way_t x) {
+    if (list->size == 0) {
+        list->head = x;
+    } else {
+        next[list->tail] = x;
+        prev[x] = list->tail;
+    }
+    list->tail = x;
+    list->size++;
+}
+
+/**
+ * @brief Insert an entry at the head of a list
+ */
+static inline void list_prepend(way_list_t *list, way_t *prev, way_t *next,
+                                way_t x) {
+    if (list->size == 0) {
+        list->tail = x;
+    } else {
+        prev[list->head] = x;
+        next[x] = list->head;
+    }
+    list->head = x;
+    list->size++;
+}
+
+/**
+ * @brief Insert an entry right after another one of a list
+ */
+static inline void list_insert_after(way_list_t *list, way_t *prev,
+                                     way_t *next, way_t at, way_t x) {
+    if (at == list->tail) {
+        list_append(list, prev, next, x);
+        return;
+    }
+    next[x] = next[at];
+    prev[x] = at;
+    prev[next[at]] = x;
+    next[at] = x;
+    list->size++;
+}
+
+/**
+ * @brief Remove an entry from a list
+ */
+static inline void list_remove(way_list_t *list, way_t *prev, way_t *next,
+                               way_t x) {
+    if (x == list->head) {
+        list->head = next[x];
+    } else {
+        next[prev[x]] = next[x];
+    }
+    if (x == list->tail) {
+        list->tail = prev[x];
+    } else {
+        prev[next[x]] = prev[x];
+    }
+    list->size--;
+}
+
+/**
+ * @brief Move all entries of a list to the tail of another
+ */
+static inline void list_splice(way_list_t *list, way_list_t *from,
+                               way_t *prev, way_t *next) {
+    if (from->size == 0) {
+        return;
+    }
+    if (list->size == 0) {
+        *list = *from;
+    } else {
+        next[list->tail] = from->head;
+        prev[from->head] = list->tail;
+        list->tail = from->tail;
+        list->size = (way_t)(list->size + from->size);
+    }
+    from->size = 0;
+}
+
+/**
+ * @brief Take an entry from a spare list, or else the first never used
+ */
+static inline way_t slot_take(way_list_t *spare, way_t *used, way_t *prev,
+                              way_t *next) {
+    if (spare->size == 0) {
+        return (*used)++;
+    }
+    way_t slot = spare->head;
+    list_remove(spare, prev, next, slot);
+    return slot;
+}
+
+/**
+ * @brief Remember the block of an evicted line at the tail of a ghost list
+ *
+ * @param[in] slots Index of the set's first ghost slot
+ * @param[in] list  The ghost list: ARC_B1, ARC_B2 or LFU_GHOSTS
+ */
+static void ghost_push(csim_cache_t *cache, list_set_t *set, size_t slots,
+                       int list, unsigned long block) {
+    way_t *prev = &cache->ghost_prev[slots];
+    way_t *next = &cache->ghost_next[slots];
+    way_t slot = slot_take(&set->spare_ghosts, &set->used_ghosts, prev, next);
+    cache->ghost[slots + slot] = block;
+    list_append(&set->lists[list], prev, next, slot);
+    blockmap_put(&cache->ghost_map, block, ((unsigned long)list << 16) | slot);
+}
+
+/**
+ * @brief Forget a block of a ghost list
+ */
+static void ghost_remove(csim_cache_t *cache, list_set_t *set, size_t slots,
+                         int list, way_t slot) {
+    way_t *prev = &cache->ghost_prev[slots];
+    way_t *next = &cache->ghost_next[slots];
+    blockmap_remove(&cache->ghost_map, cache->ghost[slots + slot]);
+    list_remove(&set->lists[list], prev, next, slot);
+    list_append(&set->spare_ghosts, prev, next, slot);
+}
+
+/**
+ * @brief Look a missing block up in the ghost lists of its set
+ *
+ * A block found is removed from its ghost list, since it is about to be
+ * cached again, and counted as a hit in that list.
+ *
+ * @param[in] first Ghost list counted as list 0 in the statistics
+ *
+ * @return The ghost list holding the block, or -1 if none does
+ */
+static int ghost_find(csim_cache_t *cache, list_set_t *set, size_t slots,
+                      int first, unsigned long block) {
+    unsigned long found;
+    if (!blockmap_get(&cache->ghost_map, block, &found)) {
+        return -1;
+    }
+    int list = (int)(found >> 16);
+    ghost_remove(cache, set, slots, list, (way_t)(found & 0xFFFF));
+    cache->ghosts.hits[list - first]++;
+    return list;
+}
+
+/**
+ * @brief Adapt an ARC set to a miss, before a victim is chosen
+ *
+ * A ghost hit in B1 means T1 was too small, and one in B2 that T2 was, so
+ * the target size of T1 moves by the ratio of the two ghost lists' sizes
+ * (at least 1). A block in neither list makes room in the ghost lists
+ * instead, so that T1 and B1 hold at most E blocks and all four lists at
+ * most 2E; when T1 alone holds E lines, its LRU line is discarded.
+ */
+static void arc_miss(csim_cache_t *cache, int E, unsigned long set_index,
+                     unsigned long block) {
+    list_set_t *set = &cache->lists[set_index];
+    size_t slots = set_index * (size_t)E;
+    way_list_t *t1 = &set->lists[ARC_T1];
+    size_t b1 = set->lists[ARC_B1].size;
+    size_t b2 = set->lists[ARC_B2].size;
+    size_t target = set->target;
+
+    cache->arc_discard = false;
+    cache->arc_source = ghost_find(cache, set, slots, ARC_B1, block);
+    if (cache->arc_source == ARC_B1) {
+        size_t delta = (b2 > b1) ? b2 / b1 : 1;
+        set->target = (way_t)((target + delta < (size_t)E) ? target + delta
+                                                             : (size_t)E);
+        return;
+    }
+    if (cache->arc_source == ARC_B2) {
+        size_t delta = (b1 > b2) ? b1 / b2 : 1;
+        set->target = (way_t)((target > delta) ? target - delta : 0);
+        return;
+    }
+
+    cache->arc_source = ARC_T1;
+    size_t total = t1->size + set->lists[ARC_T2].size + b1 + b2;
+    if (t1->size + b1 == (size_t)E) {
+        if (b1 > 0) {
+            ghost_remove(cache, set, slots, ARC_B1, set->lists[ARC_B1].head);
+        } else {
+            cache->arc_discard = true;
+        }
+    } else if (total == 2 * (size_t)E) {
+        ghost_remove(cache, set, slots, ARC_B2, set->lists[ARC_B2].head);
+    }
+}
+
+/**
+ * @brief Evict the LRU line of T1 or T2 of a full ARC set
+ *
+ * T1 gives up a line when it is larger than its target, or just as large
+ * on a ghost hit in B2. The victim's block moves to the matching ghost
+ * list, unless arc_miss() chose to discard it.
+ *
+ * @param[in] line Index of the set's way 0 in the line arrays
+ */
+static way_t arc_victim(csim_cache_t *cache, int E, unsigned long set_index,
+                        size_t line) {
+    list_set_t *set = &cache->lists[set_index];
+    way_list_t *t1 = &set->lists[ARC_T1];
+    bool from_t1 = t1->size > 0 &&
+                   (t1->size > set->target ||
+                    (cache->arc_source == ARC_B2 && t1->size == set->target));
+    int list = (cache->arc_discard || from_t1) ? ARC_T1 : ARC_T2;
+    way_t way = set->lists[list].head;
+    list_remove(&set->lists[list], &cache->prev[line], &cache->next[line],
+                way);
+    if (!cache->arc_discard) {
+        ghost_push(cache, set, set_index * (size_t)E,
+                   (list == ARC_T1) ? ARC_B1 : ARC_B2,
+                   cache->blocks[line + way]);
+    }
+    return way;
+}
+
+/**
+ * @brief Make a way of an ARC set the MRU line of T1 or T2
+ */
+static inline void arc_touch(csim_cache_t *cache, unsigned long set_index,
+                             size_t line, way_t way, int list) {
+    list_set_t *set = &cache->lists[set_index];
+    list_append(&set->lists[list], &cache->prev[line], &cache->next[line],
+                way);
+    cache->owner[line + way] = (way_t)list;
+}
+
+/**
+ * @brief Halve the counts of an LFU set, merging buckets that meet
+ *
+ * Counts stay at least 1. Lines of a merged bucket go after those of the
+ * lower bucket they join, which had the lower count before.
+ *
+ * @param[in] buckets Index of the set's first bucket
+ */
+static void lfu_age(csim_cache_t *cache, list_set_t *set, size_t line,
+                    size_t buckets) {
+    way_list_t *list = &set->lists[LFU_BUCKETS];
+    way_t *prev = &cache->bucket_prev[buckets];
+    way_t *next = &cache->bucket_next[buckets];
+    way_t bucket = list->head;
+    way_t kept = bucket;
+    for (size_t left = list->size; left > 0; left--) {
+        way_t following = next[bucket];
+        unsigned long freq = cache->freq[buckets + bucket] / 2;
+        cache->freq[buckets + bucket] = (freq > 0) ? freq : 1;
+        if (bucket != list->head &&
+            cache->freq[buckets + kept] == cache->freq[buckets + bucket]) {
+            way_list_t *lines = &cache->bucket[buckets + bucket];
+            way_t way = lines->head;
+            for (size_t n = lines->size; n > 0; n--) {
+                cache->owner[line + way] = kept;
+                way = cache->next[line + way];
+            }
+            list_splice(&cache->bucket[buckets + kept], lines,
+                        &cache->prev[line], &cache->next[line]);
+            list_remove(list, prev, next, bucket);
+            list_append(&set->spare_buckets, prev, next, bucket);
+        } else {
+            kept = bucket;
+        }
+        bucket = following;
+    }
+    set->ticks = 0;
+}
+
+/**
+ * @brief Take a line out of its LFU bucket, releasing the bucket if empty
+ *
+ * @param[in] buckets Index of the set's first bucket
+ */
+static void lfu_unlink(csim_cache_t *cache, list_set_t *set, size_t line,
+                       size_t buckets, way_t way) {
+    way_t bucket = cache->owner[line + way];
+    way_list_t *lines = &cache->bucket[buckets + bucket];
+    list_remove(lines, &cache->prev[line], &cache->next[line], way);
+    if (lines->size == 0) {
+        way_t *prev = &cache->bucket_prev[buckets];
+        way_t *next = &cache->bucket_next[buckets];
+        list_remove(&set->lists[LFU_BUCKETS], prev, next, bucket);
+        list_append(&set->spare_buckets, prev, next, bucket);
+    }
+}
+
+/**
+ * @brief Count an access to a way of an LFU set
+ *
+ * The line moves from its bucket to the next one up, which is created if
+ * its count is missing. If the line was alone in its bucket, the bucket
+ * itself moves up instead. All of this is O(1).
+ *
+ * @param[in] fill Whether the way was just filled, with no bucket yet
+ */
+static void lfu_touch(csim_cache_t *cache, int E, unsigned long set_index,
+                      size_t line, way_t way, bool fill) {
+    list_set_t *set = &cache->lists[set_index];
+    size_t buckets = set_index * (size_t)E;
+    way_list_t *list = &set->lists[LFU_BUCKETS];
+    way_t *prev = &cache->bucket_prev[buckets];
+    way_t *next = &cache->bucket_next[buckets];
+    unsigned long *freq = &cache->freq[buckets];
+    way_t from = cache->owner[line + way];
+    unsigned long count = fill ? 1 : freq[from] + 1;
+    way_t to;
+
+    if (fill && list->size > 0 && freq[list->head] == 1) {
+        to = list->head;
+    } else if (!fill && from != list->tail && freq[next[from]] == count) {
+        to = next[from];
+    } else if (!fill && cache->bucket[buckets + from].size == 1) {
+        freq[from] = count;
+        to = from;
+    } else {
+        to = slot_take(&set->spare_buckets, &set->used_buckets, prev, next);
+        freq[to] = count;
+        cache->bucket[buckets + to].size = 0;
+        if (fill) {
+            list_prepend(list, prev, next, to);
+        } else {
+            list_insert_after(list, prev, next, from, to);
+        }
+    }
+
+    if (to != from || fill) {
+        if (!fill) {
+            lfu_unlink(cache, set, line, buckets, way);
+        }
+        list_append(&cache->bucket[buckets + to], &cache->prev[line],
+                    &cache->next[line], way);
+        cache->owner[line + way] = to;
+    }
+    if (++set->ticks >= LFU_AGE_PERIOD * (unsigned long)E) {
+        lfu_age(cache, set, line, buckets);
+    }
+}
+
+/**
+ * @brief Evict the oldest line of the lowest bucket of a full LFU set
+ *
+ * The victim's block goes to the set's ghost list, which forgets its
+ * oldest block once it holds E.
+ */
+static way_t lfu_victim(csim_cache_t *cache, int E, unsigned long set_index,
+                        size_t line) {
+    list_set_t *set = &cache->lists[set_index];
+    size_t buckets = set_index * (size_t)E; /* also the first ghost slot */
+    way_t way = cache->bucket[buckets + set->lists[LFU_BUCKETS].head].head;
+    lfu_unlink(cache, set, line, buckets, way);
+
+    way_list_t *ghosts = &set->lists[LFU_GHOSTS];
+    if (ghosts->size == E) {
+        ghost_remove(cache, set, buckets, LFU_GHOSTS, ghosts->head);
+    }
+    ghost_push(cache, set, buckets, LFU_GHOSTS, cache->blocks[line + way]);
+    return way;
+}
+
+/**
+ * @brief Update the replacement state of a set for a hit on a way
+ *
+ * The policy hooks are always inlined into sim_update(), and every kernel
+ * passes a constant policy, so each hook compiles down to a single case.
+ */
+static inline __attribute__((always_inline)) void
+policy_hit(csim_cache_t *cache, policy_t policy, int E,
+           unsigned long set_index, size_t line, way_t way) {
+    int team;
+    switch (policy) {
+    case POLICY_LRU:
+        lru_touch(cache, &cache->meta[set_index], line, way);
+        break;
+    case POLICY_PLRU:
+        plru_touch(policy_state(cache, E, set_index), E, way);
+        break;
+    case POLICY_BITPLRU:
+        bitplru_touch(policy_state(cache, E, set_index), E, way);
+        break;
+    case POLICY_NRU:
+        bit_set(policy_state(cache, E, set_index), 0, way);
+        break;
+    case POLICY_DRRIP:
+        team = duel_team(cache, set_index);
+        if (team >= 0) {
+            cache->duel.hits[team]++;
+        }
+        /* fall through */
+    case POLICY_SRRIP:
+    case POLICY_BRRIP:
+        /* Hit priority: a reused block is predicted to be reused soon */
+        rrpv_set(policy_state(cache, E, set_index), way, 0);
+        break;
+    case POLICY_ARC:
+        list_remove(&cache->lists[set_index].lists[cache->owner[line + way]],
+                    &cache->prev[line], &cache->next[line], way);
+        arc_touch(cache, set_index, line, way, ARC_T2);
+        break;
+    case POLICY_LFU:
+        lfu_touch(cache, E, set_index, line, way, false);
+        break;
+    default:
+        /* FIFO and random ignore hits */
+        break;
+    }
+}
+
+/**
+ * @brief Update the replacement state of a set for a block put in a way
+ *
+ * @param[in] evicted Whether the way held a block before (otherwise it
+ *                    was an empty way, removed from the replacement
+ *                    state if it was ever invalidated)
+ */
+static inline __attribute__((always_inline)) void
+policy_insert(csim_cache_t *cache, policy_t policy, int E,
+              unsigned long set_index, size_t line, way_t way, bool evicted) {
+    set_meta_t *meta = &cache->meta[set_index];
+    switch (policy) {
+    case POLICY_LRU:
+        if (evicted) {
+            lru_touch(cache, meta, line, way);
+        } else {
+            lru_push(cache, meta, line, way, meta->count == 0);
+        }
+        break;
+    case POLICY_FIFO:
+        /* Lines fill in way order, so the oldest line starts at way 0 */
+        if (evicted) {
+            meta->lru = (way + 1 == E) ? 0 : (way_t)(way + 1);
+        }
+        break;
+    case POLICY_RANDOM:
+        break;
+    case POLICY_SRRIP:
+        rrpv_set(policy_state(cache, E, set_index), way, RRPV_MAX - 1);
+        break;
+    case POLICY_BRRIP:
+        rrpv_set(policy_state(cache, E, set_index), way, brrip_insertion(meta));
+        break;
+    case POLICY_DRRIP:
+        rrpv_set(policy_state(cache, E, set_index), way,
+                 drrip_insertion(cache, set_index));
+        break;
+    case POLICY_ARC:
+        /* A block back from a ghost list has been seen twice */
+        arc_touch(cache, set_index, line, way,
+                  (cache->arc_source == ARC_T1) ? ARC_T1 : ARC_T2);
+        break;
+    case POLICY_LFU:
+        lfu_touch(cache, E, set_index, line, way, true);
+        break;
+    default:
+        policy_hit(cache, policy, E, set_index, line, way);
+        break;
+    }
+}
+
+/**
+ * @brief Update the replacement state of a set for a miss
+ *
+ * This comes before the block is filled in or a victim is chosen, and
+ * gives the policies with ghost lists a chance to look the block up.
+ */
+static inline __attribute__((always_inline)) void
+policy_miss(csim_cache_t *cache, policy_t policy, int E,
+            unsigned long set_index, unsigned long block) {
+    switch (policy) {
+    case POLICY_ARC:
+        arc_miss(cache, E, set_index, block);
+        break;
+    case POLICY_LFU:
+        ghost_find(cache, &cache->lists[set_index], set_index * (size_t)E,
+                   LFU_GHOSTS, block);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Choose the way of a full set to evict
+ *
+ * @param[in] line Index of the set's way 0 in the line arrays
+ */
+static inline __attribute__((always_inline)) way_t
+policy_victim(csim_cache_t *cache, policy_t policy, int E,
+              unsigned long set_index, size_t line) {
+    uint64_t *bits;
+    int way;
+    switch (policy) {
+    case POLICY_RANDOM:
+        return random_victim(policy_state(cache, E, set_index), E);
+    case POLICY_PLRU:
+        return plru_victim(policy_state(cache, E, set_index), E);
+    case POLICY_BITPLRU:
+        /* Never all set: the last touch would have cleared the others */
+        return (way_t)bits_first_clear(policy_state(cache, E, set_index), E);
+    case POLICY_NRU:
+        bits = policy_state(cache, E, set_index);
+        way = bits_first_clear(bits, E);
+        if (way < 0) {
+            memset(bits, 0, (((size_t)E + 63) / 64) * sizeof(uint64_t));
+            way = 0;
+        }
+        return (way_t)way;
+    case POLICY_SRRIP:
+    case POLICY_BRRIP:
+    case POLICY_DRRIP:
+        return rrip_victim(policy_state(cache, E, set_index), E);
+    case POLICY_ARC:
+        return arc_victim(cache, E, set_index, line);
+    case POLICY_LFU:
+        return lfu_victim(cache, E, set_index, line);
+    default:
+        return cache->meta[set_index].lru;
+    }
+}
+
+/**
+ * @brief Remove an invalidated way from the replacement state of its set
+ *
+ * The way is then filled like a way that was never used. Policies whose
+ * per-way state is overwritten by the next fill have nothing to undo.
+ * FIFO's oldest line is a position in way order, which holes cannot
+ * change, so a refilled hole keeps the age of the block it replaced.
+ */
+static void policy_remove(csim_cache_t *cache, unsigned long set_index,
+                          size_t line, way_t way) {
+    list_set_t *set = &cache->lists[set_index];
+    switch (cache->policy) {
+    case POLICY_LRU:
+        lru_unlink(cache, &cache->meta[set_index], line, way);
+        break;
+    case POLICY_ARC:
+        list_remove(&set->lists[cache->owner[line + way]], &cache->prev[line],
+                    &cache->next[line], way);
+        break;
+    case POLICY_LFU:
+        lfu_unlink(cache, set, line, set_index * (size_t)cache->E, way);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Find the way holding a block in a set
+ *
+ * @param[in] line Index of the set's way 0 in the line arrays
+ *
+ * @return The way index, or -1 on a miss
+ */
+static int cache_lookup(const csim_cache_t *cache, size_t line, size_t word,
+                        unsigned long block) {
+    if (cache->use_map) {
+        unsigned long way;
+        if (blockmap_get(&cache->map, block, &way)) {
+            return (int)way;
+        }
+        return -1;
+    }
+    uint64_t hits = cache->match(&cache->blocks[line], cache->E, block) &
+                    cache->valid[word];
+    if (hits == 0) {
+        return -1;
+    }
+    return __builtin_ctzll(hits);
+}
+
+/**
+ * @brief Update a set for one access, given the result of its lookup
+ *
+ * This is the body shared by every simulation kernel. It is always inlined
+ * so that kernels which pass a constant policy and E get the policy hooks,
+ * the set arithmetic, the fill check and the single-way case folded at
+ * compile time. With one way there is no replacement choice, and mru and
+ * lru are always 0 (their zero-initialized value), so the policy state is
+ * skipped entirely, except by policies that keep statistics of their
+ * own.
+ *
+ * A fill that is not a demand access (see csim_fill()) counts neither a
+ * hit nor a miss, and leaves the replacement state of a block it finds
+ * alone. An eviction records the victim for csim_access_evict().
+ *
+ * @param[in] policy Replacement policy of the cache
+ * @param[in] E      Associativity (number of lines per set)
+ * @param[in] line   Index of the set's way 0 in the line arrays
+ * @param[in] word   Index of the set's first bitmap word
+ * @param[in] found  Way holding block, or -1 on a miss
+ * @param[in] demand Whether this is an access rather than a fill
+ *
+ * @return The outcome of the access
+ */
+static inline __attribute__((always_inline)) csim_result_t
+sim_update(csim_cache_t *cache, policy_t policy, int E,
+           unsigned long set_index, size_t line, size_t word,
+           unsigned long block, bool store, int found, bool demand) {
+    unsigned long B = 1UL << cache->b;
+    set_meta_t *meta = &(cache->meta[set_index]);
+    bool replaces = (E > 1 || policy_keeps_stats(policy));
+
+    if (found >= 0) {
+        way_t way = (way_t)found;
+        if (demand) {
+            cache->stats.hits++;
+        }
+        if (demand && replaces) {
+            policy_hit(cache, policy, E, set_index, line, way);
+        }
+        if (store && !bit_test(cache->dirty, word, way)) {
+            bit_set(cache->dirty, word, way);
+            cache->stats.dirty_bytes += B;
+        }
+        return CSIM_HIT;
+    }
+
+    if (demand) {
+        cache->stats.misses++;
+    }
+    if (replaces) {
+        policy_miss(cache, policy, E, set_index, block);
+    }
+    if (meta->count < E) {
+        way_t way = cache->holes
+                        ? (way_t)bits_first_clear(&cache->valid[word], E)
+                        : meta->count;
+        cache->blocks[line + way] = block;
+        bit_set(cache->valid, word, way);
+        if (replaces) {
+            policy_insert(cache, policy, E, set_index, line, way, false);
+        }
+        meta->count++;
+        if (E >= MAP_MIN_ASSOC && cache->use_map) {
+            blockmap_put(&cache->map, block, way);
+        }
+        if (store) {
+            bit_set(cache->dirty, word, way);
+            cache->stats.dirty_bytes += B;
+        }
+        return CSIM_MISS;
+    }
+
+    cache->stats.evictions++;
+    way_t way =
+        replaces ? policy_victim(cache, policy, E, set_index, line) : 0;
+    cache->victim = cache->blocks[line + way];
+    if (E >= MAP_MIN_ASSOC && cache->use_map) {
+        blockmap_remove(&cache->map, cache->victim);
+        blockmap_put(&cache->map, block, way);
+    }
+    cache->blocks[line + way] = block;
+    if (replaces) {
+        policy_insert(cache, policy, E, set_index, line, way, true);
+    }
+
+    bool dirty = bit_test(cache->dirty, word, way);
+    cache->victim_dirty = dirty;
+    if (dirty) {
+        cache->stats.dirty_evictions += B;
+    }
+    if (dirty && !store) {
+        bit_clear(cache->dirty, word, way);
+        cache->stats.dirty_bytes -= B;
+    } else if (!dirty && store) {
+        bit_set(cache->dirty, word, way);
+        cache->stats.dirty_bytes += B;
+    }
+    return CSIM_MISS_EVICTION;
+}
+
+/**
+ * @brief Define a kernel simulating one access for any associativity
+ *
+ * Every step of LRU and FIFO (hit promotion, fill, victim selection) takes
+ * constant time regardless of associativity; the bitmap policies scan one
+ * word per 64 ways, and tree-PLRU walks log2(E) levels.
+ */
+#define DEFINE_GENERIC_KERNEL(NAME, POLICY)                                    \
+    static csim_result_t sim_generic_##NAME(csim_cache_t *cache,               \
+                                            unsigned long set_index,           \
+                                            unsigned long block, bool store) { \
+        size_t line = set_index * (size_t)cache->E;                            \
+        size_t word = set_index * cache->W;                                    \
+        int found = cache_lookup(cache, line, word, block);                    \
+        return sim_update(cache, (POLICY), cache->E, set_index, line, word,    \
+                          block, store, found, true);                          \
+    }
+
+DEFINE_GENERIC_KERNEL(lru, POLICY_LRU)
+DEFINE_GENERIC_KERNEL(fifo, POLICY_FIFO)
+DEFINE_GENERIC_KERNEL(random, POLICY_RANDOM)
+DEFINE_GENERIC_KERNEL(plru, POLICY_PLRU)
+DEFINE_GENERIC_KERNEL(bitplru, POLICY_BITPLRU)
+DEFINE_GENERIC_KERNEL(nru, POLICY_NRU)
+DEFINE_GENERIC_KERNEL(srrip, POLICY_SRRIP)
+DEFINE_GENERIC_KERNEL(brrip, POLICY_BRRIP)
+DEFINE_GENERIC_KERNEL(drrip, POLICY_DRRIP)
+DEFINE_GENERIC_KERNEL(arc, POLICY_ARC)
+DEFINE_GENERIC_KERNEL(lfu, POLICY_LFU)
+
+/** @brief Kernel of each policy used when none is specialized for E */
+static const sim_kernel_fn GENERIC_KERNELS[] = {
+    [POLICY_LRU] = sim_generic_lru,         [POLICY_FIFO] = sim_generic_fifo,
+    [POLICY_RANDOM] = sim_generic_random,   [POLICY_PLRU] = sim_generic_plru,
+    [POLICY_BITPLRU] = sim_generic_bitplru, [POLICY_NRU] = sim_generic_nru,
+    [POLICY_SRRIP] = sim_generic_srrip,     [POLICY_BRRIP] = sim_generic_brrip,
+    [POLICY_DRRIP] = sim_generic_drrip,     [POLICY_ARC] = sim_generic_arc,
+    [POLICY_LFU] = sim_generic_lfu,
+};
+
+/* Unrolled comparison of block against ways 0 to N - 1 of blocks */
+#define MATCH_WAY(i) (((uint64_t)(blocks[i] == block)) << (i))
+#define MATCH_1 MATCH_WAY(0)
+#define MATCH_2 MATCH_1 | MATCH_WAY(1)
+#define MATCH_4 MATCH_2 | MATCH_WAY(2) | MATCH_WAY(3)
+#define MATCH_8                                                                \
+    MATCH_4 | MATCH_WAY(4) | MATCH_WAY(5) | MATCH_WAY(6) | MATCH_WAY(7)
+#define MATCH_16                                                               \
+    MATCH_8 | MATCH_WAY(8) | MATCH_WAY(9) | MATCH_WAY(10) | MATCH_WAY(11) |    \
+        MATCH_WAY(12) | MATCH_WAY(13) | MATCH_WAY(14) | MATCH_WAY(15)
+
+/**
+ * @brief Define a kernel specialized for a policy and a fixed number of ways
+ *
+ * The way comparisons are fully unrolled, the set has a single bitmap word,
+ * and sim_update() is inlined with the policy and E known at compile time.
+ */
+#define DEFINE_KERNEL(NAME, POLICY, WAYS)                                      \
+    static csim_result_t sim_##NAME##_##WAYS(csim_cache_t *cache,              \
+                                             unsigned long set_index,          \
+                                             unsigned long block,              \
+                                             bool store) {                     \
+        size_t line = set_index * (WAYS);                                      \
+        const unsigned long *blocks = &cache->blocks[line];                    \
+        uint64_t hits = (MATCH_##WAYS) & cache->valid[set_index];              \
+        int found = (hits != 0) ? __builtin_ctzll(hits) : -1;                  \
+        return sim_update(cache, (POLICY), (WAYS), set_index, line,            \
+                          set_index, block, store, found, true);               \
+    }
+
+/* A direct-mapped set has no replacement choice, so any policy can use it */
+DEFINE_KERNEL(direct, POLICY_LRU, 1)
+DEFINE_KERNEL(lru, POLICY_LRU, 8)
+DEFINE_KERNEL(lru, POLICY_LRU, 16)
+DEFINE_KERNEL(plru, POLICY_PLRU, 8)
+DEFINE_KERNEL(plru, POLICY_PLRU, 16)
+
+#ifdef HAVE_AVX2_KERNELS
+
+/* Unrolled AVX2 comparison of block against ways i to i + 3 of blocks */
+#define MATCH4_AVX2(i)                                                         \
+    ((uint64_t)(unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(               \
+         _mm256_cmpeq_epi64(                                                   \
+             _mm256_loadu_si256((const __m256i *)(blocks + (i))), key)))       \
+     << (i))
+#define MATCH_AVX2_8 MATCH4_AVX2(0) | MATCH4_AVX2(4)
+#define MATCH_AVX2_16 MATCH_AVX2_8 | MATCH4_AVX2(8) | MATCH4_AVX2(12)
+
+/**
+ * @brief Define an AVX2 variant of DEFINE_KERNEL, four ways per compare
+ *
+ * The upper halves of the vector registers are cleared explicitly, as not
+ * every compiler does so on return, and leaving them dirty slows down any
+ * SSE code the caller runs next.
+ */
+#define DEFINE_KERNEL_AVX2(NAME, POLICY, WAYS)                                 \
+    __attribute__((target("avx2"))) static csim_result_t                       \
+        sim_##NAME##_##WAYS##_avx2(csim_cache_t *cache,                        \
+                                   unsigned long set_index,                    \
+                                   unsigned long block, bool store) {          \
+        size_t line = set_index * (WAYS);                                      \
+        const unsigned long *blocks = &cache->blocks[line];                    \
+        __m256i key = _mm256_set1_epi64x((long long)block);                    \
+        uint64_t hits = (MATCH_AVX2_##WAYS) & cache->valid[set_index];         \
+        _mm256_zeroupper();                                                    \
+        int found = (hits != 0) ? __builtin_ctzll(hits) : -1;                  \
+        return sim_update(cache, (POLICY), (WAYS), set_index, line,            \
+                          set_index, block, store, found, true);               \
+    }
+
+DEFINE_KERNEL_AVX2(lru, POLICY_LRU, 8)
+DEFINE_KERNEL_AVX2(lru, POLICY_LRU, 16)
+DEFINE_KERNEL_AVX2(plru, POLICY_PLRU, 8)
+DEFINE_KERNEL_AVX2(plru, POLICY_PLRU, 16)
+
+#endif /* HAVE_AVX2_KERNELS */
+
+/**
+ * @brief Kernels specialized at compile time, by associativity and policy
+ *
+ * Direct-mapped is TEST_ASSOC, 8-way is HASWELL_L1_ASSOC, and 16-way is a
+ * typical last-level cache; tree-PLRU is what such hardware implements.
+ * Entries that need an instruction set extension come first and are
+ * skipped on hosts without it. Any other configuration uses the generic
+ * kernel of its policy, as do policies that keep statistics of their own
+ * even when direct-mapped.
+ */
+static const struct {
+    int E;                /* associativity the kernel is specialized for */
+    int policy;           /* replacement policy it implements, -1 for all */
+    const char *isa;      /* required CPU feature, or NULL */
+    const char *name;     /* name reported by csim_kernel_name() */
+    sim_kernel_fn kernel; /* the kernel */
+} SIM_KERNELS[] = {
+#ifdef HAVE_AVX2_KERNELS
+    {8, POLICY_LRU, "avx2", "lru-8-avx2", sim_lru_8_avx2},
+    {16, POLICY_LRU, "avx2", "lru-16-avx2", sim_lru_16_avx2},
+    {8, POLICY_PLRU, "avx2", "plru-8-avx2", sim_plru_8_avx2},
+    {16, POLICY_PLRU, "avx2", "plru-16-avx2", sim_plru_16_avx2},
+#endif
+    {1, -1, NULL, "direct", sim_direct_1},
+    {8, POLICY_LRU, NULL, "lru-8", sim_lru_8},
+    {16, POLICY_LRU, NULL, "lru-16", sim_lru_16},
+    {8, POLICY_PLRU, NULL, "plru-8", sim_plru_8},
+    {16, POLICY_PLRU, NULL, "plru-16", sim_plru_16},
+};
+
+/**
+ * @brief Whether the host supports a kernel's instruction set extension
+ */
+static bool sim_isa_supported(const char *isa) {
+    if (isa == NULL) {
+        return true;
+    }
+#ifdef HAVE_AVX2_KERNELS
+    __builtin_cpu_init();
+    if (strcmp(isa, "avx2") == 0) {
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return false;
+}
+
+/**
+ * @brief Pick the simulation kernel for a cache's configuration
+ *
+ * A specialized kernel is used if one exists, otherwise the generic kernel
+ * of the cache's policy.
+ *
+ * @param[in] generic Whether to use the generic kernel regardless
+ */
+static void sim_select_kernel(csim_cache_t *cache, bool generic) {
+    cache->kernel = GENERIC_KERNELS[cache->policy];
+    cache->kernel_name = "generic";
+    if (generic) {
+        return;
+    }
+    int any = policy_keeps_stats(cache->policy) ? (int)cache->policy : -1;
+    for (size_t i = 0; i < sizeof(SIM_KERNELS) / sizeof(SIM_KERNELS[0]);
+         i++) {
+        if (SIM_KERNELS[i].E == cache->E &&
+            (SIM_KERNELS[i].policy == any ||
+             SIM_KERNELS[i].policy == (int)cache->policy) &&
+            sim_isa_supported(SIM_KERNELS[i].isa)) {
+            cache->kernel = SIM_KERNELS[i].kernel;
+            cache->kernel_name = SIM_KERNELS[i].name;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Log2 of the bytes per bit of a write-combining entry's chunks
+ *
+ * An entry has one bit per byte of blocks of up to 64 bytes, and one bit
+ * per 1/64th of larger blocks.
+ */
+static inline int wcb_chunk_bits(const csim_cache_t *cache) {
+    return (cache->b > 6) ? cache->b - 6 : 0;
+}
+
+/**
+ * @brief Flush the oldest entry of the write-combining buffer to memory
+ */
+static void wcb_flush(csim_cache_t *cache) {
+    uint64_t chunks = cache->wcb_chunks[cache->wcb_oldest];
+    cache->writes.writes++;
+    cache->writes.bytes += (unsigned long)__builtin_popcountll(chunks)
+                           << wcb_chunk_bits(cache);
+    cache->wcb_oldest = (cache->wcb_oldest + 1) % cache->wcb_entries;
+    cache->wcb_count--;
+}
+
+/**
+ * @brief Write bytes of one block to memory
+ *
+ * Without a write-combining buffer every write goes straight to memory.
+ * With one, a write to a block already buffered merges into its entry;
+ * otherwise it takes a new entry, flushing the oldest if all are in use.
+ *
+ * @param[in] addr Address of the first byte written
+ * @param[in] size Number of bytes written, cut off at the end of the block
+ */
+static void sim_memory_write(csim_cache_t *cache, unsigned long addr,
+                             unsigned long size) {
+    unsigned long B = 1UL << cache->b;
+    unsigned long offset = addr & (B - 1);
+    unsigned long end = (size == 0) ? offset + 1 : offset + size;
+    if (end > B) {
+        end = B;
+    }
+    if (cache->wcb_entries == 0) {
+        cache->writes.writes++;
+        cache->writes.bytes += end - offset;
+        return;
+    }
+
+    int shift = wcb_chunk_bits(cache);
+    unsigned long first = offset >> shift;
+    unsigned long last = (end - 1) >> shift;
+    uint64_t chunks = ((last == 63) ? ~0UL : (1UL << (last + 1)) - 1) &
+                      ~((1UL << first) - 1);
+    unsigned long block = addr >> cache->b;
+    for (size_t i = 0; i < cache->wcb_count; i++) {
+        size_t entry = (cache->wcb_oldest + i) % cache->wcb_entries;
+        if (cache->wcb_blocks[entry] == block) {
+            cache->wcb_chunks[entry] |= chunks;
+            cache->writes.combined++;
+            return;
+        }
+    }
+    if (cache->wcb_count == cache->wcb_entries) {
+        wcb_flush(cache);
+    }
+    size_t entry = (cache->wcb_oldest + cache->wcb_count) % cache->wcb_entries;
+    cache->wcb_blocks[entry] = block;
+    cache->wcb_chunks[entry] = chunks;
+    cache->wcb_count++;
+}
+
+/**
+ * @brief Set of a block under a hashed or non-power-of-two index
+ *
+ * XOR folding first reduces the block number to s bits. The modulo is
+ * then taken with the reciprocal r = floor((2^64 - 1) / sets) instead of
+ * a division: the high half of x * r is the quotient or one less, so a
+ * single correction leaves the remainder.
+ */
+static unsigned long index_hash(const csim_cache_t *cache,
+                                unsigned long block) {
+    unsigned long x = block;
+    if (cache->index == CSIM_INDEX_XOR) {
+        unsigned long mask = (1UL << cache->s) - 1;
+        x = 0;
+        for (unsigned long rest = block; rest != 0; rest >>= cache->s) {
+            x ^= rest & mask;
+        }
+    }
+    unsigned long q = (unsigned long)(((u128_t)x * cache->recip) >> 64);
+    unsigned long r = x - q * cache->sets;
+    return (r >= cache->sets) ? r - cache->sets : r;
+}
+
+/**
+ * @brief Set of a block
+ */
+static inline unsigned long sim_set(const csim_cache_t *cache,
+                                    unsigned long block) {
+    if (cache->hashed) {
+        return index_hash(cache, block);
+    }
+    return block & ((1UL << cache->s) - 1);
+}
+
+/**
+ * @brief Whether an access writes its block: a store or a modify
+ */
+static inline bool op_stores(char op) {
+    return op == 'S' || op == 'M';
+}
+
+/**
+ * @brief Simulate one access to a cache that is not write-back and
+ *        write-allocate, or has a write-combining buffer
+ *
+ * A write-through store updates the line, which stays clean, and writes
+ * its bytes to memory. A store that misses in a no-write-allocate cache
+ * writes its bytes to memory without filling a line; the load of a modify
+ * fills it anyway. Dirty victims are written to memory whole. All these
+ * writes go through the buffer, if any.
+ *
+ * @return The outcome of the access
+ */
+static csim_result_t sim_write(csim_cache_t *cache, const access_t *op) {
+    unsigned long block = op->addr >> cache->b;
+    unsigned long set_index = sim_set(cache, block);
+    bool store = op_stores(op->op);
+    if (op->op == 'S' && cache->no_write_allocate &&
+        cache_lookup(cache, set_index * (size_t)cache->E,
+                     set_index * cache->W, block) < 0) {
+        cache->stats.misses++;
+        sim_memory_write(cache, op->addr, op->size);
+        return CSIM_MISS;
+    }
+
+    csim_result_t result =
+        cache->kernel(cache, set_index, block, store && !cache->write_through);
+    if (result == CSIM_MISS_EVICTION && cache->victim_dirty) {
+        sim_memory_write(cache, cache->victim << cache->b, 1UL << cache->b);
+    }
+    if (store && cache->write_through) {
+        sim_memory_write(cache, op->addr, op->size);
+    }
+    return result;
+}
+
+/**
+ * @brief Simulate one access to a block
+ */
+static inline csim_result_t sim_block(csim_cache_t *cache,
+                                      const access_t *op) {
+    csim_result_t result;
+    if (cache->writes_slow) {
+        result = sim_write(cache, op);
+    } else {
+        unsigned long block = op->addr >> cache->b;
+        result = cache->kernel(cache, sim_set(cache, block), block,
+                               op_stores(op->op));
+    }
+    cache->stats.hits += (op->op == 'M');
+    return result;
+}
+
+/**
+ * @brief Simulate one access to a cache with a write policy other than
+ *        write-back and write-allocate, a buffer, or split accesses
+ *
+ * If the cache splits accesses, one whose bytes span several blocks
+ * accesses each of them in turn, with the bytes that fall in it, and
+ * counts a hit or miss for each. An access within one block, the usual
+ * case, is simulated directly.
+ *
+ * @return The outcome of the access: a hit if every block hit, otherwise
+ *         an eviction if any block evicted another, otherwise a miss
+ */
+static csim_result_t sim_slow(csim_cache_t *cache, const access_t *op) {
+    unsigned long B = 1UL << cache->b;
+    unsigned long offset = op->addr & (B - 1);
+    if (!cache->split || op->size <= B - offset) {
+        return sim_block(cache, op);
+    }
+
+    csim_result_t result = CSIM_HIT;
+    access_t part = *op;
+    unsigned long left = op->size;
+    while (left > 0) {
+        unsigned long bytes = B - (part.addr & (B - 1));
+        part.size = (unsigned int)((left < bytes) ? left : bytes);
+        csim_result_t block_result = sim_block(cache, &part);
+        if (block_result > result) {
+            result = block_result;
+        }
+        left -= part.size;
+        part.addr += part.size;
+    }
+    return result;
+}
+
+/**
+ * @brief Simulate one access
+ *
+ * A modify ('M') is a load and a store of the same bytes, simulated with
+ * a single lookup that writes the block: its load has the outcome of the
+ * lookup, and its store always hits.
+ *
+ * @param[in] op The access; 'S' is a store, 'M' a modify, and anything
+ *               else a load
+ *
+ * @return The outcome of the access, or of the load of a modify
+ */
+csim_result_t csim_access(csim_cache_t *cache, const access_t *op) {
+    if (cache->slow) {
+        return sim_slow(cache, op);
+    }
+    unsigned long block = op->addr >> cache->b;
+    csim_result_t result =
+        cache->kernel(cache, sim_set(cache, block), block, op_stores(op->op));
+    cache->stats.hits += (op->op == 'M');
+    return result;
+}
+
+/**
+ * @brief Simulate one access, reporting the block it evicted
+ *
+ * @param[out] evicted The address and dirty bit of the evicted block (the
+ *                     last one, if a split access evicted several), if
+ *                     the result is CSIM_MISS_EVICTION
+ *
+ * @return The outcome of the access
+ */
+csim_result_t csim_access_evict(csim_cache_t *cache, const access_t *op,
+                                csim_eviction_t *evicted) {
+    csim_result_t result = csim_access(cache, op);
+    if (result == CSIM_MISS_EVICTION) {
+        evicted->addr = cache->victim << cache->b;
+        evicted->dirty = cache->victim_dirty;
+    }
+    return result;
+}
+
+/**
+ * @brief Put a block in the cache without counting an access
+ *
+ * This is how a cache takes blocks it did not ask for, such as the dirty
+ * blocks written back to it by the cache above, or prefetched blocks. A
+ * block that is missing is filled as on a miss, evicting another if its
+ * set is full (a dirty victim is written to memory, as on a miss), but no
+ * hit or miss is counted. A block that is already cached keeps its place
+ * in the replacement order.
+ *
+ * @param[in]  addr    Any address in the block
+ * @param[in]  dirty   Whether the block is dirty; a cached block that is
+ *                     clean becomes dirty, but a dirty one stays dirty
+ * @param[out] evicted The address and dirty bit of the evicted block, if
+ *                     the result is CSIM_MISS_EVICTION; may be NULL
+ *
+ * @return CSIM_HIT if the block was already cached, otherwise the outcome
+ *         of filling it
+ */
+csim_result_t csim_fill(csim_cache_t *cache, unsigned long addr, bool dirty,
+                        csim_eviction_t *evicted) {
+    unsigned long block = addr >> cache->b;
+    unsigned long set_index = sim_set(cache, block);
+    size_t line = set_index * (size_t)cache->E;
+    size_t word = set_index * cache->W;
+    int found = cache_lookup(cache, line, word, block);
+    csim_result_t result = sim_update(cache, cache->policy, cache->E,
+                                      set_index, line, word, block, dirty,
+                                      found, false);
+    if (result == CSIM_MISS_EVICTION && cache->writes_slow &&
+        cache->victim_dirty) {
+        sim_memory_write(cache, cache->victim << cache->b, 1UL << cache->b);
+    }
+    if (result == CSIM_MISS_EVICTION && evicted != NULL) {
+        evicted->addr = cache->victim << cache->b;
+        evicted->dirty = cache->victim_dirty;
+    }
+    return result;
+}
+
+/**
+ * @brief Whether a block is cached, without counting an access
+ *
+ * @param[in] addr Any address in the block
+ */
+bool csim_contains(const csim_cache_t *cache, unsigned long addr) {
+    unsigned long block = addr >> cache->b;
+    unsigned long set_index = sim_set(cache, block);
+    return cache_lookup(cache, set_index * (size_t)cache->E,
+                        set_index * cache->W, block) >= 0;
+}
+
+/**
+ * @brief Remove a block from the cache
+ *
+ * The line is invalidated as if it had never been filled, and is the
+ * first to be filled again in its set. Its dirty bytes leave the cache
+ * without counting as an eviction; writing them back is up to the caller.
+ *
+ * @param[in]  addr  Any address in the block
+ * @param[out] dirty Whether the block was dirty; may be NULL
+ *
+ * @return true if the block was cached, false otherwise
+ */
+bool csim_invalidate(csim_cache_t *cache, unsigned long addr, bool *dirty) {
+    unsigned long block = addr >> cache->b;
+    unsigned long set_index = sim_set(cache, block);
+    size_t line = set_index * (size_t)cache->E;
+    size_t word = set_index * cache->W;
+    int found = cache_lookup(cache, line, word, block);
+    if (found < 0) {
+        return false;
+    }
+
+    way_t way = (way_t)found;
+    if (cache->E > 1 || policy_keeps_stats(cache->policy)) {
+        policy_remove(cache, set_index, line, way);
+    }
+    bool was_dirty = bit_test(cache->dirty, word, way);
+    if (was_dirty) {
+        bit_clear(cache->dirty, word, way);
+        cache->stats.dirty_bytes -= 1UL << cache->b;
+    }
+    if (dirty != NULL) {
+        *dirty = was_dirty;
+    }
+    bit_clear(cache->valid, word, way);
+    if (cache->use_map) {
+        blockmap_remove(&cache->map, block);
+    }
+    cache->meta[set_index].count--;
+    cache->holes = true;
+    return true;
+}
+
+/**
+ * @brief Prefetch the state of a set that is about to be accessed
+ *
+ * Only the state the lookup reads is prefetched: the set's metadata, its
+ * valid bitmap and the first host cache line of its block addresses. The
+ * recency list and dirty bits are only touched once the lookup resolves,
+ * and prefetching them too was measured to cost more than it saved, as
+ * it competes with demand misses for the host's line fill buffers. The
+ * block map of a highly associative cache is not prefetched.
+ */
+static inline void sim_prefetch_set(const csim_cache_t *cache,
+                                    unsigned long set_index) {
+    size_t line = set_index * (size_t)cache->E;
+    size_t word = set_index * cache->W;
+    __builtin_prefetch(&cache->meta[set_index], 1);
+    __builtin_prefetch(&cache->blocks[line], 1);
+    __builtin_prefetch(&cache->valid[word], 1);
+}
+
+/**
+ * @brief Simulate a batch of accesses in order
+ *
+ * This gives the same statistics as calling csim_access() on each access,
+ * but selects the kernel once for the whole batch. Caches with a write
+ * policy other than write-back and write-allocate, with a buffer, or that
+ * split accesses simulate each access with csim_access() instead, and
+ * hashed or non-power-of-two indexes are computed for each access without
+ * prefetching. Otherwise, if the cache is too big to stay in the host's
+ * caches, the set indices of BATCH_CHUNK accesses are computed up front,
+ * and each set is prefetched PREFETCH_DISTANCE accesses before it is
+ * simulated, so that its memory latency overlaps the simulation of the
+ * accesses before it.
+ */
+void csim_access_batch(csim_cache_t *cache, const access_t *ops, size_t n) {
+    sim_kernel_fn kernel = cache->kernel;
+    int b = cache->b;
+    unsigned long set_mask = (1UL << cache->s) - 1;
+    unsigned long modifies = 0;
+
+    if (cache->slow) {
+        /* Accesses within one block need no splitting */
+        unsigned long B = 1UL << b;
+        for (size_t i = 0; i < n; i++) {
+            if (cache->writes_slow ||
+                (ops[i].addr & (B - 1)) + ops[i].size > B) {
+                sim_slow(cache, &ops[i]);
+                continue;
+            }
+            unsigned long block = ops[i].addr >> b;
+            kernel(cache, sim_set(cache, block), block, op_stores(ops[i].op));
+            modifies += (ops[i].op == 'M');
+        }
+        cache->stats.hits += modifies;
+        return;
+    }
+    if (cache->hashed) {
+        for (size_t i = 0; i < n; i++) {
+            unsigned long block = ops[i].addr >> b;
+            kernel(cache, index_hash(cache, block), block,
+                   op_stores(ops[i].op));
+            modifies += (ops[i].op == 'M');
+        }
+        cache->stats.hits += modifies;
+        return;
+    }
+    if (!cache->prefetch) {
+        for (size_t i = 0; i < n; i++) {
+            unsigned long block = ops[i].addr >> b;
+            kernel(cache, block & set_mask, block, op_stores(ops[i].op));
+            modifies += (ops[i].op == 'M');
+        }
+        cache->stats.hits += modifies;
+        return;
+    }
+
+    unsigned long blocks[BATCH_CHUNK];
+    for (size_t start = 0; start < n; start += BATCH_CHUNK) {
+        const access_t *chunk = &ops[start];
+        size_t m = (n - start < BATCH_CHUNK) ? n - start : BATCH_CHUNK;
+        for (size_t i = 0; i < m; i++) {
+            blocks[i] = chunk[i].addr >> b;
+        }
+        for (size_t i = 0; i < m && i < PREFETCH_DISTANCE; i++) {
+            sim_prefetch_set(cache, blocks[i] & set_mask);
+        }
+        for (size_t i = 0; i < m; i++) {
+            if (i + PREFETCH_DISTANCE < m) {
+                sim_prefetch_set(cache,
+                                 blocks[i + PREFETCH_DISTANCE] & set_mask);
+            }
+            kernel(cache, blocks[i] & set_mask, blocks[i],
+                   op_stores(chunk[i].op));
+            modifies += (chunk[i].op == 'M');
+        }
+    }
+    cache->stats.hits += modifies;
+}
+
+/**
+ * @brief Copy the statistics of all accesses simulated so far
+ *
+ * @param[out] stats Hits, misses and evictions so far, and the dirty bytes
+ *                   currently in the cache and evicted so far
+ */
+void csim_get_stats(const csim_cache_t *cache, csim_stats_t *stats) {
+    *stats = cache->stats;
+}
+
+/**
+ * @brief Copy the statistics of the writes to memory so far
+ *
+ * A write-back, write-allocate cache without a buffer only writes its
+ * dirty victims to memory, one block at a time.
+ *
+ * @param[out] stats Writes and bytes that reached memory, writes combined
+ *                   in the buffer, and bytes left in it
+ */
+void csim_get_write_stats(const csim_cache_t *cache,
+                          csim_write_stats_t *stats) {
+    if (!cache->writes_slow) {
+        stats->writes = cache->stats.dirty_evictions >> cache->b;
+        stats->bytes = cache->stats.dirty_evictions;
+        stats->combined = 0;
+        stats->buffered = 0;
+        return;
+    }
+    *stats = cache->writes;
+    for (size_t i = 0; i < cache->wcb_count; i++) {
+        size_t entry = (cache->wcb_oldest + i) % cache->wcb_entries;
+        stats->buffered +=
+            (unsigned long)__builtin_popcountll(cache->wcb_chunks[entry])
+            << wcb_chunk_bits(cache);
+    }
+}
+
+/**
+ * @brief Copy the leader set statistics of a set-dueling policy
+ *
+ * @param[out] stats Hits and misses of the leader sets of each policy, and
+ *                   the final policy selector
+ *
+ * @return true on success, false if the cache's policy does not duel
+ */
+bool csim_get_duel_stats(const csim_cache_t *cache, csim_duel_stats_t *stats) {
+    if (cache->policy != POLICY_DRRIP) {
+        return false;
+    }
+    *stats = cache->duel;
+    return true;
+}
+
+/**
+ * @brief Copy the ghost list statistics of the ARC or LFU policy
+ *
+ * @param[out] stats Hits in each ghost list, and for ARC the sum of the
+ *                   sets' target sizes of T1
+ *
+ * @return true on success, false if the cache's policy has no ghost lists
+ */
+bool csim_get_ghost_stats(const csim_cache_t *cache,
+                          csim_ghost_stats_t *stats) {
+    if (cache->policy != POLICY_ARC && cache->policy != POLICY_LFU) {
+        return false;
+    }
+    *stats = cache->ghosts;
+    if (cache->policy == POLICY_ARC) {
+        for (size_t set = 0; set < cache->sets; set++) {
+            stats->target += cache->lists[set].target;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Name of the simulation kernel a cache uses
+ *
+ * @return "generic", or the name of a kernel specialized for the cache
+ */
+const char *csim_kernel_name(const csim_cache_t *cache) {
+    return cache->kernel_name;
+}
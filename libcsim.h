@@ -0,0 +1,186 @@
+/**
+ * @file libcsim.h
+ * @brief Prototypes for the reentrant cache simulator library
+ *
+ * Every simulated cache is an independent csim_cache_t with its own
+ * statistics, so any number of caches can be simulated in one process, and
+ * different caches may be used from different threads at the same time.
+ * A single cache must not be accessed from two threads at once.
+ */
+
+#ifndef CSIM_LIBCSIM_H
+#define CSIM_LIBCSIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cachelab.h"
+#include "trace.h"
+
+/** @brief Largest supported associativity */
+#define CSIM_MAX_ASSOC 65535
+
+/** @brief Largest number of sets other than 2^s with modulo indexing */
+#define CSIM_MAX_SETS (1UL << 32)
+
+/** @brief Largest supported write-combining buffer, in entries */
+#define CSIM_MAX_WRITE_BUFFER 4096
+
+/** @brief Opaque simulated cache */
+typedef struct csim_cache csim_cache_t;
+
+/**
+ * @brief Outcome of a simulated access
+ */
+typedef enum {
+    CSIM_HIT,           /* block was present */
+    CSIM_MISS,          /* block was loaded into an empty line */
+    CSIM_MISS_EVICTION, /* block replaced another block */
+} csim_result_t;
+
+/**
+ * @brief A block evicted by an access or a fill
+ */
+typedef struct {
+    unsigned long addr; /* address of the first byte of the block */
+    bool dirty;         /* whether the block was dirty */
+} csim_eviction_t;
+
+/**
+ * @brief Function mapping a block to its set
+ */
+typedef enum {
+    CSIM_INDEX_MODULO, /* block number modulo the number of sets */
+    CSIM_INDEX_XOR,    /* XOR of the s-bit fields of the block, modulo sets */
+    CSIM_INDEX_PRIME,  /* modulo the largest prime up to the number of sets */
+    CSIM_INDEX_SKEW,   /* a hash per way; only simulated by skew.h */
+} csim_index_t;
+
+/**
+ * @brief Parameters of a simulated cache
+ *
+ * Zero-initialize the struct and set s, E and b; every other field
+ * defaults to the fastest implementation for the host, and to a
+ * write-back, write-allocate cache without a write-combining buffer that
+ * only accesses the block of an access's first byte, and whose set is the
+ * low s bits of the block number.
+ */
+typedef struct {
+    int s;                  /* Number of set index bits */
+    int E;                  /* Associativity (number of lines per set) */
+    int b;                  /* Number of block bits */
+    const char *policy;     /* replacement policy name, or NULL for "lru" */
+    const char *lookup;     /* set lookup kernel (see tagmatch.h), or NULL */
+    bool generic;           /* never use a kernel specialized for E */
+    bool write_through;     /* stores also write memory; lines stay clean */
+    bool no_write_allocate; /* stores that miss write memory only */
+    int write_buffer;       /* write-combining buffer entries, or 0 */
+    bool split;             /* access every block an access spans */
+    unsigned long sets;     /* number of sets if not 0, instead of 2^s */
+    csim_index_t index;     /* function mapping blocks to sets */
+} csim_config_t;
+
+/**
+ * @brief Writes from a cache to memory
+ *
+ * Writes combined in the write-combining buffer reach memory as a single
+ * write when their entry is flushed, and bytes written more than once
+ * while buffered are only counted once.
+ */
+typedef struct {
+    unsigned long writes;   /* writes that reached memory */
+    unsigned long bytes;    /* bytes written to memory */
+    unsigned long combined; /* writes merged into a buffered one */
+    unsigned long buffered; /* bytes still in the buffer at the end */
+} csim_write_stats_t;
+
+/**
+ * @brief Performance of the leader sets of a set-dueling policy
+ *
+ * Index 0 is the team of leader sets that always use policy[0], and index
+ * 1 the team that always uses policy[1]. The other sets follow policy[1]
+ * while psel is above psel_max / 2.
+ */
+typedef struct {
+    const char *policy[2];   /* policy of each team */
+    unsigned long sets[2];   /* number of leader sets of each team */
+    unsigned long hits[2];   /* hits in the leader sets of each team */
+    unsigned long misses[2]; /* misses in the leader sets of each team */
+    unsigned psel;           /* policy selector at the end */
+    unsigned psel_max;       /* value at which psel saturates */
+} csim_duel_stats_t;
+
+/**
+ * @brief Hits in the ghost lists of the ARC and LFU policies
+ *
+ * A ghost list remembers blocks recently evicted from a set, and a ghost
+ * hit is a miss on one of them. ARC has two: B1, for blocks evicted after
+ * a single access, and B2, for blocks accessed more often. LFU has one.
+ */
+typedef struct {
+    int lists;             /* number of ghost lists: 2 for ARC, 1 for LFU */
+    unsigned long hits[2]; /* ghost hits in each list */
+    unsigned long target;  /* sum over the sets of ARC's target size of T1 */
+} csim_ghost_stats_t;
+
+/** @brief Names of the replacement policies, for csim_config_t */
+#define CSIM_POLICIES                                                          \
+    "lru, fifo, random, plru, bitplru, nru, srrip, brrip, drrip, arc, lfu"
+
+/** @brief Whether a replacement policy exists (NULL means LRU) */
+bool csim_policy_exists(const char *name);
+
+/** @brief Whether a policy simulates every set independently of the others */
+bool csim_policy_per_set(const char *name);
+
+/** @brief Names of the set index functions, for csim_index_parse() */
+#define CSIM_INDEX_FUNCTIONS "modulo, xor, prime, skew"
+
+/** @brief Look up a set index function by name; false if there is none */
+bool csim_index_parse(const char *name, csim_index_t *index);
+
+/** @brief Number of sets a configuration gives, 0 if it is invalid */
+unsigned long csim_config_sets(const csim_config_t *config);
+
+/** @brief Create an empty cache; returns NULL if invalid or out of memory */
+csim_cache_t *csim_create(const csim_config_t *config);
+
+/** @brief Free all memory used by a cache */
+void csim_destroy(csim_cache_t *cache);
+
+/** @brief Simulate one access */
+csim_result_t csim_access(csim_cache_t *cache, const access_t *op);
+
+/** @brief Simulate one access, reporting the block it evicted, if any */
+csim_result_t csim_access_evict(csim_cache_t *cache, const access_t *op,
+                                csim_eviction_t *evicted);
+
+/** @brief Put a block in the cache without counting a hit or miss */
+csim_result_t csim_fill(csim_cache_t *cache, unsigned long addr, bool dirty,
+                        csim_eviction_t *evicted);
+
+/** @brief Whether a block is cached, without counting an access */
+bool csim_contains(const csim_cache_t *cache, unsigned long addr);
+
+/** @brief Remove a block from the cache; returns whether it was cached */
+bool csim_invalidate(csim_cache_t *cache, unsigned long addr, bool *dirty);
+
+/** @brief Simulate n accesses in order */
+void csim_access_batch(csim_cache_t *cache, const access_t *ops, size_t n);
+
+/** @brief Copy the statistics of all accesses simulated so far */
+void csim_get_stats(const csim_cache_t *cache, csim_stats_t *stats);
+
+/** @brief Copy the statistics of the writes to memory so far */
+void csim_get_write_stats(const csim_cache_t *cache, csim_write_stats_t *stats);
+
+/** @brief Copy leader set statistics; false if the policy does not duel */
+bool csim_get_duel_stats(const csim_cache_t *cache, csim_duel_stats_t *stats);
+
+/** @brief Copy ghost list statistics; false if the policy has none */
+bool csim_get_ghost_stats(const csim_cache_t *cache, csim_ghost_stats_t *stats);
+
+/** @brief Name of the simulation kernel a cache uses */
+const char *csim_kernel_name(const csim_cache_t *cache);
+
+#endif /* CSIM_LIBCSIM_H */
@@ -0,0 +1,269 @@
+/**
+ * @file mrc.c
+ * @brief Miss ratio curves with SHARDS spatial sampling
+ *
+ * The miss ratio curve of a trace gives the miss ratio of a fully
+ * associative LRU cache as a function of its size. It follows from the
+ * stack distances of the trace, but tracking every block is too slow and
+ * too large for very long traces. Instead, as in SHARDS (Waldspurger et
+ * al., FAST '15), only blocks whose hash falls below a threshold T out of
+ * MRC_MODULUS are tracked. That samples a fraction R = T / MRC_MODULUS of
+ * the blocks, and with them about R of the distinct blocks between two
+ * accesses, so sampled distances are scaled up by 1 / R and each sampled
+ * access stands for 1 / R accesses.
+ *
+ * With a fixed rate, memory still grows with the number of distinct blocks.
+ * The fixed-size variant keeps at most max_blocks blocks: when one more is
+ * sampled, the blocks with the largest hash are dropped and T is lowered
+ * to that hash, so the rate adapts to the trace. Accesses keep the weight
+ * of the rate they were sampled at.
+ *
+ * The sampled accesses weigh N in all on average, for N accesses, but
+ * a few hot blocks that are sampled or not move the total a long way.
+ * Miss ratios are the weight of the sampled misses over N, rather than
+ * over the total weight, and are clamped to 1. This is plain SHARDS
+ * normalized by the access count, not SHARDS_adj, which moves the
+ * difference into the first bin of the histogram instead.
+ *
+ * Sampled distances are multiples of 1 / R, so the curve is flat below
+ * about 1 / R blocks: a reuse after fewer distinct blocks is usually
+ * seen at distance 0.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "mrc.h"
+#include "stackdist.h"
+
+/** @brief Range of the hash values that thresholds are compared against */
+#define MRC_MODULUS (1UL << 24)
+
+/**
+ * @brief A sampled block and its hash
+ */
+typedef struct {
+    unsigned long hash;  /* hash of the block, below MRC_MODULUS */
+    unsigned long block; /* block address */
+} mrc_entry_t;
+
+/**
+ * @brief Miss ratio curve builder
+ *
+ * Distances are binned by the bit length of their scaled value, so bin
+ * i > 0 holds distances in [2^(i-1), 2^i), and an access misses in a
+ * cache of 2^j blocks exactly when its bin is above j.
+ */
+struct mrc {
+    stackdist_t *sd;           /* distances between sampled blocks */
+    unsigned long threshold;   /* blocks with a smaller hash are sampled */
+    unsigned long max_blocks;  /* most blocks to sample, or 0 for no limit */
+    mrc_entry_t *heap;         /* max-heap by hash of the sampled blocks */
+    size_t heap_len;           /* number of entries in heap */
+    size_t heap_cap;           /* capacity of heap */
+    double hist[MRC_POINTS];   /* weight of sampled accesses by bin */
+    double cold;               /* weight of sampled first accesses */
+    unsigned long accesses;    /* number of accesses, sampled or not */
+};
+
+/**
+ * @brief Hash a block address (the splitmix64 finalizer)
+ */
+static inline unsigned long mrc_hash(unsigned long block) {
+    block ^= block >> 30;
+    block *= 0xbf58476d1ce4e5b9UL;
+    block ^= block >> 27;
+    block *= 0x94d049bb133111ebUL;
+    block ^= block >> 31;
+    return block & (MRC_MODULUS - 1);
+}
+
+/**
+ * @brief Create a miss ratio curve builder
+ *
+ * @param[in] rate       Fraction of blocks to sample, in (0, 1]; 1 gives
+ *                       the exact curve
+ * @param[in] max_blocks If nonzero, sample at most this many blocks,
+ *                       starting at the given rate and lowering it as
+ *                       needed
+ *
+ * @return The new builder, or NULL if memory allocation failed
+ */
+mrc_t *mrc_create(double rate, unsigned long max_blocks) {
+    mrc_t *mrc = (mrc_t *)calloc(1, sizeof(mrc_t));
+    if (mrc == NULL) {
+        return NULL;
+    }
+    mrc->sd = stackdist_create(0);
+    if (mrc->sd == NULL) {
+        free(mrc);
+        return NULL;
+    }
+    mrc->threshold = (unsigned long)(rate * (double)MRC_MODULUS + 0.5);
+    if (mrc->threshold == 0) {
+        mrc->threshold = 1;
+    } else if (mrc->threshold > MRC_MODULUS) {
+        mrc->threshold = MRC_MODULUS;
+    }
+    mrc->max_blocks = max_blocks;
+    return mrc;
+}
+
+/**
+ * @brief Free all memory used by a builder
+ */
+void mrc_destroy(mrc_t *mrc) {
+    stackdist_destroy(mrc->sd);
+    free(mrc->heap);
+    free(mrc);
+}
+
+/**
+ * @brief Add a sampled block to the heap
+ *
+ * @return true on success, false if memory allocation failed
+ */
+static bool mrc_heap_push(mrc_t *mrc, unsigned long hash,
+                          unsigned long block) {
+    if (mrc->heap_len == mrc->heap_cap) {
+        size_t cap = (mrc->heap_cap == 0) ? 64 : 2 * mrc->heap_cap;
+        mrc_entry_t *heap =
+            (mrc_entry_t *)realloc(mrc->heap, cap * sizeof(mrc_entry_t));
+        if (heap == NULL) {
+            return false;
+        }
+        mrc->heap = heap;
+        mrc->heap_cap = cap;
+    }
+    size_t i = mrc->heap_len++;
+    while (i > 0 && mrc->heap[(i - 1) / 2].hash < hash) {
+        mrc->heap[i] = mrc->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    mrc->heap[i] = (mrc_entry_t){hash, block};
+    return true;
+}
+
+/**
+ * @brief Remove the sampled block with the largest hash from the heap
+ */
+static mrc_entry_t mrc_heap_pop(mrc_t *mrc) {
+    mrc_entry_t top = mrc->heap[0];
+    mrc_entry_t last = mrc->heap[--mrc->heap_len];
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= mrc->heap_len) {
+            break;
+        }
+        if (child + 1 < mrc->heap_len &&
+            mrc->heap[child + 1].hash > mrc->heap[child].hash) {
+            child++;
+        }
+        if (mrc->heap[child].hash <= last.hash) {
+            break;
+        }
+        mrc->heap[i] = mrc->heap[child];
+        i = child;
+    }
+    if (mrc->heap_len > 0) {
+        mrc->heap[i] = last;
+    }
+    return top;
+}
+
+/**
+ * @brief Bin of a scaled stack distance
+ */
+static inline int mrc_bin(double distance) {
+    if (distance < 1.0) {
+        return 0;
+    }
+    int bin = 64 - __builtin_clzl((unsigned long)distance);
+    return (bin < MRC_POINTS) ? bin : MRC_POINTS - 1;
+}
+
+/**
+ * @brief Record an access to a block
+ *
+ * @return true on success, false if memory allocation failed
+ */
+bool mrc_access(mrc_t *mrc, unsigned long block) {
+    mrc->accesses++;
+    unsigned long hash = mrc_hash(block);
+    if (hash >= mrc->threshold) {
+        return true;
+    }
+
+    double scale = (double)MRC_MODULUS / (double)mrc->threshold;
+    unsigned long distance;
+    if (!stackdist_access(mrc->sd, block, &distance)) {
+        return false;
+    }
+    if (distance != STACKDIST_COLD) {
+        mrc->hist[mrc_bin((double)distance * scale)] += scale;
+        return true;
+    }
+
+    mrc->cold += scale;
+    if (mrc->max_blocks == 0) {
+        return true;
+    }
+    if (!mrc_heap_push(mrc, hash, block)) {
+        return false;
+    }
+    while (mrc->heap_len > mrc->max_blocks) {
+        /* Stop sampling the largest hash, and every block that has it */
+        mrc->threshold = mrc->heap[0].hash;
+        while (mrc->heap_len > 0 && mrc->heap[0].hash >= mrc->threshold) {
+            stackdist_remove(mrc->sd, mrc_heap_pop(mrc).block);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Compute the miss ratio curve of the accesses so far
+ *
+ * @param[out] miss_ratio Miss ratio of a cache of 2^i blocks, for each i
+ *                        below the returned count
+ *
+ * @return Number of points computed, up to the first cache size at which
+ *         only cold misses remain
+ */
+int mrc_curve(const mrc_t *mrc, double miss_ratio[MRC_POINTS]) {
+    int points = 1;
+    for (int i = 0; i < MRC_POINTS; i++) {
+        if (mrc->hist[i] > 0.0) {
+            points = (i + 1 < MRC_POINTS) ? i + 1 : MRC_POINTS;
+        }
+    }
+    double misses = mrc->cold;
+    for (int i = 1; i < MRC_POINTS; i++) {
+        misses += mrc->hist[i];
+    }
+    for (int i = 0; i < points; i++) {
+        /* A sample heavier than N can weigh more misses than accesses */
+        double ratio =
+            (mrc->accesses > 0) ? misses / (double)mrc->accesses : 0.0;
+        miss_ratio[i] = (ratio < 1.0) ? ratio : 1.0;
+        if (i + 1 < MRC_POINTS) {
+            misses -= mrc->hist[i + 1];
+        }
+    }
+    return points;
+}
+
+/**
+ * @brief Current sampling rate
+ */
+double mrc_rate(const mrc_t *mrc) {
+    return (double)mrc->threshold / (double)MRC_MODULUS;
+}
+
+/**
+ * @brief Number of distinct blocks currently sampled
+ */
+unsigned long mrc_sampled(const mrc_t *mrc) {
+    return stackdist_blocks(mrc->sd, 0);
+}
@@ -0,0 +1,35 @@
+/**
+ * @file mrc.h
+ * @brief Prototypes for miss ratio curves with spatial sampling
+ */
+
+#ifndef CSIM_MRC_H
+#define CSIM_MRC_H
+
+#include <stdbool.h>
+
+/** @brief Number of points in a curve: caches of 2^0 to 2^63 blocks */
+#define MRC_POINTS 64
+
+/** @brief Opaque miss ratio curve builder */
+typedef struct mrc mrc_t;
+
+/** @brief Create a builder; max_blocks > 0 bounds the blocks sampled */
+mrc_t *mrc_create(double rate, unsigned long max_blocks);
+
+/** @brief Free all memory used by a builder */
+void mrc_destroy(mrc_t *mrc);
+
+/** @brief Record an access to a block; returns false if memory ran out */
+bool mrc_access(mrc_t *mrc, unsigned long block);
+
+/** @brief Miss ratios of caches of 2^i blocks; returns points computed */
+int mrc_curve(const mrc_t *mrc, double miss_ratio[MRC_POINTS]);
+
+/** @brief Current sampling rate */
+double mrc_rate(const mrc_t *mrc);
+
+/** @brief Number of distinct blocks currently sampled */
+unsigned long mrc_sampled(const mrc_t *mrc);
+
+#endif /* CSIM_MRC_H */
@@ -0,0 +1,404 @@
+/**
+ * @file opt.c
+ * @brief Belady's optimal (OPT) replacement, from precomputed next uses
+ *
+ * OPT evicts the line whose block is next used farthest in the future,
+ * which gives the fewest misses any replacement policy can reach. The next
+ * use of every access is computed first, by a backward pass over the trace
+ * with a map from each block to the earliest of its accesses seen so far.
+ * The forward pass then simulates the cache, keeping the lines of each set
+ * in a max-heap by next use, so the victim is at the root and each hit or
+ * eviction costs O(log E).
+ *
+ * Indexed binary traces are processed in windows of a fixed number of
+ * accesses, so that only the map of distinct blocks, the cache and one
+ * window need to fit in memory: the backward pass visits the windows from
+ * last to first and spills their next uses to a temporary file, which the
+ * forward pass reads back in order. Other traces cannot seek, and are read
+ * whole into memory as a single window.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "blockmap.h"
+#include "opt.h"
+
+/** @brief Next use of an access whose block is never accessed again */
+#define OPT_NEVER (~0UL)
+
+/**
+ * @brief OPT cache
+ *
+ * Way i of set k is line k * E + i, and the ways of a set fill in order.
+ * The heap of a set holds the ways of its valid lines, with the way whose
+ * block is next used farthest in the future at the root.
+ */
+struct opt {
+    int s;                 /* number of set index bits */
+    int E;                 /* associativity */
+    int b;                 /* number of block bits */
+    size_t window;         /* accesses per window of a binary trace */
+    unsigned long *blocks; /* block in each line */
+    unsigned long *next;   /* next use of the block in each line */
+    uint16_t *heap;        /* ways of each set, max-heap by next use */
+    uint16_t *pos;         /* position of each line in its set's heap */
+    uint16_t *count;       /* number of valid lines in each set */
+    unsigned char *dirty;  /* whether each line is dirty */
+    blockmap_t where;      /* line holding each cached block */
+    csim_stats_t stats;    /* statistics so far */
+};
+
+/**
+ * @brief Create an empty OPT cache
+ *
+ * @param[in] config Parameters of the cache; the policy is ignored
+ * @param[in] window Number of accesses per window of a binary trace
+ *
+ * @return The new cache, or NULL if the parameters are invalid or memory
+ *         allocation failed
+ */
+opt_t *opt_create(const csim_config_t *config, size_t window) {
+    int s = config->s;
+    int E = config->E;
+    int b = config->b;
+    if (s < 0 || b < 0 || s + b >= 64 || E <= 0 || E > CSIM_MAX_ASSOC ||
+        window == 0) {
+        return NULL;
+    }
+    size_t S = 1UL << s;
+    if (s >= 48 || S > SIZE_MAX / (size_t)E) {
+        return NULL;
+    }
+    size_t lines = S * (size_t)E;
+
+    opt_t *opt = (opt_t *)calloc(1, sizeof(opt_t));
+    if (opt == NULL) {
+        return NULL;
+    }
+    opt->s = s;
+    opt->E = E;
+    opt->b = b;
+    opt->window = window;
+    opt->blocks = (unsigned long *)calloc(lines, sizeof(unsigned long));
+    opt->next = (unsigned long *)calloc(lines, sizeof(unsigned long));
+    opt->heap = (uint16_t *)calloc(lines, sizeof(uint16_t));
+    opt->pos = (uint16_t *)calloc(lines, sizeof(uint16_t));
+    opt->count = (uint16_t *)calloc(S, sizeof(uint16_t));
+    opt->dirty = (unsigned char *)calloc(lines, 1);
+    if (opt->blocks == NULL || opt->next == NULL || opt->heap == NULL ||
+        opt->pos == NULL || opt->count == NULL || opt->dirty == NULL ||
+        !blockmap_init(&opt->where, 0)) {
+        free(opt->blocks);
+        free(opt->next);
+        free(opt->heap);
+        free(opt->pos);
+        free(opt->count);
+        free(opt->dirty);
+        free(opt);
+        return NULL;
+    }
+    return opt;
+}
+
+/**
+ * @brief Free all memory used by a simulator
+ */
+void opt_destroy(opt_t *opt) {
+    blockmap_destroy(&opt->where);
+    free(opt->blocks);
+    free(opt->next);
+    free(opt->heap);
+    free(opt->pos);
+    free(opt->count);
+    free(opt->dirty);
+    free(opt);
+}
+
+/**
+ * @brief Next use of the line at a position of a set's heap
+ *
+ * @param[in] base Index of the set's way 0 in the line arrays
+ */
+static inline unsigned long heap_key(const opt_t *opt, size_t base,
+                                     size_t i) {
+    return opt->next[base + opt->heap[base + i]];
+}
+
+/**
+ * @brief Swap two positions of a set's heap, keeping pos up to date
+ */
+static inline void heap_swap(opt_t *opt, size_t base, size_t i, size_t j) {
+    uint16_t a = opt->heap[base + i];
+    uint16_t c = opt->heap[base + j];
+    opt->heap[base + i] = c;
+    opt->heap[base + j] = a;
+    opt->pos[base + c] = (uint16_t)i;
+    opt->pos[base + a] = (uint16_t)j;
+}
+
+/**
+ * @brief Move a line up a set's heap after its next use grew
+ */
+static void heap_sift_up(opt_t *opt, size_t base, size_t i) {
+    while (i > 0 && heap_key(opt, base, (i - 1) / 2) < heap_key(opt, base, i)) {
+        heap_swap(opt, base, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+/**
+ * @brief Move the root of a set's heap down after its line was replaced
+ *
+ * @param[in] n Number of lines in the heap
+ */
+static void heap_sift_down(opt_t *opt, size_t base, size_t n) {
+    size_t i = 0;
+    for (;;) {
+        size_t largest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < n && heap_key(opt, base, left) > heap_key(opt, base, i)) {
+            largest = left;
+        }
+        if (right < n &&
+            heap_key(opt, base, right) > heap_key(opt, base, largest)) {
+            largest = right;
+        }
+        if (largest == i) {
+            return;
+        }
+        heap_swap(opt, base, i, largest);
+        i = largest;
+    }
+}
+
+/**
+ * @brief Simulate one access
+ *
+ * @param[in] next_use Index of the next access to the same block, or
+ *                     OPT_NEVER
+ *
+ * @return true on success, false if memory allocation failed
+ */
+static bool opt_access(opt_t *opt, const access_t *op,
+                       unsigned long next_use) {
+    unsigned long B = 1UL << opt->b;
+    unsigned long block = op->addr >> opt->b;
+    size_t set = block & ((1UL << opt->s) - 1);
+    size_t base = set * (size_t)opt->E;
+    bool store = (op->op == 'S' || op->op == 'M');
+    unsigned long line;
+
+    /* The store of a modify hits the block its load brought in */
+    opt->stats.hits += (op->op == 'M');
+
+    if (blockmap_get(&opt->where, block, &line)) {
+        opt->stats.hits++;
+        opt->next[line] = next_use;
+        heap_sift_up(opt, base, opt->pos[line]);
+        if (store && !opt->dirty[line]) {
+            opt->dirty[line] = 1;
+            opt->stats.dirty_bytes += B;
+        }
+        return true;
+    }
+
+    opt->stats.misses++;
+    size_t n = opt->count[set];
+    if (n < (size_t)opt->E) {
+        line = base + n;
+        opt->heap[base + n] = (uint16_t)n;
+        opt->pos[line] = (uint16_t)n;
+        opt->count[set]++;
+        opt->blocks[line] = block;
+        opt->next[line] = next_use;
+        heap_sift_up(opt, base, n);
+        if (store) {
+            opt->dirty[line] = 1;
+            opt->stats.dirty_bytes += B;
+        }
+        return blockmap_put(&opt->where, block, line);
+    }
+
+    opt->stats.evictions++;
+    line = base + opt->heap[base];
+    blockmap_remove(&opt->where, opt->blocks[line]);
+    opt->blocks[line] = block;
+    opt->next[line] = next_use;
+    heap_sift_down(opt, base, n);
+    if (opt->dirty[line]) {
+        opt->stats.dirty_evictions += B;
+    }
+    if (opt->dirty[line] && !store) {
+        opt->dirty[line] = 0;
+        opt->stats.dirty_bytes -= B;
+    } else if (!opt->dirty[line] && store) {
+        opt->dirty[line] = 1;
+        opt->stats.dirty_bytes += B;
+    }
+    return blockmap_put(&opt->where, block, line);
+}
+
+/**
+ * @brief Compute the next use of every access of a window, last first
+ *
+ * @param[in,out] last  Index of the earliest access to each block after
+ *                      the window; on return, from the window's start
+ * @param[in]     first Index of the window's first access in the trace
+ * @param[out]    uses  Next use of each access of the window
+ *
+ * @return true on success, false if memory allocation failed
+ */
+static bool opt_next_uses(const opt_t *opt, blockmap_t *last,
+                          const access_t *ops, size_t n, unsigned long first,
+                          unsigned long *uses) {
+    for (size_t i = n; i-- > 0;) {
+        unsigned long block = ops[i].addr >> opt->b;
+        if (!blockmap_get(last, block, &uses[i])) {
+            uses[i] = OPT_NEVER;
+        }
+        if (!blockmap_put(last, block, first + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Decode exactly n records
+ *
+ * @return true on success, false on a malformed or missing record
+ */
+static bool opt_read(trace_t *trace, access_t *ops, size_t n) {
+    for (size_t used = 0; used < n;) {
+        long got = trace_read(trace, &ops[used], n - used);
+        if (got <= 0) {
+            return false;
+        }
+        used += (size_t)got;
+    }
+    return true;
+}
+
+/**
+ * @brief Simulate a trace read whole into memory
+ */
+static long opt_run_memory(opt_t *opt, trace_t *trace) {
+    access_t *ops;
+    long n = trace_read_all(trace, &ops);
+    if (n < 0) {
+        return n;
+    }
+    unsigned long *uses =
+        (unsigned long *)malloc(((size_t)n + 1) * sizeof(unsigned long));
+    blockmap_t last;
+    long result = -2;
+    if (uses != NULL && blockmap_init(&last, 0)) {
+        if (opt_next_uses(opt, &last, ops, (size_t)n, 0, uses)) {
+            result = n;
+        }
+        blockmap_destroy(&last);
+    }
+    for (long i = 0; result >= 0 && i < n; i++) {
+        if (!opt_access(opt, &ops[i], uses[i])) {
+            result = -2;
+        }
+    }
+    free(uses);
+    free(ops);
+    return result;
+}
+
+/**
+ * @brief Simulate an indexed binary trace one window at a time
+ *
+ * @param[in] records Number of records in the trace
+ */
+static long opt_run_windows(opt_t *opt, trace_t *trace,
+                            unsigned long records) {
+    size_t window = opt->window;
+    access_t *ops = (access_t *)malloc(window * sizeof(access_t));
+    unsigned long *uses =
+        (unsigned long *)malloc(window * sizeof(unsigned long));
+    blockmap_t last;
+    bool have_last = blockmap_init(&last, 0);
+    FILE *spill = tmpfile();
+    long result = 0;
+    if (ops == NULL || uses == NULL || !have_last) {
+        result = -2;
+    } else if (spill == NULL) {
+        result = -3;
+    }
+
+    unsigned long windows = (records + window - 1) / window;
+    for (unsigned long w = windows; result == 0 && w-- > 0;) {
+        unsigned long first = w * window;
+        size_t n = (records - first < window) ? records - first : window;
+        if (!trace_seek(trace, first) || !opt_read(trace, ops, n)) {
+            result = -1;
+        } else if (!opt_next_uses(opt, &last, ops, n, first, uses)) {
+            result = -2;
+        } else if (fseek(spill, (long)(first * sizeof(unsigned long)),
+                         SEEK_SET) != 0 ||
+                   fwrite(uses, sizeof(unsigned long), n, spill) != n) {
+            result = -3;
+        }
+    }
+    if (have_last) {
+        blockmap_destroy(&last);
+    }
+
+    if (result == 0 && fseek(spill, 0, SEEK_SET) != 0) {
+        result = -3;
+    } else if (result == 0 && !trace_seek(trace, 0)) {
+        result = -1;
+    }
+    for (unsigned long first = 0; result == 0 && first < records;
+         first += window) {
+        size_t n = (records - first < window) ? records - first : window;
+        if (!opt_read(trace, ops, n)) {
+            result = -1;
+        } else if (fread(uses, sizeof(unsigned long), n, spill) != n) {
+            result = -3;
+        }
+        for (size_t i = 0; result == 0 && i < n; i++) {
+            if (!opt_access(opt, &ops[i], uses[i])) {
+                result = -2;
+            }
+        }
+    }
+
+    if (spill != NULL) {
+        fclose(spill);
+    }
+    free(ops);
+    free(uses);
+    return (result == 0) ? (long)records : result;
+}
+
+/**
+ * @brief Simulate a whole trace
+ *
+ * @return Number of accesses simulated, -1 if a malformed record was found
+ *         (see trace_line()), -2 if memory allocation failed, or -3 if the
+ *         temporary file of next uses could not be written or read back
+ */
+long opt_run(opt_t *opt, trace_t *trace) {
+    long records = trace_records(trace);
+    if (records < 0) {
+        return opt_run_memory(opt, trace);
+    }
+    return opt_run_windows(opt, trace, (unsigned long)records);
+}
+
+/**
+ * @brief Copy the statistics of the accesses simulated
+ *
+ * @param[out] stats Hits, misses and evictions, and the dirty bytes in the
+ *                   cache at the end and evicted
+ */
+void opt_get_stats(const opt_t *opt, csim_stats_t *stats) {
+    *stats = opt->stats;
+}
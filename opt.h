@@ -0,0 +1,32 @@
+/**
+ * @file opt.h
+ * @brief Prototypes for Belady's optimal (OPT) replacement
+ */
+
+#ifndef CSIM_OPT_H
+#define CSIM_OPT_H
+
+#include <stddef.h>
+
+#include "libcsim.h"
+#include "trace.h"
+
+/** @brief Default number of accesses per window of a binary trace */
+#define OPT_WINDOW (1UL << 20)
+
+/** @brief Opaque OPT simulator */
+typedef struct opt opt_t;
+
+/** @brief Create an empty OPT cache; NULL if invalid or out of memory */
+opt_t *opt_create(const csim_config_t *config, size_t window);
+
+/** @brief Free all memory used by a simulator */
+void opt_destroy(opt_t *opt);
+
+/** @brief Simulate a whole trace; returns accesses, or -1 to -3 on error */
+long opt_run(opt_t *opt, trace_t *trace);
+
+/** @brief Copy the statistics of the accesses simulated */
+void opt_get_stats(const opt_t *opt, csim_stats_t *stats);
+
+#endif /* CSIM_OPT_H */
@@ -0,0 +1,428 @@
+/**
+ * @file prefetch.c
+ * @brief Hardware prefetcher models
+ *
+ * A prefetcher watches the demand accesses of a cache and fetches blocks
+ * it expects to be accessed soon, without a program counter to go by:
+ *
+ * - next: a miss, or the first hit on a prefetched block, fetches the
+ *   next degree blocks (tagged next-N-line prefetching).
+ * - stride: a table of STRIDE_REGIONS entries, one per STRIDE_REGION_BITS
+ *   region of memory, learns the distance between successive accesses to
+ *   each region. Once the same stride is seen twice in a row, every
+ *   access to the region fetches the blocks degree strides ahead of it; a
+ *   stride within one block steps a block at a time instead.
+ * - stream: STREAM_BUFFERS stream buffers, each holding the next degree
+ *   blocks after a miss, outside the cache. A miss that finds its block in
+ *   a buffer moves it into the cache, drops the blocks ahead of it and
+ *   fetches more; one that does not restarts the least recently used
+ *   buffer after it.
+ *
+ * A prefetch arrives latency accesses after the one that issued it, and a
+ * demand access to its block before then is a late prefetch, counted as a
+ * miss. The next and stride prefetchers fill the cache with csim_fill(),
+ * and a prefetched block is useful if a demand access hits it before it
+ * is evicted. A miss on a block last evicted by a prefetch fill counts as
+ * pollution. Blocks already cached or in flight are not prefetched again.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "blockmap.h"
+#include "prefetch.h"
+
+/** @brief Default number of blocks prefetched per trigger */
+#define PREFETCH_DEFAULT_DEGREE 1
+
+/** @brief Log size of the regions the stride prefetcher learns */
+#define STRIDE_REGION_BITS 12
+
+/** @brief Number of regions the stride prefetcher tracks at once */
+#define STRIDE_REGIONS 64
+
+/** @brief Saturation value of a stride's confidence */
+#define STRIDE_MAX_CONFIDENCE 3
+
+/** @brief Number of stream buffers */
+#define STREAM_BUFFERS 4
+
+/** @brief Default number of blocks in each stream buffer */
+#define STREAM_DEFAULT_DEPTH 4
+
+/**
+ * @brief Stride learned for one region
+ */
+typedef struct {
+    bool valid;           /* whether the entry tracks a region */
+    unsigned long region; /* address >> STRIDE_REGION_BITS */
+    unsigned long last;   /* address of the last access to the region */
+    long stride;          /* distance between the last accesses */
+    int confidence;       /* times the stride repeated, less mismatches */
+} region_t;
+
+/**
+ * @brief Stream buffer, holding consecutive blocks
+ */
+typedef struct {
+    unsigned long head;                       /* block of the first entry */
+    int count;                                /* entries in the buffer */
+    int start;                                /* slot of the first entry */
+    unsigned long last_use;                   /* access that last used it */
+    unsigned long ready[PREFETCH_MAX_DEGREE]; /* arrival of each slot */
+} stream_t;
+
+/**
+ * @brief Prefetcher
+ */
+struct prefetch {
+    csim_cache_t *cache;              /* cache it fetches blocks into */
+    prefetch_kind_t kind;             /* which prefetcher */
+    int b;                            /* Number of block bits */
+    int degree;                       /* blocks per trigger or stream */
+    unsigned long latency;            /* accesses a prefetch takes */
+    unsigned long now;                /* demand accesses so far */
+    blockmap_t unused;                /* prefetched blocks not accessed */
+    blockmap_t displaced;             /* blocks a prefetch fill evicted */
+    blockmap_t inflight;              /* queued block -> its arrival */
+    unsigned long *queue_block;       /* queued prefetches, oldest first */
+    unsigned long *queue_ready;       /* arrival of each */
+    size_t queue_size;                /* capacity of the queue */
+    size_t queue_head;                /* slot of the oldest */
+    size_t queue_count;               /* prefetches queued */
+    region_t regions[STRIDE_REGIONS]; /* stride table */
+    stream_t streams[STREAM_BUFFERS]; /* stream buffers */
+    prefetch_stats_t stats;           /* statistics so far */
+};
+
+/**
+ * @brief Look up a prefetcher by name
+ *
+ * @param[out] kind The prefetcher, if it exists
+ *
+ * @return true if name is one of PREFETCH_KINDS, false otherwise
+ */
+bool prefetch_parse(const char *name, prefetch_kind_t *kind) {
+    static const char *const NAMES[] = {
+        [PREFETCH_NEXT] = "next",
+        [PREFETCH_STRIDE] = "stride",
+        [PREFETCH_STREAM] = "stream",
+    };
+    for (size_t i = 0; i < sizeof(NAMES) / sizeof(NAMES[0]); i++) {
+        if (strcmp(name, NAMES[i]) == 0) {
+            *kind = (prefetch_kind_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Attach a prefetcher to a cache
+ *
+ * The prefetcher does not own the cache, whose statistics keep counting
+ * the demand accesses simulated through prefetch_access().
+ *
+ * @return The prefetcher, or NULL if config is invalid or out of memory
+ */
+prefetch_t *prefetch_create(csim_cache_t *cache,
+                            const prefetch_config_t *config) {
+    if (config->degree < 0 || config->degree > PREFETCH_MAX_DEGREE ||
+        config->latency > PREFETCH_MAX_LATENCY || config->b < 0 ||
+        config->b >= 64) {
+        return NULL;
+    }
+    prefetch_t *prefetch = (prefetch_t *)calloc(1, sizeof(prefetch_t));
+    if (prefetch == NULL) {
+        return NULL;
+    }
+    prefetch->cache = cache;
+    prefetch->kind = config->kind;
+    prefetch->b = config->b;
+    prefetch->degree = config->degree;
+    if (prefetch->degree == 0) {
+        prefetch->degree = (config->kind == PREFETCH_STREAM)
+                               ? STREAM_DEFAULT_DEPTH
+                               : PREFETCH_DEFAULT_DEGREE;
+    }
+    prefetch->latency = config->latency;
+
+    /* Each access queues at most degree prefetches, for latency + 1 */
+    prefetch->queue_size =
+        (size_t)prefetch->degree * (size_t)(prefetch->latency + 1);
+    prefetch->queue_block =
+        (unsigned long *)malloc(prefetch->queue_size * sizeof(unsigned long));
+    prefetch->queue_ready =
+        (unsigned long *)malloc(prefetch->queue_size * sizeof(unsigned long));
+    if (prefetch->queue_block == NULL || prefetch->queue_ready == NULL ||
+        !blockmap_init(&prefetch->unused, 0) ||
+        !blockmap_init(&prefetch->displaced, 0) ||
+        !blockmap_init(&prefetch->inflight, 0)) {
+        prefetch_destroy(prefetch);
+        return NULL;
+    }
+    return prefetch;
+}
+
+/**
+ * @brief Free all memory used by a prefetcher, but not its cache
+ */
+void prefetch_destroy(prefetch_t *prefetch) {
+    blockmap_destroy(&prefetch->unused);
+    blockmap_destroy(&prefetch->displaced);
+    blockmap_destroy(&prefetch->inflight);
+    free(prefetch->queue_block);
+    free(prefetch->queue_ready);
+    free(prefetch);
+}
+
+/**
+ * @brief Account for a block evicted from the cache
+ *
+ * @param[in] by_prefetch Whether a prefetch fill evicted it
+ */
+static void prefetch_evicted(prefetch_t *prefetch,
+                             const csim_eviction_t *evicted,
+                             bool by_prefetch) {
+    unsigned long victim = evicted->addr >> prefetch->b;
+    bool was_unused = blockmap_remove(&prefetch->unused, victim);
+    if (by_prefetch && !was_unused) {
+        blockmap_put(&prefetch->displaced, victim, 0);
+    }
+}
+
+/**
+ * @brief Fill the cache with a prefetched block that arrived
+ */
+static void prefetch_fill(prefetch_t *prefetch, unsigned long block) {
+    csim_eviction_t evicted;
+    if (csim_fill(prefetch->cache, block << prefetch->b, false, &evicted) ==
+        CSIM_MISS_EVICTION) {
+        prefetch_evicted(prefetch, &evicted, true);
+    }
+    blockmap_remove(&prefetch->displaced, block);
+    blockmap_put(&prefetch->unused, block, 0);
+}
+
+/**
+ * @brief Issue a prefetch of a block into the cache
+ *
+ * Blocks that are cached or already in flight are skipped.
+ */
+static void prefetch_issue(prefetch_t *prefetch, unsigned long block) {
+    unsigned long ready;
+    if (prefetch->queue_count == prefetch->queue_size ||
+        csim_contains(prefetch->cache, block << prefetch->b) ||
+        blockmap_get(&prefetch->inflight, block, &ready)) {
+        return;
+    }
+    ready = prefetch->now + prefetch->latency + 1;
+    size_t slot = (prefetch->queue_head + prefetch->queue_count) %
+                  prefetch->queue_size;
+    prefetch->queue_block[slot] = block;
+    prefetch->queue_ready[slot] = ready;
+    prefetch->queue_count++;
+    blockmap_put(&prefetch->inflight, block, ready);
+    prefetch->stats.issued++;
+}
+
+/**
+ * @brief Fill the cache with every queued prefetch that has arrived
+ *
+ * A queued prefetch whose block was accessed while in flight is dropped.
+ */
+static void prefetch_arrive(prefetch_t *prefetch) {
+    while (prefetch->queue_count > 0 &&
+           prefetch->queue_ready[prefetch->queue_head] <= prefetch->now) {
+        unsigned long block = prefetch->queue_block[prefetch->queue_head];
+        unsigned long ready = prefetch->queue_ready[prefetch->queue_head];
+        prefetch->queue_head =
+            (prefetch->queue_head + 1) % prefetch->queue_size;
+        prefetch->queue_count--;
+
+        unsigned long queued;
+        if (blockmap_get(&prefetch->inflight, block, &queued) &&
+            queued == ready) {
+            blockmap_remove(&prefetch->inflight, block);
+            prefetch_fill(prefetch, block);
+        }
+    }
+}
+
+/**
+ * @brief Learn the stride of an access's region, and prefetch along it
+ *
+ * @param[in] addr Address of the access
+ */
+static void stride_train(prefetch_t *prefetch, unsigned long addr) {
+    unsigned long number = addr >> STRIDE_REGION_BITS;
+    region_t *region = &prefetch->regions[number % STRIDE_REGIONS];
+    if (!region->valid || region->region != number) {
+        *region = (region_t){.valid = true, .region = number, .last = addr};
+        return;
+    }
+    long delta = (long)(addr - region->last);
+    if (delta == 0) {
+        return;
+    }
+    region->last = addr;
+    if (delta == region->stride) {
+        if (region->confidence < STRIDE_MAX_CONFIDENCE) {
+            region->confidence++;
+        }
+    } else if (region->confidence > 0) {
+        region->confidence--;
+    } else {
+        region->stride = delta;
+    }
+    if (region->confidence == 0) {
+        return;
+    }
+
+    /* Unsigned arithmetic wraps, stepping down for a negative stride */
+    unsigned long B = 1UL << prefetch->b;
+    bool down = (region->stride < 0);
+    unsigned long step = (unsigned long)region->stride;
+    if ((down ? 0 - step : step) < B) {
+        step = down ? 0 - B : B;
+    }
+    for (int k = 1; k <= prefetch->degree; k++) {
+        prefetch_issue(prefetch,
+                       (addr + step * (unsigned long)k) >> prefetch->b);
+    }
+}
+
+/**
+ * @brief Fetch blocks into a stream buffer until it is full
+ */
+static void stream_refill(prefetch_t *prefetch, stream_t *stream) {
+    while (stream->count < prefetch->degree) {
+        int slot = (stream->start + stream->count) % prefetch->degree;
+        stream->ready[slot] = prefetch->now + prefetch->latency + 1;
+        stream->count++;
+        prefetch->stats.issued++;
+    }
+}
+
+/**
+ * @brief Take a missing block from the stream buffers
+ *
+ * The buffer holding the block drops it and the blocks ahead of it, and
+ * fetches as many after its last one.
+ *
+ * @param[out] arrived Whether the block had arrived, if it was found
+ *
+ * @return true if a stream buffer held the block, false otherwise
+ */
+static bool stream_take(prefetch_t *prefetch, unsigned long block,
+                        bool *arrived) {
+    for (int i = 0; i < STREAM_BUFFERS; i++) {
+        stream_t *stream = &prefetch->streams[i];
+        unsigned long k = block - stream->head;
+        if (k >= (unsigned long)stream->count) {
+            continue;
+        }
+        int slot = (stream->start + (int)k) % prefetch->degree;
+        *arrived = (stream->ready[slot] <= prefetch->now);
+        if (*arrived) {
+            prefetch->stats.useful++;
+        } else {
+            prefetch->stats.late++;
+        }
+        stream->head = block + 1;
+        stream->start = (slot + 1) % prefetch->degree;
+        stream->count -= (int)k + 1;
+        stream->last_use = prefetch->now;
+        stream_refill(prefetch, stream);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Restart the least recently used stream buffer after a block
+ */
+static void stream_allocate(prefetch_t *prefetch, unsigned long block) {
+    stream_t *stream = &prefetch->streams[0];
+    for (int i = 1; i < STREAM_BUFFERS; i++) {
+        if (prefetch->streams[i].last_use < stream->last_use) {
+            stream = &prefetch->streams[i];
+        }
+    }
+    stream->head = block + 1;
+    stream->count = 0;
+    stream->start = 0;
+    stream->last_use = prefetch->now;
+    stream_refill(prefetch, stream);
+}
+
+/**
+ * @brief Simulate one demand access and the prefetches it triggers
+ *
+ * @param[in] op The access; 'S' is a store, 'M' a modify, and anything
+ *               else a load
+ *
+ * @return The outcome of the access in the cache; a block taken from a
+ *         stream buffer is a hit
+ */
+csim_result_t prefetch_access(prefetch_t *prefetch, const access_t *op) {
+    csim_cache_t *cache = prefetch->cache;
+    unsigned long block = op->addr >> prefetch->b;
+    csim_eviction_t evicted;
+    prefetch->now++;
+    prefetch_arrive(prefetch);
+
+    unsigned long ready;
+    if (prefetch->queue_count > 0 &&
+        blockmap_get(&prefetch->inflight, block, &ready)) {
+        blockmap_remove(&prefetch->inflight, block);
+        prefetch->stats.late++;
+    }
+    bool streamed = false;
+    bool arrived = false;
+    if (prefetch->kind == PREFETCH_STREAM && !csim_contains(cache, op->addr)) {
+        streamed = stream_take(prefetch, block, &arrived);
+    }
+    if (arrived && csim_fill(cache, op->addr, false, &evicted) ==
+                       CSIM_MISS_EVICTION) {
+        prefetch_evicted(prefetch, &evicted, false);
+    }
+
+    csim_result_t result = csim_access_evict(cache, op, &evicted);
+    if (result == CSIM_MISS_EVICTION) {
+        prefetch_evicted(prefetch, &evicted, false);
+    }
+    bool trigger = (result != CSIM_HIT);
+    if (result == CSIM_HIT) {
+        if (blockmap_remove(&prefetch->unused, block)) {
+            prefetch->stats.useful++;
+            trigger = true;
+        }
+    } else if (blockmap_remove(&prefetch->displaced, block)) {
+        prefetch->stats.polluting++;
+    }
+
+    switch (prefetch->kind) {
+    case PREFETCH_NEXT:
+        for (int k = 1; trigger && k <= prefetch->degree; k++) {
+            prefetch_issue(prefetch, block + (unsigned long)k);
+        }
+        break;
+    case PREFETCH_STRIDE:
+        stride_train(prefetch, op->addr);
+        break;
+    case PREFETCH_STREAM:
+        if (result != CSIM_HIT && !streamed) {
+            stream_allocate(prefetch, block);
+        }
+        break;
+    }
+    return result;
+}
+
+/**
+ * @brief Copy the statistics of all prefetches so far
+ */
+void prefetch_get_stats(const prefetch_t *prefetch, prefetch_stats_t *stats) {
+    *stats = prefetch->stats;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file prefetch.h
+ * @brief Prototypes for hardware prefetcher models
+ */
+
+#ifndef CSIM_PREFETCH_H
+#define CSIM_PREFETCH_H
+
+#include <stdbool.h>
+
+#include "libcsim.h"
+#include "trace.h"
+
+/** @brief Largest number of blocks prefetched per trigger */
+#define PREFETCH_MAX_DEGREE 64
+
+/** @brief Largest latency of a prefetch, in accesses */
+#define PREFETCH_MAX_LATENCY 4096
+
+/** @brief Names of the prefetchers, for prefetch_parse() */
+#define PREFETCH_KINDS "next, stride, stream"
+
+/**
+ * @brief Which prefetcher to model
+ */
+typedef enum {
+    PREFETCH_NEXT,   /* the next blocks after a miss or a prefetch hit */
+    PREFETCH_STRIDE, /* the next blocks of a stride seen in a region */
+    PREFETCH_STREAM, /* sequential blocks, held in stream buffers */
+} prefetch_kind_t;
+
+/**
+ * @brief Parameters of a prefetcher
+ */
+typedef struct {
+    prefetch_kind_t kind;  /* which prefetcher */
+    int b;                 /* Number of block bits, as in the cache */
+    int degree;            /* blocks per trigger or per stream, 0: default */
+    unsigned long latency; /* accesses that find a prefetch in flight */
+} prefetch_config_t;
+
+/**
+ * @brief Statistics of a prefetcher
+ *
+ * They are kept apart from the hits and misses of the cache, which only
+ * count demand accesses: a prefetch that is useful turns a miss into a
+ * hit, and one that pollutes turns a hit into a miss.
+ */
+typedef struct {
+    unsigned long issued;    /* blocks prefetched */
+    unsigned long useful;    /* prefetched blocks accessed after arriving */
+    unsigned long late;      /* prefetched blocks accessed before arriving */
+    unsigned long polluting; /* misses on blocks a prefetch evicted */
+} prefetch_stats_t;
+
+/** @brief Opaque prefetcher */
+typedef struct prefetch prefetch_t;
+
+/** @brief Look up a prefetcher by name; false if there is none */
+bool prefetch_parse(const char *name, prefetch_kind_t *kind);
+
+/** @brief Attach a prefetcher to a cache; NULL if invalid or out of memory */
+prefetch_t *prefetch_create(csim_cache_t *cache,
+                            const prefetch_config_t *config);
+
+/** @brief Free all memory used by a prefetcher, but not its cache */
+void prefetch_destroy(prefetch_t *prefetch);
+
+/** @brief Simulate one demand access and the prefetches it triggers */
+csim_result_t prefetch_access(prefetch_t *prefetch, const access_t *op);
+
+/** @brief Copy the statistics of all prefetches so far */
+void prefetch_get_stats(const prefetch_t *prefetch, prefetch_stats_t *stats);
+
+#endif /* CSIM_PREFETCH_H */
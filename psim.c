@@ -0,0 +1,434 @@
+/**
+ * @file psim.c
+ * @brief Set-partitioned multithreaded cache simulation
+ *
+ * The sets of a cache never interact, so a trace can be simulated by
+ * several threads at once as long as each set is only touched by one of
+ * them. The calling thread decodes the trace and routes every access to
+ * the worker owning its set through a single-producer, single-consumer
+ * ring, and each worker replays its accesses in trace order. Every set
+ * therefore sees exactly the accesses, in exactly the order, of a serial
+ * run, and since all statistics are sums over sets, adding up the
+ * statistics of the workers gives bit-identical results.
+ *
+ * The sets are split into P = 2^j partitions by the low j bits of the set
+ * index, so that neighbouring blocks, which traces tend to access
+ * together, land on different workers. Partition p belongs to worker
+ * p mod N. Each partition is an independent csim_cache_t with 2^(s - j)
+ * sets: removing the j partition bits from an address leaves a set index
+ * and tag that select the same line as in the full cache, since the
+ * removed bits are the same for every address of the partition. Using a
+ * few partitions per worker keeps the load balanced when N is not a power
+ * of two.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "psim.h"
+
+/** @brief Size of a host cache line, to keep ring counters apart */
+#define PSIM_LINE 64
+
+/** @brief Number of accesses each ring holds; a power of two */
+#define PSIM_RING_SIZE (1UL << 14)
+
+/** @brief Accesses a worker replays between updates of its ring head */
+#define PSIM_CHUNK 256
+
+/** @brief Smallest number of partitions per worker, when sets allow */
+#define PSIM_PARTS_PER_THREAD 4
+
+/** @brief Polls of an empty or full ring before sleeping on it */
+#define PSIM_SPINS 64
+
+/**
+ * @brief A ring counter alone on its host cache line
+ *
+ * The reader and a worker each write one counter of a ring, and padding
+ * both to a full line keeps those writes from invalidating each other.
+ */
+typedef union {
+    size_t value;        /* the counter */
+    char pad[PSIM_LINE]; /* room for nothing else on its line */
+} psim_counter_t;
+
+/**
+ * @brief A worker thread and the ring feeding it
+ *
+ * The counters are the only fields shared while the worker runs; they are
+ * accessed with atomic builtins. A side that finds the ring empty (or
+ * full) for PSIM_SPINS polls raises its flag and sleeps on wake, and the
+ * other side signals wake whenever it moves its counter past a raised
+ * flag. Both store their counter before loading the flag of the other,
+ * with sequentially consistent ordering, so a wakeup is never lost.
+ */
+typedef struct {
+    psim_counter_t tail;          /* accesses published by the reader */
+    psim_counter_t head;          /* accesses consumed by the worker */
+    psim_counter_t done;          /* nonzero once no more accesses come */
+    psim_counter_t worker_asleep; /* worker sleeps until tail moves */
+    psim_counter_t reader_asleep; /* reader sleeps until head moves */
+    access_t *ring;               /* PSIM_RING_SIZE accesses */
+    struct psim *psim;            /* simulator the worker belongs to */
+    pthread_mutex_t lock;         /* protects sleeping on wake */
+    pthread_cond_t wake;          /* signaled when a sleeper may proceed */
+    pthread_t thread;             /* the worker thread */
+    bool ready;                   /* lock and wake are initialized */
+    bool started;                 /* thread was created and not joined */
+} psim_worker_t;
+
+/**
+ * @brief The reader's private view of a ring
+ */
+typedef struct {
+    size_t tail;      /* accesses written, published or not */
+    size_t head_seen; /* head as last read from the worker */
+} psim_cursor_t;
+
+/**
+ * @brief Parallel simulator
+ */
+struct psim {
+    int b;                   /* number of block bits */
+    int j;                   /* number of partition bits */
+    int threads;             /* number of workers */
+    unsigned long part_mask; /* number of partitions - 1 */
+    csim_cache_t **parts;    /* cache of each partition */
+    psim_worker_t *workers;  /* worker of partition p is p mod threads */
+    psim_cursor_t *cursors;  /* reader's view of the ring of each worker */
+    access_t *batch;         /* accesses decoded by the reader */
+};
+
+/**
+ * @brief Wait until a ring counter moves away from a value, or done is set
+ *
+ * @param[in] worker  The worker owning the ring
+ * @param[in] asleep  Flag of the waiting side
+ * @param[in] counter Counter written by the other side
+ * @param[in] seen    Value of the counter the caller cannot proceed with
+ */
+static void psim_wait(psim_worker_t *worker, psim_counter_t *asleep,
+                      const psim_counter_t *counter, size_t seen) {
+    for (int spins = 0; spins < PSIM_SPINS; spins++) {
+        if (__atomic_load_n(&counter->value, __ATOMIC_ACQUIRE) != seen ||
+            __atomic_load_n(&worker->done.value, __ATOMIC_ACQUIRE)) {
+            return;
+        }
+    }
+    pthread_mutex_lock(&worker->lock);
+    __atomic_store_n(&asleep->value, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&counter->value, __ATOMIC_SEQ_CST) == seen &&
+           !__atomic_load_n(&worker->done.value, __ATOMIC_SEQ_CST)) {
+        pthread_cond_wait(&worker->wake, &worker->lock);
+    }
+    __atomic_store_n(&asleep->value, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+/**
+ * @brief Store a ring counter and wake the other side if it sleeps on it
+ */
+static void psim_advance(psim_worker_t *worker, psim_counter_t *counter,
+                         size_t value, const psim_counter_t *asleep) {
+    __atomic_store_n(&counter->value, value, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&asleep->value, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&worker->lock);
+        pthread_cond_signal(&worker->wake);
+        pthread_mutex_unlock(&worker->lock);
+    }
+}
+
+/**
+ * @brief Replay one access on the partition owning its set
+ */
+static void psim_replay(const struct psim *psim, const access_t *op) {
+    unsigned long block = op->addr >> psim->b;
+    unsigned long part = block & psim->part_mask;
+    unsigned long offset = op->addr & ((1UL << psim->b) - 1);
+    access_t local = *op;
+    local.addr = ((block >> psim->j) << psim->b) | offset;
+    csim_access(psim->parts[part], &local);
+}
+
+/**
+ * @brief Body of a worker thread: replay accesses until the reader is done
+ */
+static void *psim_worker(void *arg) {
+    psim_worker_t *worker = (psim_worker_t *)arg;
+    size_t head = worker->head.value;
+    for (;;) {
+        bool done = __atomic_load_n(&worker->done.value, __ATOMIC_ACQUIRE);
+        size_t tail = __atomic_load_n(&worker->tail.value, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            if (done) {
+                return NULL;
+            }
+            psim_wait(worker, &worker->worker_asleep, &worker->tail, head);
+            continue;
+        }
+        while (head != tail) {
+            size_t end = (tail - head > PSIM_CHUNK) ? head + PSIM_CHUNK : tail;
+            for (; head != end; head++) {
+                psim_replay(worker->psim,
+                            &worker->ring[head & (PSIM_RING_SIZE - 1)]);
+            }
+            psim_advance(worker, &worker->head, head, &worker->reader_asleep);
+        }
+    }
+}
+
+/**
+ * @brief Make the accesses written to the ring of worker i visible to it
+ */
+static void psim_publish(psim_t *psim, int i) {
+    psim_worker_t *worker = &psim->workers[i];
+    psim_advance(worker, &worker->tail, psim->cursors[i].tail,
+                 &worker->worker_asleep);
+}
+
+/**
+ * @brief Append an access to the ring of worker i, waiting while it is full
+ */
+static void psim_push(psim_t *psim, int i, const access_t *op) {
+    psim_worker_t *worker = &psim->workers[i];
+    psim_cursor_t *cursor = &psim->cursors[i];
+    if (cursor->tail - cursor->head_seen == PSIM_RING_SIZE) {
+        /* Let the worker drain what it has before waiting on it */
+        psim_publish(psim, i);
+        psim_wait(worker, &worker->reader_asleep, &worker->head,
+                  cursor->head_seen);
+        cursor->head_seen =
+            __atomic_load_n(&worker->head.value, __ATOMIC_ACQUIRE);
+    }
+    worker->ring[cursor->tail & (PSIM_RING_SIZE - 1)] = *op;
+    cursor->tail++;
+}
+
+/**
+ * @brief Tell all workers that no more accesses will come, and join them
+ */
+static void psim_finish(psim_t *psim) {
+    for (int i = 0; i < psim->threads; i++) {
+        psim_worker_t *worker = &psim->workers[i];
+        if (worker->started) {
+            psim_publish(psim, i);
+            psim_advance(worker, &worker->done, 1, &worker->worker_asleep);
+        }
+    }
+    for (int i = 0; i < psim->threads; i++) {
+        psim_worker_t *worker = &psim->workers[i];
+        if (worker->started) {
+            pthread_join(worker->thread, NULL);
+            worker->started = false;
+        }
+    }
+}
+
+/**
+ * @brief Create a parallel simulator and start its workers
+ *
+ * The number of workers is capped by the number of sets, since a set
+ * cannot be split. Policies with state shared by all sets, such as DRRIP,
+ * cannot be split at all, and get a single worker, as do caches with a
+ * write-combining buffer, which all sets share, caches that split
+ * accesses, whose blocks may fall in the sets of different workers, and
+ * caches whose set index is not the low s bits of the block.
+ *
+ * @param[in] config  Parameters of the simulated cache
+ * @param[in] threads Number of worker threads, from 1 to PSIM_MAX_THREADS
+ *
+ * @return The new simulator, or NULL if the parameters are invalid, memory
+ *         allocation failed or a thread could not be started
+ */
+psim_t *psim_create(const csim_config_t *config, int threads) {
+    int s = config->s;
+    if (s < 0 || threads < 1 || threads > PSIM_MAX_THREADS) {
+        return NULL;
+    }
+    int j = 0;
+    if (!csim_policy_per_set(config->policy) || config->write_buffer > 0 ||
+        config->split || config->sets != 0 ||
+        config->index != CSIM_INDEX_MODULO) {
+        threads = 1;
+    }
+    while (threads > 1 && j < s &&
+           (1 << j) < PSIM_PARTS_PER_THREAD * threads) {
+        j++;
+    }
+    if ((1 << j) < threads) {
+        threads = 1 << j;
+    }
+
+    psim_t *psim = (psim_t *)calloc(1, sizeof(psim_t));
+    if (psim == NULL) {
+        return NULL;
+    }
+    psim->b = config->b;
+    psim->j = j;
+    psim->threads = threads;
+    psim->part_mask = (1UL << j) - 1;
+    psim->parts = (csim_cache_t **)calloc(1UL << j, sizeof(csim_cache_t *));
+    psim->workers =
+        (psim_worker_t *)calloc((size_t)threads, sizeof(psim_worker_t));
+    psim->cursors =
+        (psim_cursor_t *)calloc((size_t)threads, sizeof(psim_cursor_t));
+    psim->batch = (access_t *)malloc(TRACE_BATCH * sizeof(access_t));
+    if (psim->parts == NULL || psim->workers == NULL ||
+        psim->cursors == NULL || psim->batch == NULL) {
+        psim_destroy(psim);
+        return NULL;
+    }
+
+    csim_config_t part_config = *config;
+    part_config.s = s - j;
+    for (unsigned long p = 0; p <= psim->part_mask; p++) {
+        psim->parts[p] = csim_create(&part_config);
+        if (psim->parts[p] == NULL) {
+            psim_destroy(psim);
+            return NULL;
+        }
+    }
+
+    for (int i = 0; i < threads; i++) {
+        psim_worker_t *worker = &psim->workers[i];
+        worker->psim = psim;
+        if (pthread_mutex_init(&worker->lock, NULL) != 0) {
+            psim_destroy(psim);
+            return NULL;
+        }
+        if (pthread_cond_init(&worker->wake, NULL) != 0) {
+            pthread_mutex_destroy(&worker->lock);
+            psim_destroy(psim);
+            return NULL;
+        }
+        worker->ready = true;
+        worker->ring = (access_t *)malloc(PSIM_RING_SIZE * sizeof(access_t));
+        if (worker->ring == NULL ||
+            pthread_create(&worker->thread, NULL, psim_worker, worker) != 0) {
+            psim_destroy(psim);
+            return NULL;
+        }
+        worker->started = true;
+    }
+    return psim;
+}
+
+/**
+ * @brief Stop the workers and free all memory used by a simulator
+ */
+void psim_destroy(psim_t *psim) {
+    if (psim->workers != NULL) {
+        psim_finish(psim);
+        for (int i = 0; i < psim->threads; i++) {
+            psim_worker_t *worker = &psim->workers[i];
+            if (worker->ready) {
+                pthread_cond_destroy(&worker->wake);
+                pthread_mutex_destroy(&worker->lock);
+            }
+            free(worker->ring);
+        }
+        free(psim->workers);
+    }
+    if (psim->parts != NULL) {
+        for (unsigned long p = 0; p <= psim->part_mask; p++) {
+            if (psim->parts[p] != NULL) {
+                csim_destroy(psim->parts[p]);
+            }
+        }
+        free(psim->parts);
+    }
+    free(psim->cursors);
+    free(psim->batch);
+    free(psim);
+}
+
+/**
+ * @brief Simulate a whole trace, then stop the workers
+ *
+ * The calling thread reads the trace while the workers replay it. The
+ * statistics are complete when this returns; a simulator runs one trace.
+ *
+ * @return true on success, false if the trace could not be decoded
+ */
+bool psim_run(psim_t *psim, trace_t *trace) {
+    access_t *ops = psim->batch;
+    long n;
+    while ((n = trace_read(trace, ops, TRACE_BATCH)) > 0) {
+        for (long i = 0; i < n; i++) {
+            unsigned long part = (ops[i].addr >> psim->b) & psim->part_mask;
+            psim_push(psim, (int)(part % (unsigned long)psim->threads),
+                      &ops[i]);
+        }
+        for (int i = 0; i < psim->threads; i++) {
+            psim_publish(psim, i);
+        }
+    }
+    psim_finish(psim);
+    return n == 0;
+}
+
+/**
+ * @brief Sum of the statistics of all partitions
+ */
+void psim_get_stats(const psim_t *psim, csim_stats_t *stats) {
+    csim_stats_t total = {0};
+    for (unsigned long p = 0; p <= psim->part_mask; p++) {
+        csim_stats_t part;
+        csim_get_stats(psim->parts[p], &part);
+        total.hits += part.hits;
+        total.misses += part.misses;
+        total.evictions += part.evictions;
+        total.dirty_bytes += part.dirty_bytes;
+        total.dirty_evictions += part.dirty_evictions;
+    }
+    *stats = total;
+}
+
+/**
+ * @brief Sum of the statistics of the writes to memory of all partitions
+ */
+void psim_get_write_stats(const psim_t *psim, csim_write_stats_t *stats) {
+    csim_write_stats_t total = {0};
+    for (unsigned long p = 0; p <= psim->part_mask; p++) {
+        csim_write_stats_t part;
+        csim_get_write_stats(psim->parts[p], &part);
+        total.writes += part.writes;
+        total.bytes += part.bytes;
+        total.combined += part.combined;
+        total.buffered += part.buffered;
+    }
+    *stats = total;
+}
+
+/**
+ * @brief Sum of the ghost list statistics of all partitions
+ *
+ * @return true on success, false if the policy has no ghost lists
+ */
+bool psim_get_ghost_stats(const psim_t *psim, csim_ghost_stats_t *stats) {
+    csim_ghost_stats_t total = {0};
+    for (unsigned long p = 0; p <= psim->part_mask; p++) {
+        csim_ghost_stats_t part;
+        if (!csim_get_ghost_stats(psim->parts[p], &part)) {
+            return false;
+        }
+        total.lists = part.lists;
+        total.hits[0] += part.hits[0];
+        total.hits[1] += part.hits[1];
+        total.target += part.target;
+    }
+    *stats = total;
+    return true;
+}
+
+/**
+ * @brief Number of worker threads actually used
+ */
+int psim_threads(const psim_t *psim) {
+    return psim->threads;
+}
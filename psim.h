@@ -0,0 +1,42 @@
+/**
+ * @file psim.h
+ * @brief Prototypes for set-partitioned multithreaded simulation
+ */
+
+#ifndef CSIM_PSIM_H
+#define CSIM_PSIM_H
+
+#include <stdbool.h>
+
+#include "cachelab.h"
+#include "libcsim.h"
+#include "trace.h"
+
+/** @brief Largest number of worker threads */
+#define PSIM_MAX_THREADS 256
+
+/** @brief Opaque parallel simulator */
+typedef struct psim psim_t;
+
+/** @brief Create a cache split over threads workers; NULL on failure */
+psim_t *psim_create(const csim_config_t *config, int threads);
+
+/** @brief Stop the workers and free all memory used by a simulator */
+void psim_destroy(psim_t *psim);
+
+/** @brief Simulate a whole trace; returns false on a trace error */
+bool psim_run(psim_t *psim, trace_t *trace);
+
+/** @brief Sum of the statistics of all workers */
+void psim_get_stats(const psim_t *psim, csim_stats_t *stats);
+
+/** @brief Sum of the writes to memory of all workers */
+void psim_get_write_stats(const psim_t *psim, csim_write_stats_t *stats);
+
+/** @brief Sum of the ghost list hits of all workers; false if none */
+bool psim_get_ghost_stats(const psim_t *psim, csim_ghost_stats_t *stats);
+
+/** @brief Number of worker threads actually used */
+int psim_threads(const psim_t *psim);
+
+#endif /* CSIM_PSIM_H */
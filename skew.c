@@ -0,0 +1,176 @@
+/**
+ * @file skew.c
+ * @brief A skewed-associative cache
+ *
+ * Each way of a skewed-associative cache is indexed by a hash of its own,
+ * so blocks that map to the same set of one way usually map to different
+ * sets of the others, and a group of blocks that would thrash a set of a
+ * conventional cache spreads over many lines. Block x may live in line
+ * h_w(x) of each way w, so a lookup checks E lines from E different sets,
+ * and a miss replaces the least recently used of them, an empty one
+ * first. The recency of a line is the time of its last access.
+ *
+ * Way w hashes a block by multiplying it with an odd constant of its own
+ * and folding the high half of the product into the low one; the low 32
+ * bits of the result are then scaled to the number of sets, which need
+ * not be a power of two.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "skew.h"
+
+/** @brief Increment of the sequence the way multipliers are drawn from */
+#define SKEW_SEED 0x9e3779b97f4a7c15UL
+
+/**
+ * @brief Skewed-associative cache
+ *
+ * Line w of set k is entry k * E + w, and only way w ever uses it.
+ */
+struct skew {
+    unsigned long sets;   /* number of sets of each way */
+    int E;                /* number of ways */
+    int b;                /* number of block bits */
+    unsigned long *mix;   /* odd multiplier of each way's hash */
+    unsigned long *block; /* block in each line */
+    unsigned long *last;  /* time of each line's last access, 0 if empty */
+    unsigned char *dirty; /* whether each line is dirty */
+    unsigned long now;    /* accesses so far */
+    csim_stats_t stats;   /* statistics so far */
+};
+
+/**
+ * @brief Create an empty skewed-associative cache
+ *
+ * @param[in] config Parameters of the cache: s or sets, E and b; the
+ *                   policy is always LRU, and the index is ignored
+ *
+ * @return The new cache, or NULL if the parameters are invalid or memory
+ *         allocation failed
+ */
+skew_t *skew_create(const csim_config_t *config) {
+    csim_config_t sized = *config;
+    sized.index = CSIM_INDEX_SKEW;
+    unsigned long sets = csim_config_sets(&sized);
+    int E = config->E;
+    if (sets == 0 || E <= 0 || E > CSIM_MAX_ASSOC ||
+        sets > SIZE_MAX / (size_t)E) {
+        return NULL;
+    }
+    size_t lines = (size_t)sets * (size_t)E;
+
+    skew_t *skew = (skew_t *)calloc(1, sizeof(skew_t));
+    if (skew == NULL) {
+        return NULL;
+    }
+    skew->sets = sets;
+    skew->E = E;
+    skew->b = config->b;
+    skew->mix = (unsigned long *)malloc((size_t)E * sizeof(unsigned long));
+    skew->block = (unsigned long *)calloc(lines, sizeof(unsigned long));
+    skew->last = (unsigned long *)calloc(lines, sizeof(unsigned long));
+    skew->dirty = (unsigned char *)calloc(lines, 1);
+    if (skew->mix == NULL || skew->block == NULL || skew->last == NULL ||
+        skew->dirty == NULL) {
+        skew_destroy(skew);
+        return NULL;
+    }
+
+    /* splitmix64, made odd so that each multiplication is a bijection */
+    unsigned long state = 0;
+    for (int w = 0; w < E; w++) {
+        state += SKEW_SEED;
+        unsigned long z = state;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+        skew->mix[w] = (z ^ (z >> 31)) | 1;
+    }
+    return skew;
+}
+
+/**
+ * @brief Free all memory used by a cache
+ */
+void skew_destroy(skew_t *skew) {
+    free(skew->mix);
+    free(skew->block);
+    free(skew->last);
+    free(skew->dirty);
+    free(skew);
+}
+
+/**
+ * @brief Line a block maps to in one way
+ */
+static inline size_t skew_line(const skew_t *skew, unsigned long block,
+                               int way) {
+    unsigned long h = block * skew->mix[way];
+    h ^= h >> 32;
+    unsigned long set = ((h & 0xffffffffUL) * skew->sets) >> 32;
+    return (size_t)set * (size_t)skew->E + (size_t)way;
+}
+
+/**
+ * @brief Simulate one access
+ *
+ * @param[in] op The access; 'S' is a store, 'M' a modify (a load, then a
+ *               store that hits), and anything else a load
+ *
+ * @return The outcome of the access, or of the load of a modify
+ */
+csim_result_t skew_access(skew_t *skew, const access_t *op) {
+    unsigned long block = op->addr >> skew->b;
+    unsigned long B = 1UL << skew->b;
+    bool store = (op->op == 'S' || op->op == 'M');
+    skew->now++;
+    skew->stats.hits += (op->op == 'M');
+
+    size_t victim = 0;
+    unsigned long oldest = ~0UL;
+    for (int w = 0; w < skew->E; w++) {
+        size_t line = skew_line(skew, block, w);
+        if (skew->last[line] != 0 && skew->block[line] == block) {
+            skew->stats.hits++;
+            skew->last[line] = skew->now;
+            if (store && !skew->dirty[line]) {
+                skew->dirty[line] = 1;
+                skew->stats.dirty_bytes += B;
+            }
+            return CSIM_HIT;
+        }
+        if (skew->last[line] < oldest) {
+            oldest = skew->last[line];
+            victim = line;
+        }
+    }
+
+    skew->stats.misses++;
+    csim_result_t result = CSIM_MISS;
+    if (oldest != 0) {
+        skew->stats.evictions++;
+        result = CSIM_MISS_EVICTION;
+        if (skew->dirty[victim]) {
+            skew->stats.dirty_bytes -= B;
+            skew->stats.dirty_evictions += B;
+        }
+    }
+    skew->block[victim] = block;
+    skew->last[victim] = skew->now;
+    skew->dirty[victim] = store;
+    if (store) {
+        skew->stats.dirty_bytes += B;
+    }
+    return result;
+}
+
+/**
+ * @brief Copy the statistics of all accesses simulated so far
+ *
+ * @param[out] stats Hits, misses and evictions so far, and the dirty bytes
+ *                   currently in the cache and evicted so far
+ */
+void skew_get_stats(const skew_t *skew, csim_stats_t *stats) {
+    *stats = skew->stats;
+}
@@ -0,0 +1,27 @@
+/**
+ * @file skew.h
+ * @brief Prototypes for skewed-associative cache simulation
+ */
+
+#ifndef CSIM_SKEW_H
+#define CSIM_SKEW_H
+
+#include "libcsim.h"
+#include "trace.h"
+
+/** @brief Opaque skewed-associative cache */
+typedef struct skew skew_t;
+
+/** @brief Create an empty cache; NULL if invalid or out of memory */
+skew_t *skew_create(const csim_config_t *config);
+
+/** @brief Free all memory used by a cache */
+void skew_destroy(skew_t *skew);
+
+/** @brief Simulate one access */
+csim_result_t skew_access(skew_t *skew, const access_t *op);
+
+/** @brief Copy the statistics of all accesses simulated so far */
+void skew_get_stats(const skew_t *skew, csim_stats_t *stats);
+
+#endif /* CSIM_SKEW_H */
@@ -0,0 +1,208 @@
+/**
+ * @file stackdist.c
+ * @brief LRU stack distance analysis with Fenwick trees
+ *
+ * The stack distance of an access is the number of distinct other blocks
+ * of the same set accessed since the previous access to its block. An LRU
+ * set with E ways hits exactly when the distance is below E, so a single
+ * pass over a trace gives the hits of every associativity at once (the
+ * inclusion property of Mattson et al.).
+ *
+ * Each set numbers its accesses with local timestamps and marks, in a
+ * Fenwick tree, the timestamp of the latest access to each of its blocks.
+ * The distance of an access is then the number of marks after the
+ * previous timestamp of its block, a prefix sum away, so each access
+ * takes O(log n) time in the number of distinct blocks n of its set. When
+ * a set runs out of timestamps, its live marks are renumbered 0 to n - 1
+ * in a tree of twice that size, which keeps both memory and the amortized
+ * cost of renumbering proportional to n.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "blockmap.h"
+#include "stackdist.h"
+
+/** @brief Smallest number of timestamps allocated to a set */
+#define SD_MIN_CAP 16
+
+/**
+ * @brief Stack distance state of one set
+ */
+typedef struct {
+    uint32_t *tree;       /* Fenwick tree over timestamps, 1-based */
+    unsigned long *owner; /* block accessed at each timestamp */
+    uint32_t cap;         /* number of timestamps allocated */
+    uint32_t next;        /* next timestamp to hand out */
+    uint32_t live;        /* number of marked timestamps (distinct blocks) */
+} sd_set_t;
+
+/**
+ * @brief Stack distance analyzer
+ *
+ * The map holds the latest timestamp of every block seen, local to its
+ * set. A timestamp is marked exactly when the map points back at it.
+ */
+struct stackdist {
+    unsigned long set_mask; /* number of sets - 1 */
+    sd_set_t *sets;         /* state of each set */
+    blockmap_t last;        /* block -> timestamp of its latest access */
+};
+
+/**
+ * @brief Add delta to the count at timestamp pos
+ */
+static inline void sd_tree_add(uint32_t *tree, uint32_t cap, uint32_t pos,
+                               uint32_t delta) {
+    for (uint32_t i = pos + 1; i <= cap; i += i & (0U - i)) {
+        tree[i] += delta;
+    }
+}
+
+/**
+ * @brief Sum of the counts at timestamps 0 to pos
+ */
+static inline uint32_t sd_tree_prefix(const uint32_t *tree, uint32_t pos) {
+    uint32_t sum = 0;
+    for (uint32_t i = pos + 1; i > 0; i &= i - 1) {
+        sum += tree[i];
+    }
+    return sum;
+}
+
+/**
+ * @brief Create an analyzer for caches with 2^s sets
+ *
+ * @return The new analyzer, or NULL if memory allocation failed
+ */
+stackdist_t *stackdist_create(int s) {
+    stackdist_t *sd = (stackdist_t *)malloc(sizeof(stackdist_t));
+    if (sd == NULL) {
+        return NULL;
+    }
+    sd->set_mask = (1UL << s) - 1;
+    sd->sets = (sd_set_t *)calloc(sd->set_mask + 1, sizeof(sd_set_t));
+    if (sd->sets == NULL || !blockmap_init(&sd->last, 0)) {
+        free(sd->sets);
+        free(sd);
+        return NULL;
+    }
+    return sd;
+}
+
+/**
+ * @brief Free all memory used by an analyzer
+ */
+void stackdist_destroy(stackdist_t *sd) {
+    for (unsigned long i = 0; i <= sd->set_mask; i++) {
+        free(sd->sets[i].tree);
+        free(sd->sets[i].owner);
+    }
+    free(sd->sets);
+    blockmap_destroy(&sd->last);
+    free(sd);
+}
+
+/**
+ * @brief Renumber the marked timestamps of a set from 0, in order
+ *
+ * The set gets room for as many new timestamps as it has live ones (and
+ * at least SD_MIN_CAP in total).
+ *
+ * @return true on success, false if memory allocation failed
+ */
+static bool sd_compact(stackdist_t *sd, sd_set_t *set) {
+    uint32_t cap = (set->live < SD_MIN_CAP / 2) ? SD_MIN_CAP : 2 * set->live;
+    uint32_t *tree = (uint32_t *)calloc((size_t)cap + 1, sizeof(uint32_t));
+    unsigned long *owner =
+        (unsigned long *)malloc((size_t)cap * sizeof(unsigned long));
+    if (tree == NULL || owner == NULL) {
+        free(tree);
+        free(owner);
+        return false;
+    }
+
+    uint32_t live = 0;
+    for (uint32_t pos = 0; pos < set->next; pos++) {
+        unsigned long block = set->owner[pos];
+        unsigned long latest;
+        if (blockmap_get(&sd->last, block, &latest) && latest == pos) {
+            owner[live] = block;
+            blockmap_put(&sd->last, block, live);
+            live++;
+        }
+    }
+
+    /* Build the tree of live ones in linear time */
+    for (uint32_t i = 1; i <= cap; i++) {
+        tree[i] += (i <= live);
+        uint32_t parent = i + (i & (0U - i));
+        if (parent <= cap) {
+            tree[parent] += tree[i];
+        }
+    }
+
+    free(set->tree);
+    free(set->owner);
+    set->tree = tree;
+    set->owner = owner;
+    set->cap = cap;
+    set->next = live;
+    return true;
+}
+
+/**
+ * @brief Record an access to a block
+ *
+ * @param[in]  block    Block address; its low s bits select the set
+ * @param[out] distance Stack distance of the access, or STACKDIST_COLD if
+ *                      the block was never accessed before
+ *
+ * @return true on success, false if memory allocation failed
+ */
+bool stackdist_access(stackdist_t *sd, unsigned long block,
+                      unsigned long *distance) {
+    sd_set_t *set = &sd->sets[block & sd->set_mask];
+    if (set->next == set->cap && !sd_compact(sd, set)) {
+        return false;
+    }
+
+    unsigned long prev;
+    if (blockmap_get(&sd->last, block, &prev)) {
+        uint32_t at = (uint32_t)prev;
+        *distance = set->live - sd_tree_prefix(set->tree, at);
+        sd_tree_add(set->tree, set->cap, at, 0U - 1U);
+    } else {
+        *distance = STACKDIST_COLD;
+        set->live++;
+    }
+
+    uint32_t now = set->next++;
+    sd_tree_add(set->tree, set->cap, now, 1);
+    set->owner[now] = block;
+    return blockmap_put(&sd->last, block, now);
+}
+
+/**
+ * @brief Forget a block, as if it had never been accessed
+ *
+ * Later accesses to other blocks of its set no longer count it, and the
+ * next access to it is cold. This lets samplers drop blocks.
+ */
+void stackdist_remove(stackdist_t *sd, unsigned long block) {
+    sd_set_t *set = &sd->sets[block & sd->set_mask];
+    unsigned long prev;
+    if (blockmap_get(&sd->last, block, &prev)) {
+        sd_tree_add(set->tree, set->cap, (uint32_t)prev, 0U - 1U);
+        set->live--;
+        blockmap_remove(&sd->last, block);
+    }
+}
+
+/**
+ * @brief Number of distinct blocks accessed so far in a set
+ */
+unsigned long stackdist_blocks(const stackdist_t *sd, unsigned long set) {
+    return sd->sets[set & sd->set_mask].live;
+}
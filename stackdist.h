@@ -0,0 +1,33 @@
+/**
+ * @file stackdist.h
+ * @brief Prototypes for LRU stack distance analysis
+ */
+
+#ifndef CSIM_STACKDIST_H
+#define CSIM_STACKDIST_H
+
+#include <stdbool.h>
+
+/** @brief Distance reported for the first access to a block */
+#define STACKDIST_COLD (~0UL)
+
+/** @brief Opaque stack distance analyzer */
+typedef struct stackdist stackdist_t;
+
+/** @brief Create an analyzer for caches with 2^s sets */
+stackdist_t *stackdist_create(int s);
+
+/** @brief Free all memory used by an analyzer */
+void stackdist_destroy(stackdist_t *sd);
+
+/** @brief Record an access; returns false if memory ran out */
+bool stackdist_access(stackdist_t *sd, unsigned long block,
+                      unsigned long *distance);
+
+/** @brief Forget a block, as if it had never been accessed */
+void stackdist_remove(stackdist_t *sd, unsigned long block);
+
+/** @brief Number of distinct blocks accessed so far in a set */
+unsigned long stackdist_blocks(const stackdist_t *sd, unsigned long set);
+
+#endif /* CSIM_STACKDIST_H */
@@ -0,0 +1,116 @@
+/**
+ * @file tagmatch.c
+ * @brief Set lookup kernels with runtime instruction set dispatch
+ *
+ * Each kernel compares a block address against the packed block array of a
+ * set and returns a bitmask of matching ways. On x86-64 the SSE4.1 kernel
+ * compares 2 ways per instruction and the AVX2 kernel 4, so a 16-way set
+ * resolves in four compares that are then folded with the valid bitmap.
+ * The vector kernels are compiled with target attributes and only selected
+ * if the CPU reports support for them, so the binary still runs anywhere.
+ */
+
+#include <stddef.h>
+
+#include "tagmatch.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define TAGMATCH_X86 1
+#endif
+
+/**
+ * @brief Portable kernel, one way per comparison
+ */
+static uint64_t match_scalar(const unsigned long *blocks, int n,
+                             unsigned long block) {
+    uint64_t mask = 0;
+    for (int i = 0; i < n; i++) {
+        mask |= (uint64_t)(blocks[i] == block) << i;
+    }
+    return mask;
+}
+
+#ifdef TAGMATCH_X86
+
+/**
+ * @brief SSE4.1 kernel, two ways per comparison
+ */
+__attribute__((target("sse4.1"))) static uint64_t
+match_sse4(const unsigned long *blocks, int n, unsigned long block) {
+    __m128i key = _mm_set1_epi64x((long long)block);
+    uint64_t mask = 0;
+    for (int i = 0; i < n; i += 2) {
+        __m128i ways = _mm_loadu_si128((const __m128i *)(blocks + i));
+        __m128i eq = _mm_cmpeq_epi64(ways, key);
+        mask |= (uint64_t)(unsigned)_mm_movemask_pd(_mm_castsi128_pd(eq))
+                << i;
+    }
+    return mask;
+}
+
+/**
+ * @brief AVX2 kernel, four ways per comparison
+ */
+__attribute__((target("avx2"))) static uint64_t
+match_avx2(const unsigned long *blocks, int n, unsigned long block) {
+    __m256i key = _mm256_set1_epi64x((long long)block);
+    uint64_t mask = 0;
+    for (int i = 0; i < n; i += 4) {
+        __m256i ways = _mm256_loadu_si256((const __m256i *)(blocks + i));
+        __m256i eq = _mm256_cmpeq_epi64(ways, key);
+        mask |= (uint64_t)(unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(eq))
+                << i;
+    }
+    /* Not every compiler clears the upper halves on return */
+    _mm256_zeroupper();
+    return mask;
+}
+
+#endif /* TAGMATCH_X86 */
+
+/**
+ * @brief Every kernel compiled in, slowest first
+ *
+ * Each kernel needs the instruction sets of the ones before it, so the
+ * kernels a host supports are always a prefix of this array. The array is
+ * never modified, so kernels may be looked up from any thread.
+ */
+static const tag_matcher_t MATCHERS[] = {
+    {"scalar", match_scalar},
+#ifdef TAGMATCH_X86
+    {"sse4.1", match_sse4},
+    {"avx2", match_avx2},
+#endif
+};
+
+/**
+ * @brief The kernels the host supports
+ *
+ * @param[out] matchers Set to an array of kernels, slowest first
+ *
+ * @return The number of kernels in the array
+ */
+int tagmatch_available(const tag_matcher_t **matchers) {
+    int count = 1;
+#ifdef TAGMATCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1")) {
+        count++;
+        if (__builtin_cpu_supports("avx2")) {
+            count++;
+        }
+    }
+#endif
+    *matchers = MATCHERS;
+    return count;
+}
+
+/**
+ * @brief The fastest kernel the host supports
+ */
+const tag_matcher_t *tagmatch_best(void) {
+    const tag_matcher_t *matchers;
+    int count = tagmatch_available(&matchers);
+    return &matchers[count - 1];
+}
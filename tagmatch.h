@@ -0,0 +1,42 @@
+/**
+ * @file tagmatch.h
+ * @brief Prototypes for set lookup kernels
+ */
+
+#ifndef CSIM_TAGMATCH_H
+#define CSIM_TAGMATCH_H
+
+#include <stdint.h>
+
+/** @brief Largest number of ways a kernel compares in one call */
+#define TAGMATCH_MAX_WAYS 64
+
+/** @brief Number of entries a kernel may read past the end of a set */
+#define TAGMATCH_OVERREAD 3
+
+/**
+ * @brief Compare a block address against the first n ways of a set
+ *
+ * Bit i of the result is set if blocks[i] == block. Bits n and above are
+ * unspecified, so callers must mask the result (e.g. with the set's valid
+ * bitmap). Vector kernels may read up to TAGMATCH_OVERREAD entries past
+ * blocks[n - 1].
+ */
+typedef uint64_t (*tag_match_fn)(const unsigned long *blocks, int n,
+                                 unsigned long block);
+
+/**
+ * @brief A lookup kernel and the name it is reported under
+ */
+typedef struct {
+    const char *name;   /* name of the instruction set used */
+    tag_match_fn match; /* the kernel */
+} tag_matcher_t;
+
+/** @brief The kernels the host supports, slowest first; returns count */
+int tagmatch_available(const tag_matcher_t **matchers);
+
+/** @brief The fastest kernel the host supports */
+const tag_matcher_t *tagmatch_best(void);
+
+#endif /* CSIM_TAGMATCH_H */
@@ -0,0 +1,372 @@
+#!/usr/bin/env python3
+
+"""Regression tests for the simulator's features.
+
+test-csim only checks the plain simulator against csim-ref. This script
+runs ./csim with the options csim-ref does not have, on the traces in
+traces/csim, in two ways:
+
+* Golden outputs: each case in test-features.expected is a csim command
+  line and the output it printed when the case was added. The output must
+  match exactly. Run with --update after a deliberate change to the
+  output, and review the diff of the expected file.
+* Equivalences: the same statistics computed two ways, such as a binary
+  trace against the text trace it was converted from, must agree.
+
+A trace named <name>.bin in a command is traces/csim/<name>.trace after
+conversion by ./tracecvt; <name>.trace is the trace itself.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+TRACES_DIR = "traces/csim"
+EXPECTED = "test-features.expected"
+
+# Traces the equivalences are checked on
+TRACES = ("dave", "lackey", "load", "long", "swap", "trans", "wide", "yi",
+          "yi2")
+
+# Replacement policies besides opt
+POLICIES = ("lru", "fifo", "random", "plru", "bitplru", "nru", "srrip",
+            "brrip", "drrip", "arc", "lfu")
+
+
+class Runner:
+    """Runs ./csim on the test traces, converting them as needed."""
+
+    def __init__(self, tmpdir):
+        self.tmpdir = tmpdir
+
+    def path(self, name):
+        """Path of a trace named in a command."""
+        base, ext = os.path.splitext(name)
+        if ext != ".bin":
+            return os.path.join(TRACES_DIR, name)
+        out = os.path.join(self.tmpdir, name)
+        if not os.path.exists(out):
+            text = os.path.join(TRACES_DIR, base + ".trace")
+            subprocess.run(["./tracecvt", text, out], check=True,
+                           stdout=subprocess.DEVNULL,
+                           stderr=subprocess.DEVNULL)
+        return out
+
+    def write(self, name, lines):
+        """Write a trace of the given lines to the temporary directory."""
+        out = os.path.join(self.tmpdir, name)
+        with open(out, "w") as f:
+            f.write("".join(line + "\n" for line in lines))
+        return out
+
+    def csim(self, args):
+        """Run ./csim and return its output, or None if it failed."""
+        args = list(args)
+        for i in range(len(args) - 1):
+            if args[i] == "-t" and not os.path.isabs(args[i + 1]):
+                args[i + 1] = self.path(args[i + 1])
+        p = subprocess.run(["./csim"] + args, stdout=subprocess.PIPE,
+                           stderr=subprocess.DEVNULL, encoding="utf-8",
+                           timeout=60)
+        return p.stdout if p.returncode == 0 else None
+
+
+def stats(output, prefix=""):
+    """Parse the "key:value" fields of the line starting with prefix."""
+    for line in (output or "").splitlines():
+        if line.startswith(prefix) and (prefix or line.startswith("hits:")):
+            return {k: int(v) for k, v in re.findall(r"(\w+):(\d+)", line)}
+    return None
+
+
+def read_expected():
+    """Parse the golden cases: a list of (comment lines, args, output)."""
+    cases = []
+    comments = []
+    with open(EXPECTED) as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if line.startswith("$ "):
+                cases.append((comments, line[2:].split(), []))
+                comments = []
+            elif line.startswith("#") or not line:
+                comments.append(line)
+            else:
+                cases[-1][2].append(line)
+    return cases
+
+
+def write_expected(cases):
+    """Write the golden cases back, in the format read_expected() takes."""
+    with open(EXPECTED, "w") as f:
+        for comments, args, output in cases:
+            for line in comments:
+                f.write(line + "\n")
+            f.write("$ " + " ".join(args) + "\n")
+            for line in output:
+                f.write(line + "\n")
+
+
+def check_golden(runner, update):
+    """Compare the output of each golden case with the expected one."""
+    cases = read_expected()
+    failed = 0
+    for i, (comments, args, output) in enumerate(cases):
+        got = runner.csim(args)
+        got = ["error"] if got is None else got.splitlines()
+        if update:
+            cases[i] = (comments, args, got)
+        elif got != output:
+            failed += 1
+            print("FAIL: ./csim %s" % " ".join(args))
+            print("  expected: %s" % "\n            ".join(output))
+            print("  got:      %s" % "\n            ".join(got))
+    if update:
+        write_expected(cases)
+    return len(cases), failed
+
+
+def check_binary(runner):
+    """[user-008] Binary traces replay exactly as the text they came from."""
+    configs = (["-s", "4", "-E", "2", "-b", "4"],
+               ["-s", "1", "-E", "1", "-b", "3", "-p", "fifo"],
+               ["-s", "3", "-E", "2", "-b", "4", "-p", "opt"],
+               ["-s", "3", "-E", "2", "-b", "4", "-p", "opt",
+                "--opt-window", "100"])
+    for name in TRACES:
+        for config in configs:
+            text = runner.csim(config + ["-t", name + ".trace"])
+            binary = runner.csim(config + ["-t", name + ".bin"])
+            yield (text is not None and text == binary,
+                   "%s: %s" % (name, " ".join(config)))
+
+
+def check_sweep(runner):
+    """[user-009] --sweep-assoc gives each associativity's separate run."""
+    for name in TRACES:
+        for s, E, b in (("0", "8", "3"), ("2", "6", "4"), ("4", "4", "5")):
+            sweep = runner.csim(["--sweep-assoc", "-s", s, "-E", E, "-b", b,
+                                 "-t", name + ".trace"])
+            rows = re.findall(r"^\s*(\d+)\s+(\d+)\s+(\d+)\s+(\d+)$",
+                              sweep or "", re.M)
+            ok = len(rows) == int(E)
+            for e, hits, misses, evictions in rows:
+                alone = stats(runner.csim(["-s", s, "-E", e, "-b", b, "-t",
+                                           name + ".trace"]))
+                ok = ok and alone is not None and (
+                    (alone["hits"], alone["misses"], alone["evictions"]) ==
+                    (int(hits), int(misses), int(evictions)))
+            yield ok, "%s: -s %s -E 1..%s -b %s" % (name, s, E, b)
+
+
+def check_threads(runner):
+    """[user-011] -j N gives the same output as one thread."""
+    for name in ("long.trace", "long.bin", "trans.trace", "yi.trace"):
+        for policy in POLICIES:
+            config = ["-s", "4", "-E", "4", "-b", "4", "-p", policy, "-t",
+                      name]
+            serial = runner.csim(config)
+            for threads in ("2", "3", "16"):
+                parallel = runner.csim(["-j", threads] + config)
+                yield (serial is not None and parallel == serial,
+                       "%s: -j %s -p %s" % (name, threads, policy))
+
+
+def check_policies(runner):
+    """[user-013] Every policy is LRU when there is no choice of victim."""
+    for name in TRACES:
+        for s, b in (("0", "3"), ("2", "4"), ("5", "5")):
+            config = ["-s", s, "-E", "1", "-b", b, "-t", name + ".trace"]
+            lru = stats(runner.csim(config))
+            for policy in POLICIES:
+                other = stats(runner.csim(config + ["-p", policy]))
+                yield (lru is not None and other == lru,
+                       "%s: -s %s -E 1 -b %s -p %s" % (name, s, b, policy))
+
+
+def check_opt(runner):
+    """[user-015] OPT misses no more than any other policy."""
+    for name in TRACES:
+        for s, E, b in (("0", "4", "3"), ("2", "2", "4"), ("3", "8", "5")):
+            config = ["-s", s, "-E", E, "-b", b, "-t", name + ".trace"]
+            opt = stats(runner.csim(config + ["-p", "opt"]))
+            for policy in POLICIES:
+                other = stats(runner.csim(config + ["-p", policy]))
+                ok = opt is not None and other is not None and (
+                    opt["hits"] + opt["misses"] ==
+                    other["hits"] + other["misses"] and
+                    opt["misses"] <= other["misses"])
+                yield ok, "%s: -s %s -E %s -b %s -p %s" % (name, s, E, b,
+                                                          policy)
+
+
+def check_coherence(runner):
+    """[user-020] Coherent caches agree with one cache and across protocols."""
+    for name in TRACES:
+        config = ["-s", "2", "-E", "2", "-b", "4"]
+        alone = stats(runner.csim(config + ["-t", name + ".trace"]))
+        core = stats(runner.csim(["--coherence", "mesi"] + config +
+                                 ["-t", name + ".trace"]), "core0 ")
+        # Each writeback is a dirty 16-byte block the cache alone evicts
+        yield (alone is not None and core is not None and
+               all(alone[k] == core[k]
+                   for k in ("hits", "misses", "evictions")) and
+               core["writebacks"] * 16 == alone["dirty_bytes_evicted"],
+               "%s: one core" % name)
+
+        # Hand the accesses out to three cores, three at a time
+        with open(os.path.join(TRACES_DIR, name + ".trace")) as f:
+            lines = [line.rstrip("\n") + " %d" % (i // 3 % 3)
+                     for i, line in enumerate(f) if line.strip()]
+        shared = runner.write(name + ".cores", lines)
+        mesi = runner.csim(["--coherence", "mesi"] + config + ["-t", shared])
+        moesi = runner.csim(["--coherence", "moesi"] + config +
+                            ["-t", shared])
+        ok = mesi is not None and moesi is not None
+        for i in range(3):
+            a = stats(mesi, "core%d " % i)
+            b = stats(moesi, "core%d " % i)
+            if a is None and b is None:
+                continue
+            ok = ok and a is not None and b is not None and all(
+                a[k] == b[k] for k in ("hits", "misses", "evictions",
+                                       "upgrades", "invalidations")) and (
+                b["writebacks"] <= a["writebacks"] and
+                b["interventions"] >= a["interventions"])
+        yield ok, "%s: three cores, mesi against moesi" % name
+
+
+def check_split(runner):
+    """[user-021] --split-blocks accesses every block an access spans."""
+    for name in TRACES + ("span",):
+        for b in (0, 2, 3, 4):
+            # M records access each block twice, to load and then to store
+            records = blocks = 0
+            with open(os.path.join(TRACES_DIR, name + ".trace")) as f:
+                for line in f:
+                    fields = line.replace(",", " ").split()
+                    if not fields or fields[0] not in ("I", "L", "S", "M"):
+                        continue
+                    addr, size = int(fields[1], 16), max(int(fields[2]), 1)
+                    times = 2 if fields[0] == "M" else 1
+                    records += times
+                    blocks += times * (((addr + size - 1) >> b) -
+                                       (addr >> b) + 1)
+            config = ["-s", "2", "-E", "2", "-b", str(b), "-t",
+                      name + ".trace"]
+            whole = stats(runner.csim(config))
+            split = stats(runner.csim(["--split-blocks"] + config))
+            yield (whole is not None and split is not None and
+                   whole["hits"] + whole["misses"] == records and
+                   split["hits"] + split["misses"] == blocks,
+                   "%s: -b %d" % (name, b))
+
+
+def check_records(runner):
+    """[user-022] M and I records are the accesses they stand for."""
+    with open(os.path.join(TRACES_DIR, "lackey.trace")) as f:
+        records = [line.split() for line in f if line.strip()]
+    expanded = runner.write("expanded.trace", sum(
+        (["L " + arg, "S " + arg] if op == "M" else [op + " " + arg]
+         for op, arg in records), []))
+    loads = runner.write("loads.trace", ["L " + arg if op == "I" else
+                                         op + " " + arg
+                                         for op, arg in records])
+    fetches = runner.write("fetches.trace", ["L " + arg
+                                             for op, arg in records
+                                             if op == "I"])
+    data = runner.write("data.trace", [op + " " + arg for op, arg in records
+                                       if op != "I"])
+    for s, E, b in (("0", "4", "3"), ("2", "2", "4"), ("4", "1", "5")):
+        config = ["-s", s, "-E", E, "-b", b]
+        trace = runner.csim(config + ["-t", "lackey.trace"])
+        yield (trace is not None and
+               trace == runner.csim(config + ["-t", expanded]) and
+               trace == runner.csim(config + ["-t", loads]),
+               "lackey: -s %s -E %s -b %s, M as L and S, I as L" % (s, E, b))
+
+        split = runner.csim(["--icache", "%s,%s" % (s, E), "-s", "3", "-E",
+                             "2", "-b", b, "-t", "lackey.trace"])
+        icache = stats(split, "icache ")
+        alone = stats(runner.csim(config + ["-t", fetches]))
+        yield (icache is not None and alone is not None and
+               all(icache[k] == alone[k]
+                   for k in ("hits", "misses", "evictions")) and
+               stats(split) == stats(runner.csim(["-s", "3", "-E", "2",
+                                                  "-b", b, "-t", data])),
+               "lackey: --icache %s,%s -b %s" % (s, E, b))
+
+
+def check_victim(runner):
+    """[user-025] Victim and miss caches only see the cache's misses."""
+    for name in TRACES:
+        for s, E, b in (("0", "1", "3"), ("2", "1", "4"), ("3", "2", "4")):
+            config = ["-s", s, "-E", E, "-b", b, "-t", name + ".trace"]
+            alone = stats(runner.csim(config))
+            for option, prefix in (("--victim", "victim "),
+                                   ("--miss-cache", "miss_cache ")):
+                for entries in (1, 4):
+                    output = runner.csim([option, str(entries)] + config)
+                    main = stats(output)
+                    small = stats(output, prefix)
+                    ok = (alone is not None and main is not None and
+                          small is not None and
+                          all(main[k] == alone[k]
+                              for k in ("hits", "misses", "evictions")) and
+                          small["hits"] + small["misses"] == main["misses"])
+                    if ok and option == "--victim":
+                        # Each eviction moves a block in, each hit takes one
+                        # out, and what is left fits
+                        held = (main["evictions"] - small["hits"] -
+                                small["evictions"])
+                        ok = (0 <= held <= entries and
+                              small["dirty_bytes_moved"] ==
+                              main["dirty_bytes_evicted"])
+                    elif ok:
+                        # Each miss puts a block in, and dirty ones stay in
+                        # the cache
+                        held = small["misses"] - small["evictions"]
+                        ok = (0 <= held <= entries and
+                              small["dirty_bytes_moved"] == 0 and
+                              small["dirty_bytes_evicted"] == 0 and
+                              main == alone)
+                    yield ok, "%s: %s %d -s %s -E %s -b %s" % (
+                        name, option, entries, s, E, b)
+
+
+CHECKS = (check_binary, check_sweep, check_threads, check_policies,
+          check_opt, check_coherence, check_split, check_records,
+          check_victim)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--update", action="store_true",
+                        help="rewrite the golden outputs from ./csim")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmpdir:
+        runner = Runner(tmpdir)
+        total, failed = check_golden(runner, args.update)
+        print("golden outputs: %d/%d passed" % (total - failed, total))
+        for check in CHECKS:
+            results = list(check(runner))
+            for ok, what in results:
+                if not ok:
+                    print("FAIL: %s %s" % (check.__doc__.split("]")[0] + "]",
+                                           what))
+            passed = sum(ok for ok, _ in results)
+            print("%s: %d/%d passed" % (check.__name__, passed,
+                                        len(results)))
+            total += len(results)
+            failed += len(results) - passed
+
+    print("TEST_FEATURES_RESULTS=%d/%d" % (total - failed, total))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,199 @@
+/**
+ * @file tlb.c
+ * @brief A TLB hierarchy in front of a physically indexed cache
+ *
+ * Each level of the TLB is a csim cache whose blocks are pages, so it
+ * holds one translation per line and takes any replacement policy. A
+ * translation looks up the levels from L1 down and stops at the first
+ * that hits; each level that misses fills the page in, as in a
+ * non-inclusive hierarchy. A miss in every level walks the page table.
+ *
+ * Virtual pages map to physical frames through a fixed permutation of
+ * the page numbers, so that a trace always translates the same way yet
+ * consecutive virtual pages land in scattered frames, as they do after
+ * a process has run for a while. The page offset is kept, so a cache
+ * whose set index bits reach past the page offset sees the page colors
+ * the mapping picked rather than those of the virtual addresses.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tlb.h"
+
+/** @brief Bits of a virtual address that the page table maps */
+#define VIRTUAL_BITS 48
+
+/** @brief Bits of a virtual address resolved by each page table level */
+#define LEVEL_BITS 9
+
+/** @brief Odd multiplier of the first round of the page permutation */
+#define PAGE_MIX_1 0x9e3779b97f4a7c15UL
+
+/** @brief Odd multiplier of the second round of the page permutation */
+#define PAGE_MIX_2 0xbf58476d1ce4e5b9UL
+
+/**
+ * @brief TLB hierarchy
+ */
+struct tlb {
+    int page_bits;                        /* log page size */
+    int levels;                           /* number of levels */
+    int walk_reads;                       /* page table entries per walk */
+    unsigned long page_mask;              /* page numbers are below this */
+    int page_shift;                       /* shift of the permutation */
+    csim_cache_t *caches[TLB_MAX_LEVELS]; /* each level, from L1 down */
+};
+
+/**
+ * @brief Look up a page size by name
+ *
+ * @param[out] page_bits Log size of the page
+ *
+ * @return true if name is one of TLB_PAGE_SIZES, false otherwise
+ */
+bool tlb_parse_page(const char *name, int *page_bits) {
+    static const struct {
+        const char *name;
+        int bits;
+    } SIZES[] = {{"4k", 12}, {"2m", 21}, {"1g", 30}};
+    for (size_t i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); i++) {
+        if (strcmp(name, SIZES[i].name) == 0) {
+            *page_bits = SIZES[i].bits;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Parse the geometry of each level of a TLB
+ *
+ * @param[in]  spec   "<s>,<E>" for each level from L1 down, separated by
+ *                    '/', with at most TLB_MAX_LEVELS levels
+ * @param[out] config Its levels, s and E are set
+ *
+ * @return true on success, false if spec is malformed; the geometry
+ *         itself is checked by tlb_create()
+ */
+bool tlb_parse_levels(const char *spec, tlb_config_t *config) {
+    config->levels = 0;
+    while (config->levels < TLB_MAX_LEVELS) {
+        int level = config->levels;
+        int used;
+        if (sscanf(spec, "%d,%d%n", &config->s[level], &config->E[level],
+                   &used) != 2) {
+            return false;
+        }
+        config->levels++;
+        spec += used;
+        if (*spec == '\0') {
+            return true;
+        }
+        if (*spec != '/') {
+            return false;
+        }
+        spec++;
+    }
+    return false;
+}
+
+/**
+ * @brief Create an empty TLB hierarchy
+ *
+ * @return The hierarchy, or NULL if config is invalid (a page size not in
+ *         TLB_PAGE_SIZES, no levels or too many, or a level csim_create()
+ *         rejects) or out of memory
+ */
+tlb_t *tlb_create(const tlb_config_t *config) {
+    int bits = config->page_bits;
+    if (bits < LEVEL_BITS || bits >= VIRTUAL_BITS ||
+        (VIRTUAL_BITS - bits) % LEVEL_BITS != 0 || config->levels < 1 ||
+        config->levels > TLB_MAX_LEVELS) {
+        return NULL;
+    }
+    tlb_t *tlb = (tlb_t *)calloc(1, sizeof(tlb_t));
+    if (tlb == NULL) {
+        return NULL;
+    }
+    tlb->page_bits = bits;
+    tlb->levels = config->levels;
+    tlb->walk_reads = (VIRTUAL_BITS - bits) / LEVEL_BITS;
+    tlb->page_mask = (1UL << (64 - bits)) - 1;
+    tlb->page_shift = (64 - bits) / 2;
+    for (int i = 0; i < config->levels; i++) {
+        csim_config_t level = {.s = config->s[i],
+                               .E = config->E[i],
+                               .b = bits,
+                               .policy = config->policy};
+        tlb->caches[i] = csim_create(&level);
+        if (tlb->caches[i] == NULL) {
+            tlb_destroy(tlb);
+            return NULL;
+        }
+    }
+    return tlb;
+}
+
+/**
+ * @brief Free all memory used by a TLB hierarchy
+ */
+void tlb_destroy(tlb_t *tlb) {
+    for (int i = 0; i < tlb->levels; i++) {
+        if (tlb->caches[i] != NULL) {
+            csim_destroy(tlb->caches[i]);
+        }
+    }
+    free(tlb);
+}
+
+/**
+ * @brief Physical address a virtual address maps to
+ *
+ * The page number goes through two rounds of a multiplication by an odd
+ * constant and an xor with its own top half, each a bijection on the
+ * 64 - page_bits bits of a page number, so no two pages share a frame.
+ */
+unsigned long tlb_map(const tlb_t *tlb, unsigned long addr) {
+    unsigned long page = addr >> tlb->page_bits;
+    page = (page * PAGE_MIX_1) & tlb->page_mask;
+    page ^= page >> tlb->page_shift;
+    page = (page * PAGE_MIX_2) & tlb->page_mask;
+    page ^= page >> tlb->page_shift;
+    return (page << tlb->page_bits) | (addr & ((1UL << tlb->page_bits) - 1));
+}
+
+/**
+ * @brief Translate a virtual address through the TLB hierarchy
+ *
+ * @return The physical address, as from tlb_map()
+ */
+unsigned long tlb_translate(tlb_t *tlb, unsigned long addr) {
+    access_t lookup = {.addr = addr, .size = 1, .op = 'L'};
+    for (int i = 0; i < tlb->levels; i++) {
+        if (csim_access(tlb->caches[i], &lookup) == CSIM_HIT) {
+            break;
+        }
+    }
+    return tlb_map(tlb, addr);
+}
+
+/**
+ * @brief Copy the statistics of all translations so far
+ *
+ * @param[out] stats Hits and misses of each level, and the page walks of
+ *                   the misses in the last one
+ */
+void tlb_get_stats(const tlb_t *tlb, tlb_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->levels = tlb->levels;
+    for (int i = 0; i < tlb->levels; i++) {
+        csim_stats_t level;
+        csim_get_stats(tlb->caches[i], &level);
+        stats->hits[i] = level.hits;
+        stats->misses[i] = level.misses;
+    }
+    stats->walks = stats->misses[tlb->levels - 1];
+    stats->walk_reads = stats->walks * (unsigned long)tlb->walk_reads;
+}
@@ -0,0 +1,69 @@
+/**
+ * @file tlb.h
+ * @brief Prototypes for TLB and address translation simulation
+ */
+
+#ifndef CSIM_TLB_H
+#define CSIM_TLB_H
+
+#include <stdbool.h>
+
+#include "libcsim.h"
+
+/** @brief Largest number of TLB levels */
+#define TLB_MAX_LEVELS 3
+
+/** @brief Names of the page sizes, for tlb_parse_page() */
+#define TLB_PAGE_SIZES "4k, 2m, 1g"
+
+/**
+ * @brief Parameters of a TLB hierarchy
+ */
+typedef struct {
+    int page_bits;         /* log page size: 12, 21 or 30 */
+    int levels;            /* number of levels, from L1 down */
+    int s[TLB_MAX_LEVELS]; /* set index bits of each level */
+    int E[TLB_MAX_LEVELS]; /* associativity of each level */
+    const char *policy;    /* replacement policy, NULL for LRU */
+} tlb_config_t;
+
+/**
+ * @brief Statistics of a TLB hierarchy
+ *
+ * Every miss in the last level walks the page table, reading one entry
+ * per level of the x86-64 radix tree that maps the page size: 4 for 4K
+ * pages, 3 for 2M pages and 2 for 1G pages.
+ */
+typedef struct {
+    int levels;                           /* number of levels */
+    unsigned long hits[TLB_MAX_LEVELS];   /* translations found per level */
+    unsigned long misses[TLB_MAX_LEVELS]; /* translations passed down */
+    unsigned long walks;                  /* page walks */
+    unsigned long walk_reads;             /* page table entries read */
+} tlb_stats_t;
+
+/** @brief Opaque TLB hierarchy */
+typedef struct tlb tlb_t;
+
+/** @brief Look up a page size by name; false if there is none */
+bool tlb_parse_page(const char *name, int *page_bits);
+
+/** @brief Parse "<s>,<E>[/<s>,<E>...]" into levels; false if malformed */
+bool tlb_parse_levels(const char *spec, tlb_config_t *config);
+
+/** @brief Create an empty TLB hierarchy; NULL if invalid or out of memory */
+tlb_t *tlb_create(const tlb_config_t *config);
+
+/** @brief Free all memory used by a TLB hierarchy */
+void tlb_destroy(tlb_t *tlb);
+
+/** @brief Physical address a virtual address maps to, without the TLB */
+unsigned long tlb_map(const tlb_t *tlb, unsigned long addr);
+
+/** @brief Translate a virtual address through the TLB hierarchy */
+unsigned long tlb_translate(tlb_t *tlb, unsigned long addr);
+
+/** @brief Copy the statistics of all translations so far */
+void tlb_get_stats(const tlb_t *tlb, tlb_stats_t *stats);
+
+#endif /* CSIM_TLB_H */
@@ -0,0 +1,1030 @@
+/**
+ * @file trace.c
+ * @brief A fast reader and a writer for memory traces
+ *
+ * Text traces consist of lines of the form
+ * "<op> <hex address>,<decimal size>", optionally followed by a space and
+ * the decimal number of the core (or thread) that made the access; it is 0
+ * if absent. The op is 'L' (load), 'S' (store), 'M' (modify: a load and a
+ * store) or 'I' (instruction fetch), as in Valgrind's lackey traces, whose
+ * data records are indented. Regular files are memory-mapped and decoded
+ * in place; pipes and other unmappable inputs are streamed through a
+ * fixed-size buffer instead.
+ *
+ * Binary traces are recognized by their first bytes and hold the same
+ * records in about a quarter of the space:
+ *
+ *     header   magic "\x89CTR", u16 version, u16 flags
+ *     blocks   u32 record count (> 0), then that many records
+ *     end      u32 0
+ *     index    per block: u64 file offset, u64 number of its first record
+ *     trailer  u64 offset of index, u64 blocks, u64 records
+ *
+ * The index and trailer are only present if flags has BIN_FLAG_INDEX set.
+ * Each record is a byte holding the op in its high nibble and the size in
+ * its low nibble (0 if the size does not fit, in which case it follows as
+ * a varint), then the zig-zag encoded difference from the previous
+ * address in the block as a varint. If the top bit of the op is set, the
+ * record's core follows as a varint; records of core 0 leave it out, so
+ * untagged traces are unchanged. Integers are little-endian, varints
+ * hold 7 bits per byte, least significant first. Since addresses restart
+ * from 0 in each block, decoding can start at any block.
+ *
+ * The decoder avoids bounds checks in its inner loops: every field has a
+ * maximum width, so as long as MAX_LINE bytes are readable past the start
+ * of a record, it cannot run off the end of the window. The last few bytes
+ * of a trace are copied into a zero-padded buffer to keep that invariant.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+/** @brief Maximum number of hex digits in an address */
+#define MAX_HEX_DIGITS 16
+
+/** @brief Maximum number of decimal digits in a size */
+#define MAX_DEC_DIGITS 9
+
+/** @brief Maximum number of decimal digits in a core */
+#define MAX_CORE_DIGITS 5
+
+/** @brief Maximum number of spaces between the op and the address */
+#define MAX_SPACES 8
+
+/** @brief Upper bound on the bytes a decoder may read past a record start */
+#define MAX_LINE 64
+
+/** @brief Size of the buffer used when the trace cannot be mapped */
+#define STREAM_BUF_SIZE (1 << 20)
+
+/** @brief Version of the binary format written and understood */
+#define BIN_VERSION 1
+
+/** @brief Size of the binary header: magic, version and flags */
+#define BIN_HEADER_SIZE 8
+
+/** @brief Size of the binary trailer */
+#define BIN_TRAILER_SIZE 24
+
+/** @brief Size of a block index entry */
+#define BIN_INDEX_ENTRY_SIZE 16
+
+/** @brief Smallest size of a binary record: its op byte and one varint */
+#define BIN_MIN_RECORD_SIZE 2
+
+/** @brief Binary header flag: the trace ends in a block index and trailer */
+#define BIN_FLAG_INDEX 0x1
+
+/** @brief Number of records per block in binary traces written */
+#define BIN_BLOCK_RECORDS TRACE_BATCH
+
+/** @brief Maximum number of bytes in a varint */
+#define MAX_VARINT 10
+
+/** @brief Maximum size of a binary record: op byte and three varints */
+#define MAX_BIN_RECORD (1 + 3 * MAX_VARINT)
+
+/** @brief Bit of a binary op code meaning the record's core follows */
+#define BIN_OP_CORE 0x8
+
+#if MAX_BIN_RECORD + 4 > MAX_LINE
+#error "Binary records and block headers must fit in the decoder's margin"
+#endif
+
+/**
+ * @brief Trace reader state
+ *
+ * Records are decoded from the window [pos, end). Records may only start
+ * before safe_end; past that point the window must be refilled, unless it
+ * is final, in which case the bytes after end are zero padding. Binary
+ * traces use the same windows, and additionally track their position
+ * within the current block.
+ */
+struct trace {
+    int fd;                     /* file descriptor of the trace */
+    char *map;                  /* mapping of the whole file, or NULL */
+    size_t map_len;             /* length of the mapping */
+    char *buf;                  /* stream buffer, or tail buffer if mapped */
+    const char *pos;            /* next byte to decode */
+    const char *end;            /* end of the current window */
+    const char *safe_end;       /* records starting here may overrun end */
+    bool final;                 /* no more data after the current window */
+    unsigned long line;         /* current line (or binary record) number */
+    bool binary;                /* whether the trace is in binary format */
+    bool done;                  /* whether the binary end marker was read */
+    unsigned long block_left;   /* records left in the current binary block */
+    unsigned long prev_addr;    /* address of the previous binary record */
+    const unsigned char *index; /* block index of a mapped trace, or NULL */
+    unsigned long blocks;       /* number of entries in index */
+    unsigned long records;      /* number of records, if index is set */
+};
+
+/**
+ * @brief Trace writer state
+ *
+ * Binary records are encoded into a buffer holding one block, which is
+ * written out once it is full, so that its record count can precede it.
+ */
+struct trace_writer {
+    FILE *file;                  /* output file */
+    bool binary;                 /* whether to write the binary format */
+    bool error;                  /* whether a write has failed */
+    unsigned char *block;        /* encoded records of the current block */
+    size_t block_len;            /* number of bytes in block */
+    unsigned long block_records; /* number of records in block */
+    unsigned long prev_addr;     /* address of the previous record */
+    unsigned long records;       /* records written, excluding block */
+    unsigned long offset;        /* bytes written to file */
+    unsigned long *index;        /* offset and first record of each block */
+    size_t blocks;               /* number of blocks in index */
+    size_t index_cap;            /* capacity of index, in blocks */
+};
+
+/** @brief First bytes of a binary trace; the first is never valid text */
+static const unsigned char BIN_MAGIC[4] = {0x89, 'C', 'T', 'R'};
+
+/** @brief Access type of each binary op code, or 0 if invalid */
+static const char BIN_OPS[16] = {
+    'L', 'S', 'M', 'I', [BIN_OP_CORE] = 'L', 'S', 'M', 'I',
+};
+
+static void trace_refill(trace_t *trace);
+
+/* Whitespace that may separate records */
+static const bool IS_SPACE[256] = {
+    [' '] = true, ['\t'] = true, ['\r'] = true, ['\n'] = true,
+};
+
+/* Characters that may follow a record; NUL marks the end of a final window */
+static const bool IS_RECORD_END[256] = {
+    [' '] = true, ['\t'] = true, ['\r'] = true, ['\n'] = true, ['\0'] = true,
+};
+
+/* Access types accepted in the op field */
+static const bool IS_OP[256] = {
+    ['L'] = true,
+    ['S'] = true,
+    ['M'] = true,
+    ['I'] = true,
+};
+
+/**
+ * @brief Load a little-endian integer of the given number of bytes
+ */
+static inline unsigned long load_le(const unsigned char *u, int bytes) {
+    unsigned long value = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        value = (value << 8) | u[i];
+    }
+    return value;
+}
+
+/**
+ * @brief Store a little-endian integer of the given number of bytes
+ *
+ * @return The byte after the stored integer
+ */
+static inline unsigned char *store_le(unsigned char *u, unsigned long value,
+                                      int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        u[i] = (unsigned char)(value >> (8 * i));
+    }
+    return u + bytes;
+}
+
+/**
+ * @brief Decode a varint of at most MAX_VARINT bytes
+ *
+ * @return The byte after the varint, or NULL if it is too long
+ */
+static inline const unsigned char *decode_varint(const unsigned char *u,
+                                                 unsigned long *value) {
+    unsigned long v = 0;
+    for (int i = 0; i < MAX_VARINT; i++) {
+        v |= (unsigned long)(u[i] & 0x7f) << (7 * i);
+        if (u[i] < 0x80) {
+            *value = v;
+            return u + i + 1;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Encode a varint
+ *
+ * @return The byte after the varint
+ */
+static inline unsigned char *encode_varint(unsigned char *u,
+                                           unsigned long value) {
+    while (value >= 0x80) {
+        *u++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *u++ = (unsigned char)value;
+    return u;
+}
+
+/**
+ * @brief Point the window of a mapped trace at an offset into the file
+ */
+static void trace_map_window(trace_t *trace, size_t offset) {
+    trace->pos = trace->map + offset;
+    trace->end = trace->map + trace->map_len;
+    trace->safe_end = (trace->map_len - offset > MAX_LINE)
+                          ? trace->end - MAX_LINE
+                          : trace->pos;
+    trace->final = false;
+}
+
+/**
+ * @brief Recognize a binary trace and consume its header
+ *
+ * The index of a mapped binary trace is only used if the trailer agrees
+ * with the size of the file, and its record count with the file's last
+ * block; otherwise the trace can still be read, just not seeked, and its
+ * number of records is unknown.
+ *
+ * @return false if the trace is binary but its header is unsupported
+ */
+static bool trace_detect(trace_t *trace) {
+    const unsigned char *u = (const unsigned char *)trace->pos;
+    size_t avail = (size_t)(trace->end - trace->pos);
+    if (avail < sizeof(BIN_MAGIC) ||
+        memcmp(u, BIN_MAGIC, sizeof(BIN_MAGIC)) != 0) {
+        return true;
+    }
+    if (avail < BIN_HEADER_SIZE || load_le(u + 4, 2) != BIN_VERSION) {
+        return false;
+    }
+    unsigned long flags = load_le(u + 6, 2);
+    trace->binary = true;
+    trace->pos += BIN_HEADER_SIZE;
+    trace->line = 0;
+
+    if (trace->map == NULL || !(flags & BIN_FLAG_INDEX) ||
+        trace->map_len < BIN_HEADER_SIZE + BIN_TRAILER_SIZE) {
+        return true;
+    }
+    const unsigned char *trailer = (const unsigned char *)trace->map +
+                                   trace->map_len - BIN_TRAILER_SIZE;
+    unsigned long index_at = load_le(trailer, 8);
+    unsigned long blocks = load_le(trailer + 8, 8);
+    unsigned long records = load_le(trailer + 16, 8);
+    if (index_at < BIN_HEADER_SIZE ||
+        blocks > (trace->map_len - BIN_TRAILER_SIZE) / BIN_INDEX_ENTRY_SIZE ||
+        index_at + blocks * BIN_INDEX_ENTRY_SIZE !=
+            trace->map_len - BIN_TRAILER_SIZE ||
+        records > (index_at - BIN_HEADER_SIZE) / BIN_MIN_RECORD_SIZE) {
+        return true;
+    }
+
+    /* The last block must end exactly at the record count */
+    const unsigned char *map = (const unsigned char *)trace->map;
+    unsigned long counted = 0;
+    if (blocks > 0) {
+        const unsigned char *last =
+            map + index_at + (blocks - 1) * BIN_INDEX_ENTRY_SIZE;
+        unsigned long offset = load_le(last, 8);
+        unsigned long first = load_le(last + 8, 8);
+        if (offset < BIN_HEADER_SIZE || offset > index_at - 4 ||
+            first > records) {
+            return true;
+        }
+        counted = first + load_le(map + offset, 4);
+    }
+    if (counted != records) {
+        return true;
+    }
+    trace->index = map + index_at;
+    trace->blocks = blocks;
+    trace->records = records;
+    return true;
+}
+
+/**
+ * @brief Open a trace file for reading
+ *
+ * Text and binary traces are told apart by their first bytes.
+ *
+ * @param[in] filename Path of the trace, or "-" for standard input
+ *
+ * @return The new trace reader, or NULL if the file could not be opened
+ *         or is a binary trace of an unsupported version
+ */
+trace_t *trace_open(const char *filename) {
+    trace_t *trace = (trace_t *)calloc(1, sizeof(trace_t));
+    if (trace == NULL) {
+        return NULL;
+    }
+
+    if (strcmp(filename, "-") == 0) {
+        trace->fd = STDIN_FILENO;
+    } else {
+        trace->fd = open(filename, O_RDONLY);
+        if (trace->fd < 0) {
+            free(trace);
+            return NULL;
+        }
+    }
+
+    struct stat st;
+    if (fstat(trace->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        trace->map_len = (size_t)st.st_size;
+        void *map = mmap(NULL, trace->map_len, PROT_READ, MAP_PRIVATE,
+                         trace->fd, 0);
+        if (map != MAP_FAILED) {
+            trace->map = (char *)map;
+            posix_madvise(map, trace->map_len, POSIX_MADV_SEQUENTIAL);
+        }
+    }
+
+    /* Mapped files only need room to pad their tail */
+    size_t buf_size = (trace->map != NULL) ? MAX_LINE : STREAM_BUF_SIZE;
+    trace->buf = (char *)malloc(buf_size + MAX_LINE);
+    if (trace->buf == NULL) {
+        trace_close(trace);
+        return NULL;
+    }
+
+    if (trace->map != NULL) {
+        trace_map_window(trace, 0);
+    } else {
+        trace->pos = trace->end = trace->safe_end = trace->buf;
+        trace_refill(trace);
+    }
+    trace->line = 1;
+    if (!trace_detect(trace)) {
+        trace_close(trace);
+        return NULL;
+    }
+    return trace;
+}
+
+/**
+ * @brief Refill the window once decoding reaches safe_end
+ *
+ * Mapped traces copy their remaining bytes into the zero-padded tail
+ * buffer. Streamed traces move the unconsumed bytes to the front of the
+ * buffer and read until it is full or the input is exhausted.
+ */
+static void trace_refill(trace_t *trace) {
+    size_t rem = (size_t)(trace->end - trace->pos);
+    memmove(trace->buf, trace->pos, rem);
+
+    size_t len = rem;
+    if (trace->map == NULL) {
+        while (len < STREAM_BUF_SIZE) {
+            ssize_t got = read(trace->fd, trace->buf + len,
+                               STREAM_BUF_SIZE - len);
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got <= 0) {
+                trace->final = true;
+                break;
+            }
+            len += (size_t)got;
+        }
+    } else {
+        trace->final = true;
+    }
+
+    trace->pos = trace->buf;
+    trace->end = trace->buf + len;
+    if (trace->final) {
+        memset(trace->buf + len, 0, MAX_LINE);
+        trace->safe_end = trace->end;
+    } else {
+        trace->safe_end = trace->end - MAX_LINE;
+    }
+}
+
+/** @brief Flag set in HEX_VALUE for valid hex digits */
+#define HEX_VALID 0x10
+
+/* Decoded value of each hex digit, or 0 if the character is not one */
+static const unsigned char HEX_VALUE[256] = {
+    ['0'] = HEX_VALID | 0x0, ['1'] = HEX_VALID | 0x1, ['2'] = HEX_VALID | 0x2,
+    ['3'] = HEX_VALID | 0x3, ['4'] = HEX_VALID | 0x4, ['5'] = HEX_VALID | 0x5,
+    ['6'] = HEX_VALID | 0x6, ['7'] = HEX_VALID | 0x7, ['8'] = HEX_VALID | 0x8,
+    ['9'] = HEX_VALID | 0x9, ['a'] = HEX_VALID | 0xa, ['b'] = HEX_VALID | 0xb,
+    ['c'] = HEX_VALID | 0xc, ['d'] = HEX_VALID | 0xd, ['e'] = HEX_VALID | 0xe,
+    ['f'] = HEX_VALID | 0xf, ['A'] = HEX_VALID | 0xa, ['B'] = HEX_VALID | 0xb,
+    ['C'] = HEX_VALID | 0xc, ['D'] = HEX_VALID | 0xd, ['E'] = HEX_VALID | 0xe,
+    ['F'] = HEX_VALID | 0xf,
+};
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+/** @brief A byte value repeated in every byte of a word */
+#define BYTES(c) (0x0101010101010101UL * (uint64_t)(c))
+
+/**
+ * @brief Mark the bytes of x within [lo, hi], for bytes below 0x80
+ *
+ * @return A word with the high bit of each matching byte set
+ */
+static inline uint64_t bytes_in_range(uint64_t x, unsigned lo, unsigned hi) {
+    return (x + BYTES(0x80 - lo)) & ~(x + BYTES(0x7f - hi)) & BYTES(0x80);
+}
+
+/**
+ * @brief Decode exactly 8 hex digits, the common address width
+ *
+ * @param[in]  u     Start of the digits
+ * @param[out] value The decoded value
+ *
+ * @return true if all 8 characters were hex digits
+ */
+static inline bool decode_hex8(const unsigned char *u, unsigned long *value) {
+    uint64_t x;
+    memcpy(&x, u, sizeof(x));
+    uint64_t hex = (bytes_in_range(x, '0', '9') |
+                    bytes_in_range(x | BYTES(0x20), 'a', 'f')) &
+                   ~x;
+    if (hex != BYTES(0x80)) {
+        return false;
+    }
+
+    /* Nibble values, first character in the lowest byte */
+    uint64_t v = (x & BYTES(0x0f)) + 9 * ((x >> 6) & BYTES(0x01));
+    v = ((v << 4) + (v >> 8)) & 0x00ff00ff00ff00ffUL;
+    v = ((v << 8) + (v >> 16)) & 0x0000ffff0000ffffUL;
+    v = ((v << 16) + (v >> 32)) & 0x00000000ffffffffUL;
+    *value = v;
+    return true;
+}
+
+#endif
+
+/**
+ * @brief Decode a hex number of up to MAX_HEX_DIGITS digits
+ *
+ * @param[in]  u     Start of the number
+ * @param[out] value The decoded value
+ *
+ * @return The number of digits decoded
+ */
+static inline int decode_hex(const unsigned char *u, unsigned long *value) {
+#ifdef BYTES
+    if (u[8] == ',' && decode_hex8(u, value)) {
+        return 8;
+    }
+#endif
+    unsigned long addr = 0;
+    int i;
+    for (i = 0; i < MAX_HEX_DIGITS; i++) {
+        unsigned int h = HEX_VALUE[u[i]];
+        if (!(h & HEX_VALID)) {
+            break;
+        }
+        addr = (addr << 4) | (h & 0xf);
+    }
+    *value = addr;
+    return i;
+}
+
+/**
+ * @brief Decode one record starting at p
+ *
+ * @param[in]  p  First character of the record (its op)
+ * @param[out] op The decoded access
+ *
+ * @return Pointer just past the record, or NULL if it is malformed
+ */
+static const char *parse_record(const char *p, access_t *op) {
+    const unsigned char *u = (const unsigned char *)p;
+    int i;
+
+    char type = (char)u[0];
+    if (!IS_OP[u[0]] || u[1] != ' ') {
+        return NULL;
+    }
+    u++;
+    for (i = 0; i < MAX_SPACES && *u == ' '; i++) {
+        u++;
+    }
+
+    unsigned long addr;
+    i = decode_hex(u, &addr);
+    if (i == 0 || u[i] != ',') {
+        return NULL;
+    }
+    u += i + 1;
+
+    unsigned int size = 0;
+    for (i = 0; i < MAX_DEC_DIGITS; i++) {
+        unsigned int d = (unsigned int)u[i] - '0';
+        if (d > 9) {
+            break;
+        }
+        size = size * 10 + d;
+    }
+    if (i == 0) {
+        return NULL;
+    }
+    u += i;
+
+    unsigned int core = 0;
+    if (u[0] == ' ' && (unsigned int)u[1] - '0' <= 9) {
+        u++;
+        for (i = 0; i < MAX_CORE_DIGITS; i++) {
+            unsigned int d = (unsigned int)u[i] - '0';
+            if (d > 9) {
+                break;
+            }
+            core = core * 10 + d;
+        }
+        if (core > USHRT_MAX) {
+            return NULL;
+        }
+        u += i;
+    }
+    if (!IS_RECORD_END[u[0]]) {
+        return NULL;
+    }
+
+    op->addr = addr;
+    op->size = size;
+    op->op = type;
+    op->core = (unsigned short)core;
+    return (const char *)u;
+}
+
+/**
+ * @brief Decode a batch of records from a binary trace
+ *
+ * @return As for trace_read()
+ */
+static long trace_read_binary(trace_t *trace, access_t *ops, size_t max) {
+    const unsigned char *p = (const unsigned char *)trace->pos;
+    const unsigned char *safe_end = (const unsigned char *)trace->safe_end;
+    unsigned long left = trace->block_left;
+    unsigned long addr = trace->prev_addr;
+    unsigned long record = trace->line;
+    size_t n = 0;
+    long result = -1;
+
+    while (n < max && !trace->done) {
+        if (p >= safe_end) {
+            if (trace->final) {
+                /* The data ended, or a record ran into the padding */
+                goto out;
+            }
+            trace->pos = (const char *)p;
+            trace_refill(trace);
+            p = (const unsigned char *)trace->pos;
+            safe_end = (const unsigned char *)trace->safe_end;
+            continue;
+        }
+
+        if (left == 0) {
+            left = load_le(p, 4);
+            p += 4;
+            addr = 0;
+            if (left == 0) {
+                if (p > (const unsigned char *)trace->end) {
+                    goto out;
+                }
+                trace->done = true;
+            }
+            continue;
+        }
+
+        record++;
+        unsigned int code = *p++;
+        char op = BIN_OPS[code >> 4];
+        unsigned long size = code & 0xf;
+        unsigned long delta;
+        unsigned long core = 0;
+        if (op == 0 || (size == 0 && (p = decode_varint(p, &size)) == NULL) ||
+            size > UINT_MAX || (p = decode_varint(p, &delta)) == NULL) {
+            goto out;
+        }
+        if (code >= (BIN_OP_CORE << 4) &&
+            ((p = decode_varint(p, &core)) == NULL || core > USHRT_MAX)) {
+            goto out;
+        }
+        addr += (delta >> 1) ^ (0UL - (delta & 1));
+        ops[n] = (access_t){.addr = addr,
+                            .size = (unsigned int)size,
+                            .op = op,
+                            .core = (unsigned short)core};
+        left--;
+        n++;
+    }
+    result = (long)n;
+
+out:
+    trace->pos = (const char *)p;
+    trace->block_left = left;
+    trace->prev_addr = addr;
+    trace->line = record;
+    return result;
+}
+
+/**
+ * @brief Decode a batch of records from a trace
+ *
+ * @param[in]  trace The trace to read from
+ * @param[out] ops   Array receiving the decoded accesses
+ * @param[in]  max   Capacity of ops
+ *
+ * @return Number of records decoded, 0 at end of trace, or -1 if a
+ *         malformed record was found (see trace_line())
+ */
+long trace_read(trace_t *trace, access_t *ops, size_t max) {
+    if (trace->binary) {
+        return trace_read_binary(trace, ops, max);
+    }
+
+    /* Work on locals: stores through ops may alias the reader state */
+    const char *p = trace->pos;
+    const char *safe_end = trace->safe_end;
+    unsigned long line = trace->line;
+    size_t n = 0;
+    long result;
+
+    while (n < max) {
+        if (p >= safe_end) {
+            if (trace->final) {
+                break;
+            }
+            trace->pos = p;
+            trace_refill(trace);
+            p = trace->pos;
+            safe_end = trace->safe_end;
+            continue;
+        }
+
+        unsigned char c = (unsigned char)*p;
+        if (IS_SPACE[c]) {
+            line += (c == '\n');
+            p++;
+            continue;
+        }
+
+        const char *next = parse_record(p, &ops[n]);
+        if (next == NULL) {
+            result = -1;
+            goto out;
+        }
+        /* Consume the usual trailing newline without another iteration */
+        bool newline = (*next == '\n');
+        line += newline;
+        p = next + newline;
+        n++;
+    }
+    result = (long)n;
+
+out:
+    trace->pos = p;
+    trace->line = line;
+    return result;
+}
+
+/**
+ * @brief Decode all remaining records of a trace into memory
+ *
+ * Indexed binary traces know their number of records, so the array is
+ * allocated at its final size up front; otherwise it grows by doubling.
+ * The count comes from the trailer, which trace_open() has checked
+ * against the size of the file, but an array that large may still not
+ * be addressable, and then it grows from TRACE_BATCH as well.
+ *
+ * @param[in]  trace The trace to read from
+ * @param[out] ops   Set to the decoded accesses, to be freed by the
+ *                   caller, or to NULL on error
+ *
+ * @return Number of records decoded, -1 if a malformed record was found
+ *         (see trace_line()), or -2 if memory allocation failed
+ */
+long trace_read_all(trace_t *trace, access_t **ops) {
+    size_t capacity = (size_t)TRACE_BATCH;
+    if (trace->index != NULL &&
+        trace->records < SIZE_MAX / sizeof(access_t) - 1) {
+        capacity = trace->records + 1;
+    }
+    size_t used = 0;
+    access_t *buf = (access_t *)malloc(capacity * sizeof(access_t));
+    long n = 0;
+    while (buf != NULL &&
+           (n = trace_read(trace, &buf[used], capacity - used)) > 0) {
+        used += (size_t)n;
+        if (used == capacity) {
+            capacity *= 2;
+            access_t *grown =
+                (access_t *)realloc(buf, capacity * sizeof(access_t));
+            if (grown == NULL) {
+                free(buf);
+            }
+            buf = grown;
+        }
+    }
+    *ops = NULL;
+    if (buf == NULL) {
+        return -2;
+    }
+    if (n < 0) {
+        free(buf);
+        return -1;
+    }
+    *ops = buf;
+    return (long)used;
+}
+
+/**
+ * @brief Line number of the last record examined
+ *
+ * For binary traces, this is the number of the record instead, from 1.
+ */
+unsigned long trace_line(const trace_t *trace) {
+    return trace->line;
+}
+
+/**
+ * @brief Format of an open trace
+ */
+trace_format_t trace_format(const trace_t *trace) {
+    return trace->binary ? TRACE_BINARY : TRACE_TEXT;
+}
+
+/**
+ * @brief Number of records in a trace, if it is known without reading it
+ *
+ * @return The number of records of an indexed binary trace, or -1 for
+ *         other traces
+ */
+long trace_records(const trace_t *trace) {
+    return (trace->index != NULL) ? (long)trace->records : -1;
+}
+
+/**
+ * @brief Position a trace so that the next record read is the given one
+ *
+ * Only memory-mapped binary traces with a block index support this. The
+ * block holding the record is found by binary search of the index, and
+ * the records before it in the block are decoded and dropped.
+ *
+ * @param[in] record Number of the record, from 0
+ *
+ * @return true on success, false if the trace cannot seek there
+ */
+bool trace_seek(trace_t *trace, unsigned long record) {
+    if (trace->index == NULL || record > trace->records) {
+        return false;
+    }
+    unsigned long lo = 0;
+    unsigned long hi = trace->blocks;
+    while (hi - lo > 1) {
+        unsigned long mid = lo + (hi - lo) / 2;
+        if (load_le(trace->index + mid * BIN_INDEX_ENTRY_SIZE + 8, 8) <=
+            record) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    unsigned long offset = BIN_HEADER_SIZE;
+    unsigned long first = 0;
+    if (trace->blocks > 0) {
+        offset = load_le(trace->index + lo * BIN_INDEX_ENTRY_SIZE, 8);
+        first = load_le(trace->index + lo * BIN_INDEX_ENTRY_SIZE + 8, 8);
+    }
+    if (offset >= trace->map_len || first > record) {
+        return false;
+    }
+    trace_map_window(trace, offset);
+    trace->done = false;
+    trace->block_left = 0;
+    trace->line = first;
+
+    access_t skipped[64];
+    for (unsigned long left = record - first; left > 0;) {
+        size_t max = (left < 64) ? left : 64;
+        long n = trace_read(trace, skipped, max);
+        if (n <= 0) {
+            return false;
+        }
+        left -= (unsigned long)n;
+    }
+    return true;
+}
+
+/**
+ * @brief Close a trace and release its resources
+ *
+ * @param[in] trace the trace to close
+ */
+void trace_close(trace_t *trace) {
+    if (trace->map != NULL) {
+        munmap(trace->map, trace->map_len);
+    }
+    if (trace->fd != STDIN_FILENO) {
+        close(trace->fd);
+    }
+    free(trace->buf);
+    free(trace);
+}
+
+/**
+ * @brief Write bytes to a trace being written, tracking errors and offset
+ */
+static void writer_put(trace_writer_t *writer, const void *data,
+                       size_t bytes) {
+    if (fwrite(data, 1, bytes, writer->file) != bytes) {
+        writer->error = true;
+    }
+    writer->offset += bytes;
+}
+
+/**
+ * @brief Create a trace file for writing
+ *
+ * @param[in] filename Path of the trace, or "-" for standard output
+ * @param[in] format   Format to write the trace in
+ *
+ * @return The new trace writer, or NULL if the file could not be created
+ */
+trace_writer_t *trace_create(const char *filename, trace_format_t format) {
+    trace_writer_t *writer =
+        (trace_writer_t *)calloc(1, sizeof(trace_writer_t));
+    if (writer == NULL) {
+        return NULL;
+    }
+    writer->binary = (format == TRACE_BINARY);
+    if (writer->binary) {
+        writer->block = (unsigned char *)malloc(BIN_BLOCK_RECORDS *
+                                                MAX_BIN_RECORD);
+        if (writer->block == NULL) {
+            free(writer);
+            return NULL;
+        }
+    }
+    writer->file =
+        (strcmp(filename, "-") == 0) ? stdout : fopen(filename, "wb");
+    if (writer->file == NULL) {
+        free(writer->block);
+        free(writer);
+        return NULL;
+    }
+
+    if (writer->binary) {
+        unsigned char header[BIN_HEADER_SIZE];
+        memcpy(header, BIN_MAGIC, sizeof(BIN_MAGIC));
+        store_le(store_le(header + 4, BIN_VERSION, 2), BIN_FLAG_INDEX, 2);
+        writer_put(writer, header, sizeof(header));
+    }
+    return writer;
+}
+
+/**
+ * @brief Write out the current block of a binary trace, if not empty
+ */
+static void writer_flush_block(trace_writer_t *writer) {
+    if (writer->block_records == 0) {
+        return;
+    }
+    if (writer->blocks == writer->index_cap) {
+        size_t cap = (writer->index_cap == 0) ? 64 : 2 * writer->index_cap;
+        unsigned long *index = (unsigned long *)realloc(
+            writer->index, 2 * cap * sizeof(unsigned long));
+        if (index == NULL) {
+            writer->error = true;
+            return;
+        }
+        writer->index = index;
+        writer->index_cap = cap;
+    }
+    writer->index[2 * writer->blocks] = writer->offset;
+    writer->index[2 * writer->blocks + 1] = writer->records;
+    writer->blocks++;
+
+    unsigned char count[4];
+    store_le(count, writer->block_records, 4);
+    writer_put(writer, count, sizeof(count));
+    writer_put(writer, writer->block, writer->block_len);
+    writer->records += writer->block_records;
+    writer->block_records = 0;
+    writer->block_len = 0;
+    writer->prev_addr = 0;
+}
+
+/**
+ * @brief Binary op code of an access type
+ *
+ * @return The op code, or -1 if the access type is not supported
+ */
+static int bin_op_code(char op) {
+    for (int code = 0; code < 16; code++) {
+        if (BIN_OPS[code] != 0 && BIN_OPS[code] == op) {
+            return code;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Append records to a trace
+ *
+ * @return false if an access cannot be represented (its op is not 'L',
+ *         'S', 'M' or 'I'), otherwise true; write errors are reported by
+ *         trace_finish()
+ */
+bool trace_write(trace_writer_t *writer, const access_t *ops, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        int code = bin_op_code(ops[i].op);
+        if (code < 0) {
+            return false;
+        }
+        unsigned int core = ops[i].core;
+        if (!writer->binary) {
+            int written =
+                (core == 0) ? fprintf(writer->file, "%c %lx,%u\n", ops[i].op,
+                                      ops[i].addr, ops[i].size)
+                            : fprintf(writer->file, "%c %lx,%u %u\n",
+                                      ops[i].op, ops[i].addr, ops[i].size,
+                                      core);
+            if (written < 0) {
+                writer->error = true;
+            }
+            continue;
+        }
+
+        unsigned char *u = writer->block + writer->block_len;
+        unsigned int size = ops[i].size;
+        if (core != 0) {
+            code |= BIN_OP_CORE;
+        }
+        *u++ = (unsigned char)(((unsigned int)code << 4) |
+                               ((size < 16) ? size : 0));
+        if (size == 0 || size >= 16) {
+            u = encode_varint(u, size);
+        }
+        unsigned long delta = ops[i].addr - writer->prev_addr;
+        u = encode_varint(u, (delta << 1) ^ (0UL - (delta >> 63)));
+        if (core != 0) {
+            u = encode_varint(u, core);
+        }
+        writer->prev_addr = ops[i].addr;
+        writer->block_len = (size_t)(u - writer->block);
+        if (++writer->block_records == BIN_BLOCK_RECORDS) {
+            writer_flush_block(writer);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Finish writing a trace and close it
+ *
+ * Binary traces get their end marker, block index and trailer here.
+ *
+ * @return true if the whole trace was written successfully
+ */
+bool trace_finish(trace_writer_t *writer) {
+    if (writer->binary) {
+        writer_flush_block(writer);
+        unsigned char end[4] = {0};
+        writer_put(writer, end, sizeof(end));
+
+        unsigned long index_at = writer->offset;
+        for (size_t i = 0; i < writer->blocks; i++) {
+            unsigned char entry[BIN_INDEX_ENTRY_SIZE];
+            store_le(store_le(entry, writer->index[2 * i], 8),
+                     writer->index[2 * i + 1], 8);
+            writer_put(writer, entry, sizeof(entry));
+        }
+        unsigned char trailer[BIN_TRAILER_SIZE];
+        unsigned char *u = store_le(trailer, index_at, 8);
+        u = store_le(u, writer->blocks, 8);
+        store_le(u, writer->records, 8);
+        writer_put(writer, trailer, sizeof(trailer));
+    }
+
+    bool ok = !writer->error;
+    if (writer->file == stdout) {
+        ok = (fflush(stdout) == 0) && ok;
+    } else {
+        ok = (fclose(writer->file) == 0) && ok;
+    }
+    free(writer->block);
+    free(writer->index);
+    free(writer);
+    return ok;
+}
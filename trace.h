@@ -0,0 +1,72 @@
+/**
+ * @file trace.h
+ * @brief Prototypes for the memory trace reader and writer
+ */
+
+#ifndef CSIM_TRACE_H
+#define CSIM_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** @brief Number of accesses decoded per call by the simulator */
+#define TRACE_BATCH 4096
+
+/**
+ * @brief Struct representing a single decoded trace record
+ */
+typedef struct {
+    unsigned long addr;  /* address of the access */
+    unsigned int size;   /* number of bytes accessed */
+    char op;             /* access type, 'L', 'S', 'M' or 'I' */
+    unsigned short core; /* core (or thread) that made it, 0 if untagged */
+} access_t;
+
+/**
+ * @brief Trace file formats
+ */
+typedef enum {
+    TRACE_TEXT,   /* one "<op> <hex address>,<size>[ <core>]" per line */
+    TRACE_BINARY, /* delta and varint encoded, with a block index */
+} trace_format_t;
+
+/** @brief Opaque trace reader state */
+typedef struct trace trace_t;
+
+/** @brief Opaque trace writer state */
+typedef struct trace_writer trace_writer_t;
+
+/** @brief Open a trace file ("-" for stdin) of either format for reading */
+trace_t *trace_open(const char *filename);
+
+/** @brief Decode up to max records; returns count, 0 at EOF, -1 on error */
+long trace_read(trace_t *trace, access_t *ops, size_t max);
+
+/** @brief Decode all remaining records; returns count, -1 or -2 on error */
+long trace_read_all(trace_t *trace, access_t **ops);
+
+/** @brief Line number of the last record examined, for error messages */
+unsigned long trace_line(const trace_t *trace);
+
+/** @brief Format of an open trace */
+trace_format_t trace_format(const trace_t *trace);
+
+/** @brief Number of records of an indexed binary trace, -1 if unknown */
+long trace_records(const trace_t *trace);
+
+/** @brief Make record (from 0) the next one read; binary files only */
+bool trace_seek(trace_t *trace, unsigned long record);
+
+/** @brief Close a trace and release its resources */
+void trace_close(trace_t *trace);
+
+/** @brief Create a trace file ("-" for stdout) for writing */
+trace_writer_t *trace_create(const char *filename, trace_format_t format);
+
+/** @brief Append records; returns false if one has an unsupported op */
+bool trace_write(trace_writer_t *writer, const access_t *ops, size_t n);
+
+/** @brief Finish and close a trace; returns false if writing failed */
+bool trace_finish(trace_writer_t *writer);
+
+#endif /* CSIM_TRACE_H */
@@ -0,0 +1,112 @@
+/**
+ * @file tracecvt.c
+ * @brief Convert memory traces between the text and binary formats
+ *
+ * The input format is detected automatically. By default the output is in
+ * the other format, so converting a trace twice gives back an equivalent
+ * trace (addresses are written without leading zeros).
+ */
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+/**
+ * @brief Helper function to print usage info
+ */
+static void print_usage(void) {
+    printf("Usage: ./tracecvt [-h] [-f <format>] <input> <output>\n"
+           "-h: Optional help flag that prints usage info\n"
+           "-f <format>: Output format, text or binary (default: the format "
+           "the input is not in)\n"
+           "<input>, <output>: Trace files, or - for stdin/stdout\n");
+}
+
+/**
+ * @brief Size of a file, or 0 if it is not a regular file
+ */
+static long file_size(const char *filename) {
+    struct stat st;
+    if (strcmp(filename, "-") == 0 || stat(filename, &st) != 0 ||
+        !S_ISREG(st.st_mode)) {
+        return 0;
+    }
+    return (long)st.st_size;
+}
+
+int main(int argc, char *argv[]) {
+    const char *format = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "hf:")) != -1) {
+        switch (opt) {
+        case 'f':
+            format = optarg;
+            break;
+        case 'h':
+        default:
+            print_usage();
+            return (opt == 'h') ? 0 : -1;
+        }
+    }
+    if (argc - optind != 2 ||
+        (format != NULL && strcmp(format, "text") != 0 &&
+         strcmp(format, "binary") != 0)) {
+        print_usage();
+        return -1;
+    }
+    const char *input = argv[optind];
+    const char *output = argv[optind + 1];
+
+    trace_t *trace = trace_open(input);
+    if (trace == NULL) {
+        fprintf(stderr, "Open file error\n");
+        return -1;
+    }
+    trace_format_t out_format;
+    if (format != NULL) {
+        out_format = (strcmp(format, "binary") == 0) ? TRACE_BINARY
+                                                     : TRACE_TEXT;
+    } else {
+        out_format =
+            (trace_format(trace) == TRACE_TEXT) ? TRACE_BINARY : TRACE_TEXT;
+    }
+    trace_writer_t *writer = trace_create(output, out_format);
+    if (writer == NULL) {
+        fprintf(stderr, "Create file error\n");
+        trace_close(trace);
+        return -1;
+    }
+
+    static access_t ops[TRACE_BATCH];
+    unsigned long records = 0;
+    long n;
+    while ((n = trace_read(trace, ops, TRACE_BATCH)) > 0) {
+        trace_write(writer, ops, (size_t)n);
+        records += (unsigned long)n;
+    }
+    if (n < 0) {
+        fprintf(stderr, "Tracefile error at line %lu\n", trace_line(trace));
+    }
+    trace_close(trace);
+    if (!trace_finish(writer)) {
+        fprintf(stderr, "Write file error\n");
+        return -1;
+    }
+    if (n < 0) {
+        return -1;
+    }
+
+    long in_bytes = file_size(input);
+    long out_bytes = file_size(output);
+    fprintf(stderr, "records: %lu\n", records);
+    if (in_bytes > 0 && out_bytes > 0) {
+        fprintf(stderr, "bytes: %ld -> %ld (%.2fx)\n", in_bytes, out_bytes,
+                (double)in_bytes / (double)out_bytes);
+    }
+    return 0;
+}
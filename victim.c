@@ -0,0 +1,138 @@
+/**
+ * @file victim.c
+ * @brief Victim caches and miss caches
+ *
+ * A small fully associative LRU cache sits between a cache and memory,
+ * and is looked up only when the cache misses, as proposed by Jouppi for
+ * the conflict misses of direct-mapped caches:
+ *
+ * - victim: the blocks the cache evicts move into the victim cache. A
+ *   miss that finds its block there swaps it with the block the cache
+ *   evicts for it, so a block bounced out by a conflict comes back
+ *   without going to memory. A block only leaves the two caches when the
+ *   victim cache evicts it, and is written back then if it is dirty.
+ * - miss: every block the cache misses on is also put in the miss cache,
+ *   and stays there however the cache replaces it. The blocks it evicts
+ *   are dropped, as the cache holds any dirty copy.
+ *
+ * The small cache is a csim cache with a single set, which the cache's
+ * misses reach through csim_access_evict(), csim_invalidate() and
+ * csim_fill(). The cache's hits, misses and evictions are those it would
+ * have alone, but its dirty bytes are not: a dirty block swapped back
+ * from a victim cache is dirty again, and the dirty bytes the cache
+ * evicts go to the victim cache rather than to memory. Only the victim
+ * cache's own dirty evictions are written back.
+ */
+
+#include <stdlib.h>
+
+#include "victim.h"
+
+/**
+ * @brief Victim or miss cache attached to a cache
+ */
+struct victim {
+    csim_cache_t *cache;  /* the cache it sits behind, not owned */
+    victim_kind_t kind;   /* which small cache */
+    csim_cache_t *buffer; /* the small cache itself, fully associative */
+    int b;                /* number of block bits */
+    unsigned long hits;   /* main cache misses found in buffer */
+    unsigned long misses; /* main cache misses not found in buffer */
+    unsigned long moves;  /* dirty bytes moved from cache into buffer */
+};
+
+/**
+ * @brief Attach a victim or miss cache to a cache
+ *
+ * The victim cache does not own the cache, whose statistics keep counting
+ * every access simulated through victim_access().
+ *
+ * @return The victim cache, or NULL if config is invalid (no entries or
+ *         more than VICTIM_MAX_ENTRIES) or out of memory
+ */
+victim_t *victim_create(csim_cache_t *cache, const victim_config_t *config) {
+    if (config->entries <= 0 || config->entries > VICTIM_MAX_ENTRIES ||
+        config->b < 0 || config->b >= 64) {
+        return NULL;
+    }
+    victim_t *victim = (victim_t *)calloc(1, sizeof(victim_t));
+    if (victim == NULL) {
+        return NULL;
+    }
+    victim->cache = cache;
+    victim->kind = config->kind;
+    victim->b = config->b;
+    csim_config_t buffer = {.s = 0, .E = config->entries, .b = config->b};
+    victim->buffer = csim_create(&buffer);
+    if (victim->buffer == NULL) {
+        free(victim);
+        return NULL;
+    }
+    return victim;
+}
+
+/**
+ * @brief Free all memory used by a victim cache, but not its cache
+ */
+void victim_destroy(victim_t *victim) {
+    csim_destroy(victim->buffer);
+    free(victim);
+}
+
+/**
+ * @brief Simulate one access to the cache and, on a miss, the victim cache
+ *
+ * @param[in] op The access; a block found in the victim cache still
+ *               counts as a miss of the cache
+ *
+ * @return The outcome of the access in the cache
+ */
+csim_result_t victim_access(victim_t *victim, const access_t *op) {
+    if (victim->kind == VICTIM_MISS) {
+        csim_result_t result = csim_access(victim->cache, op);
+        if (result != CSIM_HIT) {
+            access_t load = {.addr = op->addr, .size = op->size, .op = 'L'};
+            bool found = (csim_access(victim->buffer, &load) == CSIM_HIT);
+            victim->hits += found;
+            victim->misses += !found;
+        }
+        return result;
+    }
+
+    csim_eviction_t evicted;
+    csim_result_t result = csim_access_evict(victim->cache, op, &evicted);
+    if (result == CSIM_HIT) {
+        return result;
+    }
+    bool dirty;
+    if (csim_invalidate(victim->buffer, op->addr, &dirty)) {
+        victim->hits++;
+        if (dirty) {
+            csim_fill(victim->cache, op->addr, true, NULL);
+        }
+    } else {
+        victim->misses++;
+    }
+    if (result == CSIM_MISS_EVICTION) {
+        csim_fill(victim->buffer, evicted.addr, evicted.dirty, NULL);
+        victim->moves += evicted.dirty ? 1UL << victim->b : 0;
+    }
+    return result;
+}
+
+/**
+ * @brief Copy the statistics of the victim cache so far
+ *
+ * @param[out] stats Hits and misses of the cache's misses in the victim
+ *                   cache, the dirty bytes the cache moved into it, and
+ *                   the blocks and dirty bytes it evicted
+ */
+void victim_get_stats(const victim_t *victim, victim_stats_t *stats) {
+    csim_stats_t buffer;
+    csim_get_stats(victim->buffer, &buffer);
+    stats->hits = victim->hits;
+    stats->misses = victim->misses;
+    stats->dirty_moves = victim->moves;
+    stats->evictions = buffer.evictions;
+    stats->dirty_evictions = buffer.dirty_evictions;
+}
@@ -0,0 +1,66 @@
+/**
+ * @file victim.h
+ * @brief Prototypes for victim cache and miss cache simulation
+ */
+
+#ifndef CSIM_VICTIM_H
+#define CSIM_VICTIM_H
+
+#include "libcsim.h"
+#include "trace.h"
+
+/** @brief Largest number of entries of a victim or miss cache */
+#define VICTIM_MAX_ENTRIES 1024
+
+/**
+ * @brief Which small cache sits behind the main one
+ */
+typedef enum {
+    VICTIM_CACHE, /* holds the blocks the main cache evicts */
+    VICTIM_MISS,  /* holds a copy of the blocks the main cache misses on */
+} victim_kind_t;
+
+/**
+ * @brief Parameters of a victim or miss cache
+ */
+typedef struct {
+    victim_kind_t kind; /* which small cache */
+    int b;              /* Number of block bits, as in the cache */
+    int entries;        /* number of blocks it holds, fully associative */
+} victim_config_t;
+
+/**
+ * @brief Statistics of a victim or miss cache
+ *
+ * Only the misses of the main cache look it up, so hits + misses is the
+ * number of misses of the main cache, and the misses are those that go
+ * to memory. The main cache counts a block that moves into a victim
+ * cache as evicted, and its dirty bytes as dirty evictions, though they
+ * are not written back: dirty_moves counts them. The blocks evicted from
+ * the victim cache are those that leave the two, and the dirty ones
+ * among them are the only ones written back.
+ */
+typedef struct {
+    unsigned long hits;            /* main cache misses found here */
+    unsigned long misses;          /* main cache misses sent to memory */
+    unsigned long dirty_moves;     /* dirty bytes moved here, not written */
+    unsigned long evictions;       /* blocks evicted from here */
+    unsigned long dirty_evictions; /* dirty bytes evicted from here */
+} victim_stats_t;
+
+/** @brief Opaque victim or miss cache */
+typedef struct victim victim_t;
+
+/** @brief Attach a victim or miss cache to a cache; NULL if invalid */
+victim_t *victim_create(csim_cache_t *cache, const victim_config_t *config);
+
+/** @brief Free all memory used by a victim cache, but not its cache */
+void victim_destroy(victim_t *victim);
+
+/** @brief Simulate one access to the cache and, on a miss, the victim cache */
+csim_result_t victim_access(victim_t *victim, const access_t *op);
+
+/** @brief Copy the statistics of the victim cache so far */
+void victim_get_stats(const victim_t *victim, victim_stats_t *stats);
+
+#endif /* CSIM_VICTIM_H */